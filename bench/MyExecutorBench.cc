@@ -0,0 +1,135 @@
+//
+// Created by mingweiliu on 2019/1/28.
+//
+// handler线程池在多个io线程同时提交任务时的压测
+// 对比: 默认的 MyThreadPool(单个加锁队列), 可选的 MyWorkStealingPool(全局队列 + 每个线程的deque)
+// external: io线程直接提交任务; nested: 每个任务在handler线程中再提交fanout个子任务
+// 用法: executor_bench [每轮任务总数] [io线程数] [fanout]
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "util/MyThreadPool.h"
+#include "util/MyWorkStealingPool.h"
+
+using namespace MF;
+
+typedef std::function<int32_t()> Task;
+typedef std::function<void(Task&&)> Submit;
+
+//未完成的任务个数上限, 模拟准入控制, 避免io线程无限领先handler线程
+const int64_t g_bench_max_inflight = 8192;
+
+/**
+ * 模拟一个很短的handler
+ * @return 计算结果
+ */
+static int32_t tinyWork() {
+    volatile uint32_t x = 0;
+    for (uint32_t i = 0; i < 64; ++i) {
+        x = x + i;
+    }
+    return static_cast<int32_t >(x);
+}
+
+/**
+ * 执行一轮压测
+ * @param submitters io线程数
+ * @param total 任务总数(包括子任务)
+ * @param fanout 每个任务再提交的子任务数
+ * @param submit 提交任务
+ * @return 吞吐量(百万任务/秒)
+ */
+static double runBench(uint32_t submitters, uint32_t total, uint32_t fanout, const Submit& submit) {
+    std::atomic<int64_t> inflight {0};
+    std::atomic<uint64_t> done {0};
+    uint32_t roots = total / (fanout + 1) / submitters;
+    uint64_t expect = static_cast<uint64_t >(roots) * submitters * (fanout + 1);
+
+    auto leaf = [&]() -> int32_t {
+        auto rv = tinyWork();
+        done.fetch_add(1, std::memory_order_relaxed);
+        inflight.fetch_sub(1, std::memory_order_relaxed);
+        return rv;
+    };
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < submitters; ++i) {
+        threads.emplace_back([&]() {
+            for (uint32_t n = 0; n < roots; ++n) {
+                while (inflight.load(std::memory_order_relaxed) >= g_bench_max_inflight) {
+                    std::this_thread::yield();
+                }
+                inflight.fetch_add(fanout + 1, std::memory_order_relaxed);
+                submit([&]() -> int32_t {
+                    //在handler线程中提交子任务
+                    for (uint32_t k = 0; k < fanout; ++k) {
+                        submit(leaf);
+                    }
+                    return leaf();
+                });
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    while (done.load(std::memory_order_relaxed) < expect) {
+        std::this_thread::yield();
+    }
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return expect / cost / 1000000;
+}
+
+//旧的实现: 所有线程从一个加锁的队列取任务
+static double runLocked(uint32_t workers, uint32_t submitters, uint32_t total, uint32_t fanout) {
+    MyThreadPool<int32_t> pool;
+    pool.initialize(workers);
+
+    auto rv = runBench(submitters, total, fanout, [&](Task&& task) {
+        pool.exec(std::make_shared<std::packaged_task<int32_t()>>(std::move(task)));
+    });
+
+    //工作线程最多等待500ms之后才能看到退出标志
+    pool.stop();
+    pool.wait();
+    return rv;
+}
+
+//新的实现: work stealing
+static double runStealing(uint32_t workers, uint32_t submitters, uint32_t total, uint32_t fanout) {
+    MyWorkStealingPool<int32_t> pool;
+    pool.initialize(workers);
+
+    return runBench(submitters, total, fanout, [&](Task&& task) {
+        pool.exec(std::unique_ptr<std::packaged_task<int32_t()>>(
+                new std::packaged_task<int32_t()>(std::move(task))));
+    });
+}
+
+int main(int argc, char** argv) {
+    uint32_t total = argc > 1 ? static_cast<uint32_t >(atoi(argv[1])) : 1000000;
+    uint32_t submitters = argc > 2 ? static_cast<uint32_t >(atoi(argv[2])) : 4;
+    uint32_t fanout = argc > 3 ? static_cast<uint32_t >(atoi(argv[3])) : 8;
+    submitters = submitters > 0 ? submitters : 1;
+
+    printf("tasks: %u, io threads: %u, fanout: %u, cpus: %u\n",
+           total, submitters, fanout, std::thread::hardware_concurrency());
+    printf("%8s %10s %16s %16s\n", "workers", "mode", "locked(Mops/s)", "stealing(Mops/s)");
+    uint32_t workerCounts[] = {8, 16, 64};
+    for (auto workers : workerCounts) {
+        auto l = runLocked(workers, submitters, total, 0);
+        auto s = runStealing(workers, submitters, total, 0);
+        printf("%8u %10s %16.3f %16.3f\n", workers, "external", l, s);
+
+        l = runLocked(workers, submitters, total, fanout);
+        s = runStealing(workers, submitters, total, fanout);
+        printf("%8u %10s %16.3f %16.3f\n", workers, "nested", l, s);
+    }
+    return 0;
+}
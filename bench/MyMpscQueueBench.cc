@@ -0,0 +1,156 @@
+//
+// Created by mingweiliu on 2019/1/10.
+//
+// 多个handler线程向同一个channel发送响应的压测
+// 对比: 旧的 writeBufMutex + 拷贝到MySKBuffer, 现在的加锁拷贝到MyIOBufChain, 无锁队列传递整个响应
+// 用法: mpsc_bench [每轮消息总数] [消息长度]
+//
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <cstring>
+#include "net/MyGlobal.h"
+#include "net/buffer/MySKBuffer.h"
+#include "net/buffer/MyIOBufChain.h"
+#include "util/MyMpscQueue.h"
+
+using namespace MF;
+
+//未发送的响应个数上限, 模拟写水位, 避免handler线程无限领先io线程
+const int64_t g_bench_max_inflight = 4096;
+
+/**
+ * 执行一轮压测
+ * @param threads handler线程数
+ * @param total 消息总数
+ * @param produce handler线程发送一个响应
+ * @param consume io线程取出所有响应, 返回取出的个数
+ * @return 吞吐量(百万次/秒)
+ */
+template<typename Produce, typename Consume>
+static double runBench(uint32_t threads, uint32_t total, Produce&& produce, Consume&& consume) {
+    std::atomic<int64_t> inflight {0};
+    uint64_t expect = static_cast<uint64_t >(total / threads) * threads;
+
+    auto begin = std::chrono::steady_clock::now();
+    std::thread consumer([&]() {
+        uint64_t received = 0;
+        while (received < expect) {
+            uint32_t count = consume();
+            inflight -= count;
+            received += count;
+            if (count == 0) {
+                std::this_thread::yield(); //没有数据, 模拟io线程等待通知
+            }
+        }
+    });
+
+    std::vector<std::thread> producers;
+    for (uint32_t i = 0; i < threads; ++i) {
+        producers.emplace_back([&]() {
+            for (uint32_t n = 0; n < total / threads; ++n) {
+                while (inflight.load(std::memory_order_relaxed) >= g_bench_max_inflight) {
+                    std::this_thread::yield();
+                }
+                ++inflight;
+                produce();
+            }
+        });
+    }
+
+    for (auto& t : producers) {
+        t.join();
+    }
+    consumer.join();
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return expect / cost / 1000000;
+}
+
+//旧的实现: handler线程加锁拷贝, io线程加锁取出
+static double runMutex(uint32_t threads, uint32_t total, uint32_t length) {
+    Buffer::MySKBuffer writeBuf(g_default_skbuffer_capacity);
+    std::mutex writeBufMutex;
+    std::vector<char> payload(length, 'x');
+
+    return runBench(threads, total, [&]() {
+        //handler编码得到的响应
+        auto rsp = Buffer::MyIOBuf::create(length);
+        rsp->write<char*>(payload.data(), length);
+
+        std::lock_guard<std::mutex> guard(writeBufMutex);
+        char* tmp = writeBuf.getWriteableAndMove(length);
+        memcpy(tmp, rsp->readable(), length);
+    }, [&]() -> uint32_t {
+        std::lock_guard<std::mutex> guard(writeBufMutex);
+        uint32_t len = writeBuf.getReadableLength();
+        if (len > 0) {
+            writeBuf.getReadableAndMove(&len); //模拟write全部发送成功
+        }
+        return len / length;
+    });
+}
+
+//现在的实现: handler线程加锁拷贝到发送队列尾部的块, io线程加锁一次全部转移, 不拷贝
+static double runChain(uint32_t threads, uint32_t total, uint32_t length) {
+    Buffer::MyIOBufChain responseQueue;
+    std::mutex responseMutex;
+    Buffer::MyIOBufChain writeQueue;
+    std::vector<char> payload(length, 'x');
+
+    return runBench(threads, total, [&]() {
+        //handler编码得到的响应
+        auto rsp = Buffer::MyIOBuf::create(length);
+        rsp->write<char*>(payload.data(), length);
+
+        std::lock_guard<std::mutex> guard(responseMutex);
+        responseQueue.write(rsp->readable(), length);
+    }, [&]() -> uint32_t {
+        {
+            std::lock_guard<std::mutex> guard(responseMutex);
+            writeQueue.append(responseQueue);
+        }
+        uint32_t len = writeQueue.getReadableLength();
+        writeQueue.moveReadable(len); //模拟writev全部发送成功
+        return len / length;
+    });
+}
+
+//无锁队列: handler线程不拷贝, 整个响应放入队列, io线程取出挂到发送队列
+static double runMpsc(uint32_t threads, uint32_t total, uint32_t length) {
+    MyMpscQueue<std::unique_ptr<Buffer::MyIOBuf>> responseQueue;
+    Buffer::MyIOBufChain writeQueue;
+    std::vector<char> payload(length, 'x');
+
+    return runBench(threads, total, [&]() {
+        //handler编码得到的响应
+        auto rsp = Buffer::MyIOBuf::create(length);
+        rsp->write<char*>(payload.data(), length);
+        responseQueue.push(std::move(rsp));
+    }, [&]() -> uint32_t {
+        uint32_t count = 0;
+        std::unique_ptr<Buffer::MyIOBuf> rsp;
+        while (responseQueue.pop(rsp)) {
+            writeQueue.append(std::move(rsp));
+            ++count;
+        }
+        writeQueue.moveReadable(writeQueue.getReadableLength()); //模拟writev全部发送成功
+        return count;
+    });
+}
+
+int main(int argc, char** argv) {
+    uint32_t total = argc > 1 ? static_cast<uint32_t >(atoi(argv[1])) : 1000000;
+    uint32_t length = argc > 2 ? static_cast<uint32_t >(atoi(argv[2])) : 256;
+
+    printf("messages: %u, length: %u, cpus: %u\n", total, length, std::thread::hardware_concurrency());
+    printf("%8s %16s %16s %16s\n", "threads", "mutex(Mops/s)", "chain(Mops/s)", "mpsc(Mops/s)");
+    for (uint32_t threads = 1; threads <= 32; threads *= 2) {
+        auto m = runMutex(threads, total, length);
+        auto c = runChain(threads, total, length);
+        auto q = runMpsc(threads, total, length);
+        printf("%8u %16.3f %16.3f %16.3f\n", threads, m, c, q);
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+//
+// Created by mingweiliu on 2019/1/25.
+//
+// 共享内存通道的往返延迟压测, client写入请求, server读到之后原样写回
+// 对比: 两端忙轮询, 没有数据时等待doorbell
+// 目标: 忙轮询时往返延迟在5us以内
+// 用法: shm_bench [往返次数] [消息长度]
+//
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include "net/MyGlobal.h"
+#include "net/buffer/MyShmRing.h"
+
+using namespace MF;
+
+//每个方向ring的长度
+const uint32_t g_bench_ring_capacity = 1024 * 1024;
+
+/**
+ * 读取一条完整的消息, 没有数据时忙轮询或者等待doorbell
+ * @param rings 共享内存ring
+ * @param buf buffer
+ * @param length 消息长度
+ * @param busyPoll 是否忙轮询
+ * @return true 成功 false 对端关闭
+ */
+static bool receiveMessage(Buffer::MyShmRingPair& rings, char* buf, uint32_t length, bool busyPoll) {
+    uint32_t received = 0;
+    while (received < length) {
+        if (rings.getReceivable() == 0) {
+            if (rings.isPeerClosed()) {
+                return false;
+            }
+            if (busyPoll || !rings.park()) {
+                continue;
+            }
+
+            //已经在等待, 对端写入之后会敲doorbell
+            struct pollfd pfd = {rings.getDoorbell(), POLLIN, 0};
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                return false;
+            }
+            rings.wake(true);
+            continue;
+        }
+        received += rings.receive(buf + received, length - received);
+    }
+    return true;
+}
+
+/**
+ * 写入一条完整的消息
+ * @param rings 共享内存ring
+ * @param buf 数据
+ * @param length 消息长度
+ */
+static void sendMessage(Buffer::MyShmRingPair& rings, char* buf, uint32_t length) {
+    uint32_t sent = 0;
+    while (sent < length) {
+        struct iovec iov = {buf + sent, length - sent};
+        sent += rings.send(&iov, 1, length - sent); //消息远小于ring, 这里基本不会重试
+    }
+}
+
+/**
+ * 执行一轮压测
+ * @param rounds 往返次数
+ * @param length 消息长度
+ * @param busyPoll 是否忙轮询
+ * @param latencies 返回每次往返的延迟(ns)
+ * @return 0 成功 -1 失败
+ */
+static int32_t runPingPong(uint32_t rounds, uint32_t length, bool busyPoll, std::vector<int64_t>& latencies) {
+    //1. client创建共享内存, server映射同一份fd, 和跨进程传递fd之后的状态一样
+    Buffer::MyShmRingPair client;
+    if (client.create(g_bench_ring_capacity) != 0) {
+        return -1;
+    }
+    int32_t fds[Buffer::MyShmRingPair::kFdCount];
+    client.getFds(fds);
+    for (auto& fd : fds) {
+        fd = dup(fd); //attach之后server持有fd
+    }
+    Buffer::MyShmRingPair server;
+    if (server.attach(fds, Buffer::MyShmRingPair::kFdCount) != 0) {
+        return -1;
+    }
+
+    //2. server原样写回, client关闭之后退出
+    std::thread echo([&]() {
+        std::vector<char> buf(length);
+        while (receiveMessage(server, buf.data(), length, busyPoll)) {
+            sendMessage(server, buf.data(), length);
+        }
+    });
+
+    //3. client逐个发送, 收到响应之后再发送下一个
+    std::vector<char> request(length, 'x');
+    std::vector<char> response(length);
+    latencies.clear();
+    latencies.reserve(rounds);
+    for (uint32_t i = 0; i < rounds; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        sendMessage(client, request.data(), length);
+        if (!receiveMessage(client, response.data(), length, busyPoll)) {
+            break;
+        }
+        latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count());
+    }
+
+    client.close();
+    echo.join();
+    return latencies.size() == rounds ? 0 : -1;
+}
+
+/**
+ * 输出延迟的分布
+ * @param name 模式
+ * @param latencies 每次往返的延迟(ns)
+ */
+static void report(const char* name, std::vector<int64_t>& latencies) {
+    if (latencies.empty()) {
+        printf("%12s %12s\n", name, "failed");
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&](double p) -> double {
+        auto index = static_cast<size_t >(p * (latencies.size() - 1));
+        return latencies[index] / 1000.0;
+    };
+    double sum = 0;
+    for (auto latency : latencies) {
+        sum += latency;
+    }
+    double avg = sum / latencies.size() / 1000;
+    double p50 = at(0.5);
+    double p99 = at(0.99);
+    double p999 = at(0.999);
+    printf("%12s %12.3f %12.3f %12.3f %12.3f\n", name, avg, p50, p99, p999);
+}
+
+int main(int argc, char** argv) {
+    uint32_t rounds = argc > 1 ? static_cast<uint32_t >(atoi(argv[1])) : 1000000;
+    uint32_t length = argc > 2 ? static_cast<uint32_t >(atoi(argv[2])) : 64;
+
+    printf("rounds: %u, length: %u, cpus: %u\n", rounds, length, std::thread::hardware_concurrency());
+    if (std::thread::hardware_concurrency() < 2) {
+        printf("warning: busy poll needs two cpus, latency is bounded by the scheduler time slice\n");
+    }
+    printf("%12s %12s %12s %12s %12s\n", "mode", "avg(us)", "p50(us)", "p99(us)", "p99.9(us)");
+
+    std::vector<int64_t> latencies;
+    runPingPong(rounds, length, true, latencies);
+    report("busy-poll", latencies);
+    runPingPong(rounds / 10, length, false, latencies); //每次往返至少两次唤醒, 次数减少
+    report("doorbell", latencies);
+    return 0;
+}
@@ -32,15 +32,46 @@ namespace MF {
         kClientResultFail = 100, //失败
     }ClientResult;
 
+    typedef enum enumLoopBackend : uint32_t {
+        kLoopBackendEpoll = 0, //libev, 默认
+        kLoopBackendIoUring = 1, //tcp连接的accept/recv/send使用io_uring, 内核不支持时退回epoll
+    }LoopBackend;
+
     //socket相关
-    const uint32_t g_default_listen_backlog = 10; //默认等待链接数
+    const uint32_t g_default_listen_backlog = 1024; //默认等待链接数
+    const uint32_t g_default_accept_budget = 256; //每次监听socket可读时最多accept的连接数
     
     const uint32_t g_default_skbuffer_capacity = 1024 * 16; //socket使用的skbuffer的默认长度
+    const uint32_t g_default_buffer_pool_idle = 1024; //每个loop缓存的空闲skbuffer个数
     const uint32_t g_default_iobuf_capacity = 1024; //iobuf使用的skbuffer默认长度
     const uint32_t g_max_packet_length = 1024 * 1024; //默认的最大数据包长度
+    const uint32_t g_default_read_size = 1024 * 4; //tcp一次read的初始长度, 根据最近读取的数据量调整
+    const uint32_t g_max_read_size = 1024 * 256; //tcp一次read的最大长度
+    const uint32_t g_default_read_budget = 1024 * 1024; //tcp连接每次可读事件最多读取的字节数, 剩下的等下一轮
+    const uint32_t g_default_admission_target_us = 5000; //开启准入控制时推荐的handler任务排队时间目标(微秒), 持续超过时开始拒绝新请求
+    const uint32_t g_default_admission_interval_us = 100000; //排队时间持续超过目标多久之后进入过载状态(微秒)
     const uint32_t g_default_wheel_timer_slot_count = 1024 * 1024; //最大slot个数
 
     const uint32_t g_max_udp_packet_length = 1500; //udp最大数据包长度
+    const uint32_t g_default_udp_batch_size = 64; //udp一次系统调用收发的数据包个数
+    const uint32_t g_default_dispatch_batch_size = 64; //一次读取的多个完整数据包合并成一个handler任务的最大个数
+    const uint32_t g_max_udp_offload_length = 65535; //开启GSO/GRO之后一次收发的最大长度
+    const uint32_t g_max_udp_gso_segments = 64; //GSO一次发送的最大数据包个数
+
+    const uint32_t g_default_write_high_watermark = 1024 * 1024 * 4; //待发送数据超过该值时暂停读取
+    const uint32_t g_default_write_low_watermark = 1024 * 1024; //待发送数据低于该值时恢复读取
+    const uint32_t g_response_copy_limit = 4096; //不超过该长度的响应拷贝到发送队列, 更长的直接挂上不拷贝
+
+    const uint32_t g_default_uring_entries = 1024; //io_uring提交队列的长度
+    const uint32_t g_default_uring_buffer_count = 1024; //每个loop的io_uring接收buffer个数, 必须是2的幂
+    const uint32_t g_default_uring_buffer_size = 1024 * 16; //io_uring每个接收buffer的长度
+    const uint32_t g_max_uring_linked_sends = 16; //一次链接提交的send个数, 更多的块等前面的发完再提交
+
+    const uint32_t g_default_shm_ring_size = 1024 * 1024; //共享内存每个方向ring的默认长度
+    const uint32_t g_shm_handshake_magic = 0x4d465348; //共享内存握手消息, 和fd一起发送
+
+    const uint32_t g_default_inline_budget_us = 200; //在io线程直接执行的handler的耗时上限(微秒), 超过之后改回线程池执行
+    const uint32_t g_inline_overrun_limit = 3; //连续超过耗时上限的次数, 达到之后才改回线程池执行, 避免偶然的调度延迟
 
     
     typedef enum EndpointProtocol : uint32_t {
@@ -0,0 +1,345 @@
+//
+// Created by mingweiliu on 2019/1/8.
+//
+
+#ifndef MYFRAMEWORK2_MYIOBUFCHAIN_H
+#define MYFRAMEWORK2_MYIOBUFCHAIN_H
+
+#include <list>
+#include <iterator>
+#include <climits>
+#include <sys/uio.h>
+#include "net/buffer/myIOBuf.h"
+
+namespace MF {
+    namespace Buffer {
+        /// 由多个IOBuf组成的链式buffer
+        /// 追加数据时只在尾部分配固定大小的新块，不会移动或者拷贝已有的数据
+        /// append/prepend整个IOBuf都是O(1)的，不拷贝数据
+        /// 可以导出iovec, 给socket做readv/writev
+        /// 和IOBuf一样，不支持多线程操作
+        class MyIOBufChain {
+        public:
+            /**
+             *  @brief 构造函数
+             *
+             *  @param blockSize 每个块的容量
+             */
+            explicit MyIOBufChain(uint32_t blockSize = 1024 * 16) : blockSize_(blockSize) {}
+
+            /**
+             *  @brief 构造一个chain对象
+             *
+             *  @param blockSize 每个块的容量，默认16K
+             *
+             *  @return chain对象
+             */
+            static std::unique_ptr<MyIOBufChain> create(uint32_t blockSize = 1024 * 16) {
+                std::unique_ptr<MyIOBufChain> chain(new MyIOBufChain(blockSize));
+                return chain;
+            }
+
+            /**
+             *  @brief 获取可读数据的长度
+             *
+             *  @return 长度
+             */
+            uint32_t getReadableLength() const {
+                return length_;
+            }
+
+            /**
+             *  @brief 是否没有可读数据
+             *
+             *  @return true 没有数据
+             */
+            bool empty() const {
+                return length_ == 0;
+            }
+
+            /**
+             *  @brief 获取块的个数
+             *
+             *  @return 块的个数
+             */
+            uint32_t getBlockCount() const {
+                return static_cast<uint32_t>(blocks_.size());
+            }
+
+            /**
+             *  @brief 在尾部追加一个IOBuf，不拷贝数据
+             *
+             *  @param iobuf iobuf
+             */
+            void append(std::unique_ptr<MyIOBuf> iobuf) {
+                if (iobuf == nullptr) {
+                    return;
+                }
+
+                length_ += iobuf->getReadableLength();
+                blocks_.push_back(std::move(iobuf));
+            }
+
+            /**
+             *  @brief 在头部插入一个IOBuf，不拷贝数据
+             *
+             *  @param iobuf iobuf
+             */
+            void prepend(std::unique_ptr<MyIOBuf> iobuf) {
+                if (iobuf == nullptr) {
+                    return;
+                }
+
+                length_ += iobuf->getReadableLength();
+                blocks_.push_front(std::move(iobuf));
+            }
+
+            /**
+             *  @brief 将另一个chain的所有块追加到尾部
+             *
+             *  @param chain chain
+             */
+            void append(std::unique_ptr<MyIOBufChain> chain) {
+                if (chain == nullptr) {
+                    return;
+                }
+
+                append(*chain);
+            }
+
+            /**
+             *  @brief 将另一个chain的所有块转移到尾部, 之后该chain为空
+             *
+             *  @param chain chain
+             */
+            void append(MyIOBufChain& chain) {
+                blocks_.splice(blocks_.end(), chain.blocks_); //直接转移节点
+                length_ += chain.length_;
+                chain.length_ = 0;
+            }
+
+            /**
+             *  @brief 拷贝一段数据到尾部, 尾部空间不够时分配新的块
+             *
+             *  @param buf 数据
+             *  @param length 数据长度
+             */
+            void write(const void* buf, uint32_t length) {
+                auto src = static_cast<const char*>(buf);
+                auto it = writeStart();
+                while (length > 0) {
+                    if (it == blocks_.end()) {
+                        it = blocks_.insert(blocks_.end(), MyIOBuf::create(blockSize_));
+                    }
+
+                    auto& block = *it;
+                    uint32_t len = std::min(block->getTailroom(), length);
+                    if (len > 0) {
+                        std::memcpy(block->tail(), src, len);
+                        block->moveWriteable(len);
+                        length_ += len;
+                        src += len;
+                        length -= len;
+                    }
+                    ++it;
+                }
+            }
+
+            /**
+             *  @brief 拷贝头部的数据，不移动可读指针
+             *
+             *  @param buf 目标buffer
+             *  @param length 需要拷贝的长度
+             *
+             *  @return 实际拷贝的长度
+             */
+            uint32_t peek(void* buf, uint32_t length) const {
+                auto dst = static_cast<char*>(buf);
+                uint32_t copied = 0;
+                for (auto it = blocks_.begin(); it != blocks_.end() && copied < length; ++it) {
+                    uint32_t len = std::min((*it)->getReadableLength(), length - copied);
+                    if (len > 0) {
+                        std::memcpy(dst + copied, (*it)->readable(), len);
+                        copied += len;
+                    }
+                }
+                return copied;
+            }
+
+            /**
+             *  @brief 读取头部的数据，并且移动可读指针
+             *
+             *  @param buf 目标buffer
+             *  @param length 需要读取的长度
+             *
+             *  @return 实际读取的长度
+             */
+            uint32_t read(void* buf, uint32_t length) {
+                uint32_t len = peek(buf, length);
+                moveReadable(len);
+                return len;
+            }
+
+            /**
+             *  @brief 移动可读指针，读完的块会被释放
+             *
+             *  @param length 长度
+             */
+            void moveReadable(uint32_t length) {
+                if (length > length_) {
+                    length = length_;
+                }
+                length_ -= length;
+
+                while (!blocks_.empty()) {
+                    auto& block = blocks_.front();
+                    uint32_t len = std::min(block->getReadableLength(), length);
+                    block->moveReadable(len);
+                    length -= len;
+
+                    //只释放读完并且已经写满的块，尾部还在写的块保留
+                    if (block->getReadableLength() > 0
+                        || (length == 0 && blocks_.size() == 1 && block->getTailroom() > 0)) {
+                        break;
+                    }
+                    blocks_.pop_front();
+                }
+            }
+
+            /**
+             *  @brief 导出可读数据的iovec, 用于writev
+             *
+             *  @param iov iovec数组
+             *  @param count iovec数组的长度
+             *
+             *  @return 填充的iovec个数
+             */
+            uint32_t readableIovec(struct iovec* iov, uint32_t count) const {
+                uint32_t n = 0;
+                for (auto it = blocks_.begin(); it != blocks_.end() && n < count; ++it) {
+                    uint32_t len = (*it)->getReadableLength();
+                    if (len == 0) {
+                        continue;
+                    }
+
+                    iov[n].iov_base = (*it)->readable();
+                    iov[n].iov_len = len;
+                    ++n;
+                }
+                return n;
+            }
+
+            /**
+             *  @brief 在尾部预留至少length字节的空间，并且导出iovec, 用于readv
+             *  读取完成之后需要调用moveWriteable
+             *
+             *  @param iov iovec数组
+             *  @param count iovec数组的长度
+             *  @param length 需要预留的长度
+             *
+             *  @return 填充的iovec个数
+             */
+            uint32_t writeableIovec(struct iovec* iov, uint32_t count, uint32_t length) {
+                uint32_t n = 0;
+                uint32_t reserved = 0;
+                auto it = writeStart();
+                while (n < count && reserved < length) {
+                    if (it == blocks_.end()) {
+                        it = blocks_.insert(blocks_.end(), MyIOBuf::create(blockSize_));
+                    }
+
+                    auto& block = *it;
+                    uint32_t len = block->getTailroom();
+                    if (len > 0) {
+                        iov[n].iov_base = block->tail();
+                        iov[n].iov_len = len;
+                        reserved += len;
+                        ++n;
+                    }
+                    ++it;
+                }
+                return n;
+            }
+
+            /**
+             *  @brief 确认readv写入的数据
+             *
+             *  @param length 写入的长度
+             */
+            void moveWriteable(uint32_t length) {
+                auto it = writeStart();
+                while (length > 0 && it != blocks_.end()) {
+                    auto& block = *it;
+                    uint32_t len = std::min(block->getTailroom(), length);
+                    block->moveWriteable(len);
+                    length_ += len;
+                    length -= len;
+                    ++it;
+                }
+            }
+
+            /**
+             *  @brief 合并成一个连续的IOBuf
+             *  只有一个块时直接返回该块，不拷贝数据
+             *
+             *  @return iobuf
+             */
+            std::unique_ptr<MyIOBuf> coalesce() {
+                //跳过空块
+                while (!blocks_.empty() && blocks_.front()->getReadableLength() == 0) {
+                    blocks_.pop_front();
+                }
+
+                std::unique_ptr<MyIOBuf> iobuf;
+                if (blocks_.size() == 1) {
+                    iobuf = std::move(blocks_.front());
+                } else {
+                    iobuf = MyIOBuf::create(length_ > 0 ? length_ : 1);
+                    for (auto it = blocks_.begin(); it != blocks_.end(); ++it) {
+                        uint32_t len = (*it)->getReadableLength();
+                        if (len > 0) {
+                            iobuf->write<void*>((*it)->readable(), len);
+                        }
+                    }
+                }
+
+                blocks_.clear();
+                length_ = 0;
+                return iobuf;
+            }
+
+        protected:
+            /**
+             *  @brief 获取第一个可以继续写入的块
+             *  即最后一个有数据的块(有剩余空间时)或者它之后的块
+             *
+             *  @return 块的位置
+             */
+            std::list<std::unique_ptr<MyIOBuf>>::iterator writeStart() {
+                auto it = blocks_.end();
+                while (it != blocks_.begin()) {
+                    auto prev = std::prev(it);
+                    if ((*prev)->getReadableLength() > 0 || (*prev)->getTailroom() == 0) {
+                        break;
+                    }
+                    it = prev; //跳过尾部预留的空块
+                }
+
+                if (it != blocks_.begin() && (*std::prev(it))->getTailroom() > 0) {
+                    --it;
+                }
+                return it;
+            }
+
+        public:
+            MyIOBufChain(const MyIOBufChain& r) = delete;
+            MyIOBufChain& operator = (const MyIOBufChain& r) = delete;
+        private:
+            std::list<std::unique_ptr<MyIOBuf>> blocks_; //所有的块, 空链表不分配内存
+            uint32_t blockSize_; //新分配块的容量
+            uint32_t length_ {0}; //可读数据的总长度
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYIOBUFCHAIN_H
@@ -12,6 +12,7 @@
 #include <iostream>
 #include <cstring>
 #include <cassert>
+#include <utility>
 
 namespace MF {
     
@@ -21,6 +22,7 @@ namespace MF {
         //当用在socket上时，需要在buffer上层做好线程同步
         //当没有可写空间时，会先将已经使用的内存向前移动
         //如果移动完之后仍然没有足够的空间，buffer自动拓展
+        //视图模式(view)下buffer不持有内存，只能读取，不能写入
         class MySKBuffer {
         public:
             
@@ -34,12 +36,71 @@ namespace MF {
                 //2. 准备data
                 data_ = reinterpret_cast<void*>(reinterpret_cast<char*>(head_) + sizeof(SKBufferHead));
             }
+
+            /**
+             *  @brief 构造一个空的视图, 需要调用wrap来指定数据
+             */
+            MySKBuffer() {
+                owned_ = false;
+                min_capacity_ = 0;
+                head_ = &view_;
+                data_ = nullptr;
+            }
             
             /**
              *  @brief 析构函数
              */
             ~MySKBuffer() {
-                std::free(head_);
+                if (owned_) {
+                    std::free(head_);
+                }
+            }
+
+            MySKBuffer(const MySKBuffer& r) = delete;
+            MySKBuffer& operator = (const MySKBuffer& r) = delete;
+
+            /**
+             *  @brief 将视图指向一段外部内存, 内存的生命周期由调用者保证
+             *
+             *  @param data 数据
+             *  @param length 数据长度
+             */
+            void wrap(char* data, uint32_t length) {
+                assert(!owned_);
+                view_.capacity_ = length;
+                view_.readable_ = 0;
+                view_.writeable_ = length;
+                data_ = static_cast<void*>(data);
+            }
+
+            /**
+             *  @brief 是否持有内存
+             *
+             *  @return true 持有内存 false 视图
+             */
+            bool isOwned() const {
+                return owned_;
+            }
+
+            /**
+             *  @brief 交换两个buffer
+             *
+             *  @param r 另一个buffer
+             */
+            void swap(MySKBuffer& r) {
+                std::swap(owned_, r.owned_);
+                std::swap(min_capacity_, r.min_capacity_);
+                std::swap(view_, r.view_);
+                std::swap(head_, r.head_);
+                std::swap(data_, r.data_);
+
+                //视图的head指向自身的view_
+                if (!owned_) {
+                    head_ = &view_;
+                }
+                if (!r.owned_) {
+                    r.head_ = &r.view_;
+                }
             }
             
             //////////////
@@ -64,6 +125,15 @@ namespace MF {
                 return head_->capacity_ - getReadableLength();
             }
             
+            /**
+             *  @brief 获取尾部可以直接追加的长度, 不包含需要整理之后才能使用的空间
+             *
+             *  @return 尾部空间的长度
+             */
+            uint32_t getTailLength() const {
+                return owned_ ? head_->capacity_ - head_->writeable_ : 0;
+            }
+            
             /**
              *  @brief 获取可读指针的位置
              *
@@ -129,6 +199,10 @@ namespace MF {
              *  @return 可写指针
              */
             char* writeable(uint32_t length) {
+                if (!owned_) { //视图不能写入
+                    return nullptr;
+                }
+
                 //1. 检查readable和writeable是否相同，如果相同，说明read已经追上write，那么将writeable重置为0
                 if (head_->readable_ == head_->writeable_) {
                     head_->readable_ = 0;
@@ -139,7 +213,7 @@ namespace MF {
                     if (getWriteableLength() >= length) { //如果总的可用空间够了，那么就重新整理当前buffer
                         sort();
                     } else {
-                        incr();
+                        incr(length);
                     }
                 }
                 
@@ -160,6 +234,10 @@ namespace MF {
              *  @return 可写指针
              */
             char* getWriteableAndMove(uint32_t length) {
+                if (!owned_) { //视图不能写入
+                    return nullptr;
+                }
+
                 //1. 检查readable和writeable是否相同，如果相同，说明read已经追上write，那么将writeable重置为0
                 if (head_->readable_ == head_->writeable_) {
                     head_->readable_ = 0;
@@ -170,7 +248,7 @@ namespace MF {
                     if (getWriteableLength() >= length) { //如果总的可用空间够了，那么就重新整理当前buffer
                         sort();
                     } else {
-                        incr();
+                        incr(length);
                     }
                 }
                 
@@ -183,6 +261,22 @@ namespace MF {
                 return writeable;
             }
             
+            /**
+             *  @brief 获取尾部的可写指针, 不会移动、整理或者扩容已有的数据
+             *  已读区域仍然被引用时(例如被切片引用)，只能使用这个接口追加数据
+             *
+             *  @param length 需要写入的长度
+             *
+             *  @return 可写指针, 尾部空间不够时返回nullptr
+             */
+            char* appendable(uint32_t length) {
+                if (!owned_ || head_->writeable_ + length > head_->capacity_) {
+                    return nullptr;
+                }
+
+                return static_cast<char*>(data_) + head_->writeable_;
+            }
+
             /**
              *  @brief 移动write able, 在调用writeable之后在调用move_writeable, 否则可能会导致内存被改写
              *
@@ -213,7 +307,17 @@ namespace MF {
             void reset() {
                 head_->readable_ = 0;
                 head_->writeable_ = 0;
-                std::memset(data_, 0, head_->capacity_);
+                if (owned_) {
+                    std::memset(data_, 0, head_->capacity_);
+                }
+            }
+
+            /**
+             *  @brief 清空数据, 不清零内存, 用于复用buffer
+             */
+            void clear() {
+                head_->readable_ = 0;
+                head_->writeable_ = 0;
             }
             
         protected:
@@ -233,31 +337,35 @@ namespace MF {
                 uint32_t len = getReadableLength();
                 std::memmove(data_, src, len);
                 
-                //3. 重新设置readable和writeable
+                //3. 重新设置readable和writeable, 可写内存会被覆盖，不需要清零
                 head_->readable_ = 0;
                 head_->writeable_ = head_->readable_ + len;
-                
-                //4. 重置可写内存
-                std::memset(static_cast<char*>(data_) + head_->writeable_, 0x00, head_->capacity_ - head_->writeable_);
             }
             
             /**
-             *  @brief 扩容空间
+             *  @brief 扩容空间, 容量按倍数增长，避免大数据包反复扩容拷贝
+             *
+             *  @param length 需要写入的长度
              */
-            void incr() {
-                //1. 生成new head
-                auto newhead = InitHead(head_->capacity_ + min_capacity_);
-                
-                //2. 拷贝数据
-                std::memcpy(reinterpret_cast<char*>(newhead) + sizeof(uint32_t), reinterpret_cast<char*>(head_) + sizeof(uint32_t), head_->capacity_); //不拷贝头4个字节
+            void incr(uint32_t length) {
+                //1. 计算新的容量，至少能容纳已有数据和需要写入的数据
+                uint32_t len = getReadableLength();
+                uint32_t capacity = head_->capacity_ * 2;
+                if (capacity < len + length) {
+                    capacity = len + length;
+                }
+
+                //2. 生成new head, 只拷贝未读的数据
+                auto newhead = static_cast<SKBufferHead*>(std::malloc(capacity + sizeof(SKBufferHead)));
+                newhead->capacity_ = capacity;
+                newhead->readable_ = 0;
+                newhead->writeable_ = len;
+                std::memcpy(reinterpret_cast<char*>(newhead) + sizeof(SKBufferHead), static_cast<char*>(data_) + head_->readable_, len);
                 
                 //3. 释放旧的head，并且设置新的head和data
                 std::free(head_);
                 head_ = newhead;
                 data_ = reinterpret_cast<void*>(reinterpret_cast<char*>(head_) + sizeof(SKBufferHead));
-                
-                //4. 重新排序newhead
-                sort();
             }
             
         private:
@@ -293,6 +401,9 @@ namespace MF {
             
             SKBufferHead* head_; //头结点
             void* data_; //数据节点
+
+            bool owned_ {true}; //是否持有内存
+            SKBufferHead view_ {0, 0, 0}; //视图模式下使用的头结点
         };
     }
 }
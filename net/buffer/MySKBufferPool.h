@@ -0,0 +1,168 @@
+//
+// Created by mingweiliu on 2019/1/21.
+//
+
+#ifndef MYFRAMEWORK2_MYSKBUFFERPOOL_H
+#define MYFRAMEWORK2_MYSKBUFFERPOOL_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "net/buffer/MySKBuffer.h"
+
+namespace MF {
+    namespace Buffer {
+
+        /**
+         * 连接使用的read buffer池, 每个loop一个
+         * 连接只在有待处理数据时持有buffer, 处理完之后归还, 空闲连接不占用buffer
+         * acquire/release只能在loop线程调用, 统计数据可以在任意线程读取
+         */
+        class MySKBufferPool {
+        public:
+            /**
+             * 构造函数
+             * @param capacity 每个buffer的容量
+             * @param maxIdle 最多缓存的空闲buffer个数
+             */
+            MySKBufferPool(uint32_t capacity, uint32_t maxIdle) : capacity(capacity), maxIdle(maxIdle) {
+            }
+
+            /**
+             * 获取一个buffer, 没有空闲buffer时先回收切片已经释放的buffer
+             * @return buffer
+             */
+            std::shared_ptr<MySKBuffer> acquire() {
+                inUse.fetch_add(1, std::memory_order_relaxed);
+                if (idle.empty() && !sliced.empty()) {
+                    reclaim();
+                }
+                if (idle.empty()) {
+                    return std::make_shared<MySKBuffer>(capacity);
+                }
+
+                auto buf = std::move(idle.back());
+                idle.pop_back();
+                idleCount.store(idle.size(), std::memory_order_relaxed);
+                return buf;
+            }
+
+            /**
+             * 归还buffer
+             * 还有切片引用的buffer放入等待列表, 切片全部释放之后由reclaim回收; 扩容过的buffer不复用
+             * @param buf buffer
+             */
+            void release(std::shared_ptr<MySKBuffer>&& buf) {
+                if (buf == nullptr) {
+                    return;
+                }
+                inUse.fetch_sub(1, std::memory_order_relaxed);
+
+                if (buf.use_count() != 1) {
+                    slicedBytes.fetch_add(buf->capacity(), std::memory_order_relaxed);
+                    sliced.push_back(std::move(buf));
+                    slicedCount.store(sliced.size(), std::memory_order_relaxed);
+                    return;
+                }
+                recycle(std::move(buf));
+            }
+
+            /**
+             * 回收切片已经全部释放的buffer, loop线程定期调用, 没有空闲buffer时acquire也会调用
+             * @return 回收的buffer个数
+             */
+            uint32_t reclaim() {
+                uint32_t reclaimed = 0;
+                uint64_t bytes = 0;
+                size_t kept = 0;
+                for (size_t i = 0; i < sliced.size(); ++i) {
+                    if (sliced[i].use_count() == 1) {
+                        recycle(std::move(sliced[i]));
+                        ++reclaimed;
+                        continue;
+                    }
+
+                    bytes += sliced[i]->capacity();
+                    if (kept != i) {
+                        sliced[kept] = std::move(sliced[i]);
+                    }
+                    ++kept;
+                }
+                sliced.resize(kept);
+                slicedCount.store(sliced.size(), std::memory_order_relaxed);
+                slicedBytes.store(bytes, std::memory_order_relaxed);
+                return reclaimed;
+            }
+
+            /**
+             * 不归还buffer, 只更新统计, 用于在其他线程释放连接的情况, 线程安全
+             */
+            void forget() {
+                inUse.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            /**
+             * 获取正在被连接使用的buffer个数
+             * @return 个数
+             */
+            uint64_t getInUse() const {
+                return inUse.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * 获取池中空闲的buffer个数
+             * @return 个数
+             */
+            uint64_t getIdle() const {
+                return idleCount.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * 获取归还之后还被切片引用的buffer个数
+             * @return 个数
+             */
+            uint64_t getSliced() const {
+                return slicedCount.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * 获取池和连接持有的buffer内存(字节)
+             * 被切片引用的buffer按照实际容量计算, 连接正在使用的buffer按照初始容量计算
+             * @return 字节数
+             */
+            uint64_t getBytes() const {
+                return (getInUse() + getIdle()) * capacity + slicedBytes.load(std::memory_order_relaxed);
+            }
+
+        private:
+            /**
+             * 没有引用的buffer放回空闲列表, 扩容过的或者空闲列表满了直接释放
+             * @param buf buffer
+             */
+            void recycle(std::shared_ptr<MySKBuffer>&& buf) {
+                if (buf->capacity() != capacity || idle.size() >= maxIdle) {
+                    buf.reset();
+                    return;
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire); //保证切片的读取已经完成
+                buf->clear();
+                idle.push_back(std::move(buf));
+                idleCount.store(idle.size(), std::memory_order_relaxed);
+            }
+
+        private:
+            uint32_t capacity {0}; //每个buffer的容量
+            uint32_t maxIdle {0}; //最多缓存的空闲buffer个数
+            std::vector<std::shared_ptr<MySKBuffer>> idle; //空闲的buffer
+            std::vector<std::shared_ptr<MySKBuffer>> sliced; //已经归还但是还被切片引用的buffer
+
+            std::atomic<int64_t> inUse {0}; //连接持有的buffer个数
+            std::atomic<uint64_t> idleCount {0}; //空闲的buffer个数
+            std::atomic<uint64_t> slicedCount {0}; //被切片引用的buffer个数
+            std::atomic<uint64_t> slicedBytes {0}; //被切片引用的buffer的实际容量之和
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYSKBUFFERPOOL_H
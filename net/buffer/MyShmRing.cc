@@ -0,0 +1,317 @@
+//
+// Created by mingweiliu on 2019/1/24.
+//
+
+#include "net/buffer/MyShmRing.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "net/MyGlobal.h"
+
+namespace MF {
+    namespace Buffer {
+#ifdef __linux__
+        //memfd需要的seal, 长度固定并且不能再修改seal
+        static const int32_t kRequiredSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+#endif
+
+        void MyShmRing::bind(char *base, uint32_t capacity) {
+            header = reinterpret_cast<MyShmRingHeader*>(base);
+            data = base + sizeof(MyShmRingHeader);
+            this->capacity = capacity > 0 ? capacity : header->capacity;
+            position = 0; //新创建的ring都从0开始
+            corrupted = false;
+        }
+
+        bool MyShmRing::validate(uint64_t used) const {
+            if (used <= capacity) {
+                return true;
+            }
+            if (!corrupted) {
+                LOG(ERROR) << "shared memory ring is corrupted, position: " << position
+                           << ", used: " << used << ", capacity: " << capacity << std::endl;
+                corrupted = true;
+            }
+            return false;
+        }
+
+        uint32_t MyShmRing::getReadable() const {
+            auto readable = header->head.load(std::memory_order_acquire) - position;
+            return !corrupted && validate(readable) ? static_cast<uint32_t >(readable) : 0;
+        }
+
+        uint32_t MyShmRing::write(const struct iovec *iov, int32_t count, uint32_t length) {
+            //1. 空间不够时标记在等待, 标记之后再检查一次, 避免对端已经读完而错过通知
+            //   tail由对端写入, 超出[head - capacity, head]时不再写入
+            uint64_t head = position;
+            uint64_t used = head - header->tail.load(std::memory_order_acquire);
+            if (corrupted || !validate(used)) {
+                return 0;
+            }
+            auto space = static_cast<uint32_t >(capacity - used);
+            if (space < length) {
+                header->writerWaiting.store(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                used = head - header->tail.load(std::memory_order_acquire);
+                if (!validate(used)) {
+                    return 0;
+                }
+                space = static_cast<uint32_t >(capacity - used);
+                if (space >= length) {
+                    header->writerWaiting.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            //2. 拷贝数据, 到结尾之后从头开始
+            uint32_t written = 0;
+            for (int32_t i = 0; i < count && written < space; ++i) {
+                auto src = static_cast<const char*>(iov[i].iov_base);
+                auto len = std::min(static_cast<uint32_t >(iov[i].iov_len), space - written);
+                auto offset = static_cast<uint32_t >((head + written) & (capacity - 1));
+                auto first = std::min(len, capacity - offset);
+                memcpy(data + offset, src, first);
+                memcpy(data, src + first, len - first);
+                written += len;
+            }
+
+            //3. 发布数据
+            if (written > 0) {
+                position = head + written;
+                header->head.store(position, std::memory_order_release);
+            }
+            return written;
+        }
+
+        uint32_t MyShmRing::read(char *buf, uint32_t size) {
+            //head由对端写入, 超出[tail, tail + capacity]时不再读取
+            uint64_t tail = position;
+            auto len = std::min(size, getReadable());
+            if (len == 0) {
+                return 0;
+            }
+
+            auto offset = static_cast<uint32_t >(tail & (capacity - 1));
+            auto first = std::min(len, capacity - offset);
+            memcpy(buf, data + offset, first);
+            memcpy(buf + first, data, len - first);
+
+            position = tail + len;
+            header->tail.store(position, std::memory_order_release);
+            return len;
+        }
+
+        bool MyShmRing::park() {
+            header->parked.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (getReadable() > 0) {
+                header->parked.store(0, std::memory_order_relaxed);
+                return false;
+            }
+            return true;
+        }
+
+        bool MyShmRing::takeParked() {
+            //和park中的fence配对, 保证写入和等待标记至少有一方能看到对方
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return header->parked.load(std::memory_order_relaxed) != 0
+                   && header->parked.exchange(0, std::memory_order_relaxed) != 0;
+        }
+
+        bool MyShmRing::takeWriterWaiting() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return header->writerWaiting.load(std::memory_order_relaxed) != 0
+                   && header->writerWaiting.exchange(0, std::memory_order_relaxed) != 0;
+        }
+
+        MyShmRingPair::~MyShmRingPair() {
+            if (base != nullptr) {
+                munmap(base, length);
+            }
+            if (memfd >= 0) {
+                ::close(memfd);
+            }
+            for (auto fd : doorbells) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+        }
+
+        int32_t MyShmRingPair::create(uint32_t capacity) {
+#ifdef __linux__
+            //1. 长度取整到2的幂, 位置直接用掩码计算
+            uint32_t size = 4096;
+            while (size < capacity && size < (1U << 30)) {
+                size <<= 1;
+            }
+
+            //2. 创建共享内存和doorbell, 长度确定之后加上seal, 对端不能再改变长度
+            memfd = memfd_create("myframework-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+            if (memfd < 0) {
+                LOG(ERROR) << "create memfd fail, error: " << strerror(errno) << std::endl;
+                return -1;
+            }
+            auto ringBytes = (MyShmRing::bytes(size) + 63) & ~static_cast<size_t >(63);
+            if (ftruncate(memfd, static_cast<off_t >(ringBytes * 2)) != 0 || map(ringBytes * 2) != 0) {
+                LOG(ERROR) << "map shared memory fail, size: " << ringBytes * 2
+                           << ", error: " << strerror(errno) << std::endl;
+                return -1;
+            }
+            if (fcntl(memfd, F_ADD_SEALS, kRequiredSeals) != 0) {
+                LOG(ERROR) << "seal shared memory fail, error: " << strerror(errno) << std::endl;
+                return -1;
+            }
+            for (auto& fd : doorbells) {
+                fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (fd < 0) {
+                    LOG(ERROR) << "create eventfd fail, error: " << strerror(errno) << std::endl;
+                    return -1;
+                }
+            }
+
+            //3. 初始化两个ring
+            server = false;
+            for (uint32_t i = 0; i < 2; ++i) {
+                auto header = new(base + ringBytes * i) MyShmRingHeader();
+                header->head.store(0);
+                header->tail.store(0);
+                header->parked.store(0);
+                header->writerWaiting.store(0);
+                header->closed.store(0);
+                header->capacity = size;
+                rings[i].bind(base + ringBytes * i, size);
+            }
+            return 0;
+#else
+            LOG(ERROR) << "shared memory transport is only supported on linux" << std::endl;
+            return -1;
+#endif
+        }
+
+        int32_t MyShmRingPair::attach(const int32_t *fds, uint32_t count) {
+            if (count != kFdCount) {
+                LOG(ERROR) << "invalid shared memory fds, count: " << count << std::endl;
+                return -1;
+            }
+
+            //1. 先接管fd, 失败时由析构函数关闭
+            server = true;
+            memfd = fds[0];
+            doorbells[0] = fds[1];
+            doorbells[1] = fds[2];
+
+            //2. 只接受已经封住长度的memfd, 否则对端可以缩小文件, 访问映射时触发SIGBUS
+#ifdef __linux__
+            auto seals = fcntl(memfd, F_GET_SEALS);
+            if (seals < 0 || (seals & kRequiredSeals) != kRequiredSeals) {
+                LOG(ERROR) << "shared memory is not sealed, seals: " << seals
+                           << ", error: " << strerror(errno) << std::endl;
+                return -1;
+            }
+#endif
+
+            //3. 映射共享内存
+            struct stat st;
+            if (fstat(memfd, &st) != 0 || st.st_size <= 0 || map(static_cast<size_t >(st.st_size)) != 0) {
+                LOG(ERROR) << "map shared memory fail, error: " << strerror(errno) << std::endl;
+                return -1;
+            }
+
+            //4. 校验client写入的长度
+            auto ringBytes = length / 2;
+            for (uint32_t i = 0; i < 2; ++i) {
+                rings[i].bind(base + ringBytes * i, 0);
+                auto size = rings[i].getCapacity();
+                if (size == 0 || (size & (size - 1)) != 0 || MyShmRing::bytes(size) > ringBytes) {
+                    LOG(ERROR) << "invalid shared memory ring, capacity: " << size << std::endl;
+                    return -1;
+                }
+            }
+            return 0;
+        }
+
+        void MyShmRingPair::getFds(int32_t *fds) const {
+            fds[0] = memfd;
+            fds[1] = doorbells[0];
+            fds[2] = doorbells[1];
+        }
+
+        uint32_t MyShmRingPair::send(const struct iovec *iov, int32_t count, uint32_t length) {
+            auto written = tx().write(iov, count, length);
+
+            //对端在等待时才需要系统调用
+            if (written > 0 && tx().takeParked()) {
+                notifyPeer();
+            }
+            return written;
+        }
+
+        uint32_t MyShmRingPair::receive(char *buf, uint32_t size) {
+            auto len = rx().read(buf, size);
+            if (len > 0 && rx().takeWriterWaiting()) {
+                notifyPeer();
+            }
+            return len;
+        }
+
+        bool MyShmRingPair::park() {
+            if (parked) {
+                return true;
+            }
+            parked = rx().park();
+            return parked;
+        }
+
+        void MyShmRingPair::wake(bool rung) {
+#ifdef __linux__
+            //每次doorbell可读都要清除, 否则水平触发会一直唤醒
+            if (rung) {
+                eventfd_t value;
+                eventfd_read(getDoorbell(), &value);
+            }
+#endif
+            if (parked) {
+                parked = false;
+                rx().unpark();
+            }
+        }
+
+        void MyShmRingPair::rearm() {
+#ifdef __linux__
+            eventfd_write(getDoorbell(), 1);
+#endif
+        }
+
+        void MyShmRingPair::close() {
+            if (base == nullptr) {
+                return;
+            }
+            tx().close();
+            notifyPeer();
+        }
+
+        void MyShmRingPair::notifyPeer() {
+#ifdef __linux__
+            eventfd_write(doorbells[server ? 1 : 0], 1);
+#endif
+        }
+
+        int32_t MyShmRingPair::map(size_t length) {
+            auto addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+            if (addr == MAP_FAILED) {
+                return -1;
+            }
+            this->base = static_cast<char*>(addr);
+            this->length = length;
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,315 @@
+//
+// Created by mingweiliu on 2019/1/24.
+//
+
+#ifndef MYFRAMEWORK2_MYSHMRING_H
+#define MYFRAMEWORK2_MYSHMRING_H
+
+#include <atomic>
+#include <cstdint>
+#include <sys/uio.h>
+
+namespace MF {
+    namespace Buffer {
+
+        /**
+         * 共享内存ring的头部, 放在映射区域的开头, 两个进程通过它同步读写位置
+         * 只使用lock free的atomic, 在不同进程的映射地址上同样有效
+         */
+        struct MyShmRingHeader {
+            alignas(64) std::atomic<uint64_t> head; //写入位置, 只由生产者修改
+            alignas(64) std::atomic<uint64_t> tail; //读取位置, 只由消费者修改
+            alignas(64) std::atomic<uint32_t> parked; //消费者是否在等待doorbell
+            std::atomic<uint32_t> writerWaiting; //生产者是否在等待空闲空间
+            std::atomic<uint32_t> closed; //生产者是否已经关闭
+            uint32_t capacity; //数据区的长度, 2的幂
+        };
+
+        /**
+         * 单生产者单消费者的字节ring, 不持有内存
+         * 数据按照字节流写入, 消息的边界由上层的协议解析
+         * 对端可以任意修改共享内存, 自己的位置只以本地的副本为准, 对端的位置超出范围时标记为损坏
+         */
+        class MyShmRing {
+        public:
+            /**
+             * 计算ring需要的内存长度
+             * @param capacity 数据区的长度, 2的幂
+             * @return 字节数
+             */
+            static size_t bytes(uint32_t capacity) {
+                return sizeof(MyShmRingHeader) + capacity;
+            }
+
+            /**
+             * 绑定到一段内存
+             * @param base 内存的起始地址, 需要64字节对齐
+             * @param capacity 数据区的长度, 为0时使用头部中记录的长度
+             */
+            void bind(char* base, uint32_t capacity);
+
+            /**
+             * 写入数据, 空间不够时只写入一部分, 并且标记生产者在等待
+             * @param iov 数据
+             * @param count iovec个数
+             * @param length 数据的总长度
+             * @return 写入的字节数
+             */
+            uint32_t write(const struct iovec* iov, int32_t count, uint32_t length);
+
+            /**
+             * 读取数据
+             * @param buf buffer
+             * @param size buffer的长度
+             * @return 读取的字节数
+             */
+            uint32_t read(char* buf, uint32_t size);
+
+            /**
+             * 获取可读的字节数
+             * @return 字节数, 损坏时返回0
+             */
+            uint32_t getReadable() const;
+
+            /**
+             * 对端写入的位置是否超出了范围, 损坏之后不再读写
+             * @return true 已损坏
+             */
+            bool isCorrupted() const {
+                return corrupted;
+            }
+
+            /**
+             * 消费者准备等待doorbell, 设置之后还有数据时撤销
+             * @return true 已经设置等待 false 还有数据
+             */
+            bool park();
+
+            /**
+             * 消费者不再等待doorbell
+             */
+            void unpark() {
+                header->parked.store(0, std::memory_order_relaxed);
+            }
+
+            /**
+             * 生产者写入之后检查消费者是否在等待, 只有一个生产者能得到true
+             * @return true 需要敲doorbell
+             */
+            bool takeParked();
+
+            /**
+             * 消费者读取之后检查生产者是否在等待空间
+             * @return true 需要敲doorbell
+             */
+            bool takeWriterWaiting();
+
+            /**
+             * 生产者关闭ring
+             */
+            void close() {
+                header->closed.store(1, std::memory_order_release);
+            }
+
+            /**
+             * 生产者是否已经关闭ring
+             * @return true 已关闭
+             */
+            bool isClosed() const {
+                return header->closed.load(std::memory_order_acquire) != 0;
+            }
+
+            uint32_t getCapacity() const {
+                return capacity;
+            }
+
+        protected:
+            /**
+             * 检查对端的位置, 已使用的长度不能超过capacity
+             * @param used 已使用的长度(生产者是未读的长度, 消费者是可读的长度)
+             * @return true 正常
+             */
+            bool validate(uint64_t used) const;
+
+        protected:
+            MyShmRingHeader* header {nullptr}; //头部
+            char* data {nullptr}; //数据区
+            uint32_t capacity {0}; //数据区的长度
+            uint64_t position {0}; //自己的位置: 生产者是head, 消费者是tail, 不从共享内存读取
+            mutable bool corrupted {false}; //对端的位置是否超出了范围
+        };
+
+        /**
+         * 同一台机器上两个进程之间的双向共享内存通道
+         * client用memfd创建两个ring和两个eventfd(doorbell), 通过unix socket把fd传给server
+         * 写入之后只有对端已经在等待时才敲doorbell, 对端忙碌时读写都不需要系统调用
+         * ring[0]: client到server, ring[1]: server到client
+         * doorbell[0]: server等待, doorbell[1]: client等待
+         */
+        class MyShmRingPair {
+        public:
+            MyShmRingPair() = default;
+
+            ~MyShmRingPair();
+
+            /**
+             * client创建共享内存和doorbell
+             * @param capacity 每个方向ring的长度, 向上取整到2的幂
+             * @return 0 成功 -1 失败
+             */
+            int32_t create(uint32_t capacity);
+
+            /**
+             * server映射client传过来的共享内存, 之后持有这些fd
+             * @param fds memfd, doorbell[0], doorbell[1]
+             * @param count fd的个数, 必须为kFdCount
+             * @return 0 成功 -1 失败
+             */
+            int32_t attach(const int32_t* fds, uint32_t count);
+
+            /**
+             * 获取需要传给server的fd
+             * @param fds 返回kFdCount个fd
+             */
+            void getFds(int32_t* fds) const;
+
+            /**
+             * 获取自己的doorbell, 可读时表示对端写入了数据或者释放了空间
+             * @return fd
+             */
+            int32_t getDoorbell() const {
+                return doorbells[server ? 0 : 1];
+            }
+
+            /**
+             * 写入数据, 对端在等待时敲doorbell
+             * @param iov 数据
+             * @param count iovec个数
+             * @param length 数据的总长度
+             * @return 写入的字节数, 小于length时表示空间不够, 对端读取之后会敲doorbell
+             */
+            uint32_t send(const struct iovec* iov, int32_t count, uint32_t length);
+
+            /**
+             * 读取数据, 对端在等待空间时敲doorbell
+             * @param buf buffer
+             * @param size buffer长度
+             * @return 读取的字节数
+             */
+            uint32_t receive(char* buf, uint32_t size);
+
+            /**
+             * 获取可以读取的字节数
+             * @return 字节数
+             */
+            uint32_t getReceivable() const {
+                return rx().getReadable();
+            }
+
+            /**
+             * 没有数据可读时准备等待doorbell
+             * @return true 已经在等待 false 还有数据可读
+             */
+            bool park();
+
+            /**
+             * 开始读取之前调用, 不再等待doorbell
+             * @param rung true doorbell可读, 需要清除 false 由轮询触发
+             */
+            void wake(bool rung);
+
+            /**
+             * 自己的doorbell计数加一, 一次没有读完时让loop下一轮继续读取
+             */
+            void rearm();
+
+            /**
+             * 是否在等待doorbell
+             * @return true 在等待
+             */
+            bool isParked() const {
+                return parked;
+            }
+
+            /**
+             * 每个方向ring的长度
+             * @return 字节数
+             */
+            uint32_t getCapacity() const {
+                return tx().getCapacity();
+            }
+
+            /**
+             * 关闭自己的发送方向, 并通知对端
+             */
+            void close();
+
+            /**
+             * 对端是否已经关闭, 共享内存损坏时也按关闭处理
+             * @return true 已关闭
+             */
+            bool isPeerClosed() const {
+                return rx().isClosed() || isCorrupted();
+            }
+
+            /**
+             * 共享内存是否被对端写坏了
+             * @return true 已损坏, 需要关闭连接
+             */
+            bool isCorrupted() const {
+                return tx().isCorrupted() || rx().isCorrupted();
+            }
+
+            /**
+             * 是否已经创建或者映射
+             * @return true 是
+             */
+            bool isReady() const {
+                return base != nullptr;
+            }
+
+        public:
+            static constexpr uint32_t kFdCount = 3; //需要传递的fd个数
+
+        protected:
+            MyShmRing& tx() {
+                return rings[server ? 1 : 0];
+            }
+
+            const MyShmRing& tx() const {
+                return rings[server ? 1 : 0];
+            }
+
+            MyShmRing& rx() {
+                return rings[server ? 0 : 1];
+            }
+
+            const MyShmRing& rx() const {
+                return rings[server ? 0 : 1];
+            }
+
+            /**
+             * 敲对端的doorbell
+             */
+            void notifyPeer();
+
+            /**
+             * 映射共享内存
+             * @param length 长度
+             * @return 0 成功 -1 失败
+             */
+            int32_t map(size_t length);
+
+        protected:
+            MyShmRing rings[2]; //两个方向的ring
+            bool server {false}; //是否是server端
+            bool parked {false}; //是否在等待doorbell
+            char* base {nullptr}; //映射的地址
+            size_t length {0}; //映射的长度
+            int32_t memfd {-1}; //共享内存
+            int32_t doorbells[2] {-1, -1}; //两端的doorbell
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYSHMRING_H
@@ -9,6 +9,7 @@
 #ifndef myiobuf_h
 #define myiobuf_h
 
+#include <memory>
 #include "net/buffer/MySKBuffer.h"
 #include "net/buffer/MyIOWriter.h"
 #include "net/buffer/MyIOReader.h"
@@ -17,6 +18,7 @@ namespace MF {
     namespace Buffer {
         /// 基于SKBuffer的IOBuf
         /// SKBuffer是一个基于内存的，自动增长的buffer
+        /// IOBuf也可以是另一个SKBuffer上的只读切片，切片通过引用计数保证底层内存在所有切片释放之前有效
         class MyIOBuf {
         public: //不允许手动构造
             /**
@@ -25,12 +27,27 @@ namespace MF {
             MyIOBuf(uint32_t capacity) {
                 buffer_ = new MySKBuffer(capacity);
             }
+
+            /**
+             *  @brief 构造一个切片
+             *
+             *  @param storage 切片引用的底层buffer
+             *  @param data 切片的起始位置
+             *  @param length 切片的长度
+             */
+            MyIOBuf(std::shared_ptr<MySKBuffer> storage, char* data, uint32_t length)
+            : storage_(std::move(storage)) {
+                slice_.wrap(data, length);
+                buffer_ = &slice_;
+            }
             
             /**
              *  @brief 析构函数
              */
             ~MyIOBuf() {
-                delete buffer_;
+                if (buffer_ != &slice_) {
+                    delete buffer_;
+                }
             }
             
             /**
@@ -54,13 +71,68 @@ namespace MF {
                 return iobuf;
             }
 
+            /**
+             *  @brief 在一段共享的buffer上构造切片, 不拷贝数据
+             *
+             *  @param storage 底层buffer
+             *  @param data 切片的起始位置, 必须位于storage之内
+             *  @param length 切片长度
+             *
+             *  @return 切片
+             */
+            static std::unique_ptr<MyIOBuf> slice(const std::shared_ptr<MySKBuffer>& storage, char* data, uint32_t length) {
+                std::unique_ptr<MyIOBuf> iobuf(new MyIOBuf(storage, data, length));
+                return iobuf;
+            }
+
             /**
              *  @brief 交换两个IOBuf
              *
              *  @param r 右值
              */
             void swap(MyIOBuf& r) {
+                slice_.swap(r.slice_);
+                std::swap(storage_, r.storage_);
                 std::swap(buffer_, r.buffer_);
+
+                //切片的buffer指向自身的slice_
+                if (buffer_ == &r.slice_) {
+                    buffer_ = &slice_;
+                }
+                if (r.buffer_ == &slice_) {
+                    r.buffer_ = &r.slice_;
+                }
+            }
+
+            /**
+             *  @brief 是否是切片
+             *
+             *  @return true 切片 false 独立的buffer
+             */
+            bool isSlice() const {
+                return buffer_ == &slice_;
+            }
+
+            /**
+             *  @brief 取出接下来length字节的数据, 并且移动可读指针
+             *  切片上的split不拷贝数据，返回的切片与当前切片共享底层buffer
+             *
+             *  @param length 需要取出的长度
+             *
+             *  @return 取出的数据
+             */
+            std::unique_ptr<MyIOBuf> split(uint32_t length) {
+                uint32_t tmp = length;
+                char* buf = buffer_->getReadableAndMove(&tmp);
+                if (isSlice()) {
+                    return slice(storage_, buf, tmp);
+                }
+
+                std::unique_ptr<MyIOBuf> iobuf = create(tmp);
+                if (tmp > 0) {
+                    iobuf->write<char*>(buf, tmp);
+                }
+                return iobuf;
             }
 
             /**
@@ -90,6 +162,32 @@ namespace MF {
                 buffer_->moveReadable(len);
             }
 
+            /**
+             *  @brief 获取尾部可以直接写入的长度, 切片没有可写空间
+             *
+             *  @return 长度
+             */
+            uint32_t getTailroom() const {
+                return buffer_->getTailLength();
+            }
+
+            /**
+             *  @brief 获取尾部的可写指针, 写入之后需要调用moveWriteable
+             *
+             *  @return 可写指针, 没有可写空间时返回nullptr
+             */
+            void* tail() {
+                return buffer_->appendable(0);
+            }
+
+            /**
+             * 移动可写指针
+             * @param len 长度
+             */
+            void moveWriteable(uint32_t len) {
+                buffer_->moveWriteable(len);
+            }
+
         public:
             
             //基本类型
@@ -178,6 +276,9 @@ namespace MF {
             MyIOBuf& operator = (const MyIOBuf& r) = delete; //不能赋值， SKBuffer不能多线程操作
         private:
             MySKBuffer* buffer_;
+
+            MySKBuffer slice_; //切片模式下使用的视图
+            std::shared_ptr<MySKBuffer> storage_; //切片引用的底层buffer
         };
         
         template<typename T> void MyIOBuf::write (const BASIC_TYPE(T) &v) {
@@ -5,7 +5,8 @@
 #include "net/client/ClientLoop.h"
 namespace MF {
     namespace Client{
-        ClientLoop::ClientLoop(uint32_t flags) : MyLoop(flags){
+        ClientLoop::ClientLoop(uint32_t flags)
+        : MyLoop(flags), bufferPool(g_default_skbuffer_capacity, g_default_buffer_pool_idle) {
 
         }
 
@@ -42,16 +43,11 @@ namespace MF {
             clients.erase(client->getUid());
         }
 
-        bool ClientLoop::onIdle() {
-            if (MyTimeProvider::now() - lastCheckTime < 1) { //1秒检查一次
-                return false;
-            }
+        void ClientLoop::onTick() {
             //检查是否有链接断开了
             for(auto it = clients.begin(); it != clients.end(); ++it) {
                 it->second->onHeartbeat(); //处理心跳
             }
-            lastCheckTime = MyTimeProvider::now();
-            return true;
         }
 
         ClientLoopManager::~ClientLoopManager() {
@@ -69,7 +65,7 @@ namespace MF {
                delete *it;
            }
        }
-       int32_t ClientLoopManager::initialize(uint32_t count) {
+       int32_t ClientLoopManager::initialize(uint32_t count, int32_t cpu) {
            if (count == 0) { //系统自行决定
                return -1;
            }
@@ -83,6 +79,9 @@ namespace MF {
 
                //设置线程id
                loop->setThreadId(t.get_id());
+               if (cpu >= 0 && MyCommon::pinThread(t.native_handle(), cpu) != 0) {
+                   LOG(ERROR) << "pin client io thread to cpu fail, cpu: " << cpu << std::endl;
+               }
 
                std::unique_lock<std::mutex> lock(mutex_);
                if(!cond_.wait_for(lock, std::chrono::seconds(3), [&t]{return t.joinable();})) {
@@ -7,6 +7,7 @@
 
 #include "net/ev/MyLoop.h"
 #include "net/client/MyClient.h"
+#include "net/buffer/MySKBufferPool.h"
 
 namespace MF{
     namespace Client{
@@ -63,13 +64,21 @@ namespace MF{
              */
             void removeClient(std::shared_ptr<MyClient> client);
 
+            /**
+             * 获取read buffer池, 只能在loop线程获取和归还buffer
+             * @return buffer池
+             */
+            Buffer::MySKBufferPool* getBufferPool() {
+                return &bufferPool;
+            }
+
         protected:
-            bool onIdle() override;
+            void onTick() override;
 
         protected:
             //map<servantName, proxy>
             std::map<uint64_t , std::shared_ptr<MyClient>> clients; //所有的proxy
-            uint32_t lastCheckTime; //上一次check的时间
+            Buffer::MySKBufferPool bufferPool; //client使用的read buffer池
         };
 
         class ClientLoopManager {
@@ -84,9 +93,10 @@ namespace MF{
              *  @brief 初始化loop mananger
              *
              *  @param count loop的个数
+             *  @param cpu 所有io线程绑定的cpu, 小于0表示不绑定
              *
              */
-            int32_t initialize(uint32_t count);
+            int32_t initialize(uint32_t count, int32_t cpu = -1);
 
             /**
              *  @brief 根据index获取对应的loop
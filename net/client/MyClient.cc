@@ -5,6 +5,7 @@
 #include "net/client/MyClient.h"
 #include "net/client/ClientLoop.h"
 #include "net/client/MySession.h"
+#include "net/socket/MySocketIO.h"
 
 namespace MF {
     namespace Client{
@@ -35,12 +36,34 @@ namespace MF {
         }
 
         std::unique_ptr<Buffer::MyIOBuf> MyClient::fetchPayload(uint32_t length) {
+            if (readBuffer == nullptr) {
+                return nullptr;
+            }
             char* buf = readBuffer->getReadableAndMove(&length);
             auto iobuf = Buffer::MyIOBuf::create(length);
             iobuf->write<char*>(buf, length);
             return iobuf;
         }
 
+        char* MyClient::reserveReadBuffer(uint32_t length) {
+            if (readBuffer == nullptr) {
+                bufferPool = loop->getBufferPool();
+                readBuffer = bufferPool->acquire();
+            }
+            return readBuffer->writeable(length);
+        }
+
+        void MyClient::releaseReadBuffer() {
+            //还有不完整的数据包时保留
+            if (readBuffer != nullptr && readBuffer->getReadableLength() == 0) {
+                bufferPool->release(std::move(readBuffer));
+            }
+        }
+
+        int32_t MyClient::sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain) {
+            return sendPayload(chain->coalesce());
+        }
+
         void MyClient::whenSessionTimeout(std::function<void()> &&pred, uint64_t requestId) {
             auto self = std::weak_ptr<MyClient>(shared_from_this());
             auto func = [pred, requestId, self] (EV::MyTimerWatcher*) {
@@ -81,8 +104,12 @@ namespace MF {
             MyClient::heartbeatFunc = heartbeatFunc;
         }
 
-        MyTcpClient::MyTcpClient(uint16_t servantId) : MyClient(servantId){
-            socket->socket(AF_INET, SOCK_STREAM, 0);
+        MyTcpClient::MyTcpClient(uint16_t servantId) : MyTcpClient(servantId, AF_INET, SOCK_STREAM) {
+        }
+
+        MyTcpClient::MyTcpClient(uint16_t servantId, int32_t domain, int32_t type)
+        : MyClient(servantId), domain(domain), type(type), packetMode(type == SOCK_SEQPACKET) {
+            socket->socket(static_cast<uint8_t >(domain), type, 0);
             uid = static_cast<uint32_t >(socket->getfd() << 16 | servantId);
         }
 
@@ -117,6 +144,14 @@ namespace MF {
                 readWatcher = nullptr;
             }
 
+            //没有发送的数据丢弃
+            if (drainWatcher != nullptr) {
+                EV::MyWatcherManager::GetInstance()->destroy(drainWatcher);
+                drainWatcher = nullptr;
+            }
+            writeQueue.moveReadable(writeQueue.getReadableLength());
+            writeLengths.clear();
+
             if (connectPromise != nullptr) {
                 delete(connectPromise);
                 connectPromise = nullptr;
@@ -133,7 +168,7 @@ namespace MF {
 
             //2. 重新链接
             socket = new Socket::MySocket();
-            if (socket->socket(AF_INET, SOCK_STREAM, 0) != 0) {
+            if (socket->socket(static_cast<uint8_t >(domain), type, 0) != 0) {
                 LOG(ERROR) << "socket fail" << std::endl;
             }
 
@@ -166,20 +201,22 @@ namespace MF {
         }
 
         int32_t MyTcpClient::sendPayload(const char *buffer, uint32_t length) {
-            auto self = shared_from_this();
-            loop->RunInThreadOrImmediate([self, buffer, length]() -> void {
-                self->getSocket()->write((void *) buffer, length);
-            });
-            return 0;
+            //socket写满时需要保留没有发送的数据, 先拷贝一份
+            auto chain = Buffer::MyIOBufChain::create();
+            chain->write(buffer, length);
+            return sendPayload(std::move(chain));
         }
 
         void MyTcpClient::onConnect(EV::MyWatcher *watcher) {
-            //1. 检查链接是否已经连上
-            if (socket->connected()) {
+            //1. 已经处理过连接结果了, connect立即成功时(例如unix socket)也需要在这里完成
+            if (connectWatcher == nullptr) {
                 return;
             }
-            //检查连接是否成功
+            //检查连接是否成功, 成功之后先完成握手
             int32_t err = socket->getConnectResult();
+            if (err == 0) {
+                err = onConnected();
+            }
             if (err == 0) {
                 LOG(INFO) << "connect success, host: " << config.host << ", port: " << config.port << std::endl;
                 socket->setConnected(); //设置已连接
@@ -201,39 +238,307 @@ namespace MF {
             if (!socket->connected()) {
                 return -1;
             }
-            uint32_t len = 1024;
             int32_t rv = 0;
+            uint32_t total = 0;
             while (true) {
-                char *buf = readBuffer->writeable(len);
-                auto read = socket->read(buf, len);
+                uint32_t len = 0;
+                int32_t read = 0;
+                if (packetMode) {
+                    read = readPacket();
+                } else {
+                    //尾部空间足够时直接使用, 不整理也不扩容buffer
+                    len = std::max(readHint, readBuffer == nullptr ? 0 : readBuffer->getTailLength());
+                    char *buf = reserveReadBuffer(len);
+                    read = socket->read(buf, len);
+                    if (read > 0) {
+                        readBuffer->moveWriteable(static_cast<uint32_t >(read));
+                    }
+                }
                 if (read > 0) {
-                    readBuffer->moveWriteable(static_cast<uint32_t >(read));
                     rv += read;
+                    total += static_cast<uint32_t >(read);
+
+                    //没有读满说明内核缓冲区已经读空, 按消息读取时一次只返回一个消息
+                    if (!packetMode && static_cast<uint32_t >(read) < len) {
+                        break;
+                    }
+                    readHint = std::min(readHint * 2, g_max_read_size);
+
+                    //超过预算之后让出loop, 剩下的数据下一轮再读
+                    if (config.readBudget > 0 && total >= config.readBudget) {
+                        break;
+                    }
                 } else if (read == 0) {
                     rv = 0; //对端关闭了
                     break;
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EMSGSIZE) {
+                    rv = -1; //消息被截断了, 连接上的数据已经不完整
+                    break;
                 } else {
-                    rv = -1; //读取失败了
+                    rv = rv > 0 ? rv : -1; //读取失败了, EAGAIN时已经读到的数据照常处理
                     break;
                 }
             }
 
+            //最近的数据量变小了, 减小下一次的读取长度
+            if (total < readHint / 4 && readHint > g_default_read_size) {
+                readHint /= 2;
+            }
             return rv;
         }
 
+        int32_t MyTcpClient::readPacket() {
+            //尾部空间不够一个最大的消息时, 多出来的部分读到备用块
+            char* buf = reserveReadBuffer(0);
+            return Socket::MySocketIO::read(socket, buf, readBuffer->getTailLength(), g_max_packet_length, true,
+                    [this](uint32_t length) -> char* {
+                        return this->reserveReadBuffer(length);
+                    }, [this](uint32_t length) {
+                        this->readBuffer->moveWriteable(length);
+                    });
+        }
+
         int32_t MyTcpClient::sendPayload(std::unique_ptr<Buffer::MyIOBuf> iobuf) {
-            auto self = shared_from_this();
-            auto ptr = iobuf.release();
+            auto chain = Buffer::MyIOBufChain::create();
+            chain->append(std::move(iobuf));
+            return sendPayload(std::move(chain));
+        }
+
+        int32_t MyTcpClient::sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain) {
+            auto self = std::dynamic_pointer_cast<MyTcpClient>(shared_from_this());
+            auto ptr = chain.release();
             loop->RunInThreadOrImmediate([self, ptr]() -> void {
-                std::unique_ptr<Buffer::MyIOBuf> tmpBuf(ptr);
-                auto buffer = tmpBuf->readable();
-                auto length = tmpBuf->getReadableLength();
-                self->getSocket()->write(buffer, length);
+                self->queueChain(std::unique_ptr<Buffer::MyIOBufChain>(ptr));
             });
 
             return 0;
         }
 
+        void MyTcpClient::queueChain(std::unique_ptr<Buffer::MyIOBufChain> chain) {
+            if (socket == nullptr) {
+                LOG(ERROR) << "send payload fail, client is disconnected, uid: " << uid << std::endl;
+                return;
+            }
+
+            //之前的数据还没有发完时排在后面, 等socket可写之后一起发送, 保证顺序
+            bool idle = writeQueue.empty();
+            if (packetMode) {
+                writeLengths.push_back(chain->getReadableLength()); //每次发送是一个消息
+            }
+            writeQueue.append(std::move(chain));
+            if (idle) {
+                flushWriteQueue();
+            }
+        }
+
+        void MyTcpClient::flushWriteQueue() {
+            //按消息发送时一次系统调用正好是一个消息, 不能合并也不能拆开
+            while (packetMode && socket != nullptr && !writeLengths.empty()) {
+                auto rv = Socket::MySocketIO::writeFrame(socket, writeQueue, writeLengths.front());
+                if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break; //socket写满了, 等待可写
+                }
+                if (rv < 0) {
+                    LOG(ERROR) << "send payload fail, uid: " << uid << ", error: " << strerror(errno) << std::endl;
+                    writeQueue.moveReadable(writeQueue.getReadableLength());
+                    writeLengths.clear();
+                    break;
+                }
+                writeLengths.pop_front();
+            }
+
+            struct iovec iov[IOV_MAX];
+            while (!packetMode && socket != nullptr && !writeQueue.empty()) {
+                //1. 一次最多发送IOV_MAX个块
+                auto count = writeQueue.readableIovec(iov, IOV_MAX);
+                auto rv = socket->writev(iov, count);
+                if (rv < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break; //socket写满了, 等待可写
+                }
+                if (rv <= 0) {
+                    //连接已经不可用, 丢弃数据, 由读事件或者心跳关闭连接
+                    LOG(ERROR) << "send payload fail, uid: " << uid << ", error: " << strerror(errno) << std::endl;
+                    writeQueue.moveReadable(writeQueue.getReadableLength());
+                    break;
+                }
+
+                //2. 释放已经发送的块
+                writeQueue.moveReadable(static_cast<uint32_t >(rv));
+            }
+
+            //3. 还有数据时监听可写事件, 发完之后取消监听
+            if (!writeQueue.empty()) {
+                if (drainWatcher == nullptr) {
+                    drainWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
+                            std::bind(&MyTcpClient::onWritable, this, std::placeholders::_1), socket->getfd(), EV_WRITE);
+                }
+                if (!drainWatcher->is_listened()) {
+                    loop->add(drainWatcher);
+                }
+            } else if (drainWatcher != nullptr && drainWatcher->is_listened()) {
+                loop->remove(drainWatcher);
+            }
+        }
+
+        void MyTcpClient::onWritable(EV::MyWatcher *watcher) {
+            flushWriteQueue();
+        }
+
+        MyUnixClient::MyUnixClient(uint16_t servantId, bool seqPacket)
+        : MyTcpClient(servantId, AF_UNIX, seqPacket ? SOCK_SEQPACKET : SOCK_STREAM) {
+        }
+
+        MyShmClient::MyShmClient(uint16_t servantId) : MyUnixClient(servantId, false) {
+        }
+
+        MyShmClient::~MyShmClient() {
+            disconnect();
+        }
+
+        uint32_t MyShmClient::getFd() const {
+            return rings != nullptr ? static_cast<uint32_t >(rings->getDoorbell()) : MyUnixClient::getFd();
+        }
+
+        int32_t MyShmClient::onConnected() {
+            //1. 创建共享内存和doorbell
+            auto ringPair = std::unique_ptr<Buffer::MyShmRingPair>(new Buffer::MyShmRingPair());
+            if (ringPair->create(config.shmRingSize) != 0) {
+                return errno != 0 ? errno : EIO;
+            }
+
+            //2. 通过unix socket传给server
+            int32_t fds[Buffer::MyShmRingPair::kFdCount];
+            ringPair->getFds(fds);
+            uint32_t magic = g_shm_handshake_magic;
+            if (socket->writeFds(fds, Buffer::MyShmRingPair::kFdCount, &magic, sizeof(magic)) != sizeof(magic)) {
+                LOG(ERROR) << "send shm fds fail, host: " << config.host << ", error: " << strerror(errno) << std::endl;
+                return errno != 0 ? errno : EIO;
+            }
+
+            //3. 等待server的响应, server写入之后敲doorbell
+            ringPair->park();
+            rings = std::move(ringPair);
+            LOG(INFO) << "shm handshake success, host: " << config.host
+                      << ", capacity: " << rings->getCapacity() << std::endl;
+            return 0;
+        }
+
+        void MyShmClient::disconnect() {
+            //先销毁read watcher, 再关闭doorbell
+            MyUnixClient::disconnect();
+
+            //通知server, 不需要等待unix socket关闭
+            if (rings != nullptr) {
+                rings->close();
+                rings.reset();
+            }
+            pending.moveReadable(pending.getReadableLength());
+        }
+
+        int32_t MyShmClient::onRead() {
+            if (rings == nullptr || !socket->connected()) {
+                return -1;
+            }
+
+            //1. 清除doorbell, server也可能是释放了空间, 继续写入之前没有写完的数据
+            rings->wake(readWatcher == nullptr || !(readWatcher->events() & EV_CUSTOM));
+            flushPending();
+
+            //2. 从ring拷贝到read buffer, 没有数据时改为等待doorbell
+            uint32_t total = 0;
+            while (config.readBudget == 0 || total < config.readBudget) {
+                auto length = rings->getReceivable();
+                if (length == 0) {
+                    if (rings->park()) {
+                        break;
+                    }
+                    continue; //设置等待之后又有了数据
+                }
+
+                if (config.readBudget > 0) {
+                    length = std::min(length, config.readBudget - total);
+                }
+                auto read = rings->receive(reserveReadBuffer(length), length);
+                readBuffer->moveWriteable(read);
+                total += read;
+            }
+
+            //3. 超过预算还有数据, 或者server已经关闭, 需要自己触发下一轮
+            bool closed = rings->isPeerClosed();
+            if (total > 0 && (closed || (config.readBudget > 0 && total >= config.readBudget))) {
+                rings->rearm();
+            }
+
+            if (total == 0) {
+                if (closed) {
+                    return 0; //对端关闭了
+                }
+                errno = EAGAIN;
+                return -1;
+            }
+            return static_cast<int32_t >(total);
+        }
+
+        int32_t MyShmClient::sendPayload(const char *buffer, uint32_t length) {
+            auto chain = Buffer::MyIOBufChain::create();
+            chain->write(buffer, length);
+            return sendPayload(std::move(chain));
+        }
+
+        int32_t MyShmClient::sendPayload(std::unique_ptr<Buffer::MyIOBuf> iobuf) {
+            auto chain = Buffer::MyIOBufChain::create();
+            chain->append(std::move(iobuf));
+            return sendPayload(std::move(chain));
+        }
+
+        int32_t MyShmClient::sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain) {
+            auto self = std::dynamic_pointer_cast<MyShmClient>(shared_from_this());
+            auto ptr = chain.release();
+            loop->RunInThreadOrImmediate([self, ptr]() -> void {
+                self->writeChain(std::unique_ptr<Buffer::MyIOBufChain>(ptr));
+            });
+            return 0;
+        }
+
+        void MyShmClient::writeChain(std::unique_ptr<Buffer::MyIOBufChain> chain) {
+            if (rings == nullptr) {
+                LOG(ERROR) << "send payload fail, shm is not connected, uid: " << uid << std::endl;
+                return;
+            }
+
+            //之前的数据还没有写完时排在后面, 保证顺序
+            pending.append(std::move(chain));
+            flushPending();
+        }
+
+        void MyShmClient::flushPending() {
+            //直接从iobuf拷贝到ring, 不合并
+            struct iovec iov[IOV_MAX];
+            while (rings != nullptr && !pending.empty()) {
+                auto count = pending.readableIovec(iov, IOV_MAX);
+                uint32_t length = 0;
+                for (uint32_t i = 0; i < count; ++i) {
+                    length += static_cast<uint32_t >(iov[i].iov_len);
+                }
+
+                auto written = rings->send(iov, static_cast<int32_t >(count), length);
+                pending.moveReadable(written);
+                if (written < length) {
+                    break; //ring满了, server读取之后会敲doorbell
+                }
+            }
+
+            //共享内存被server写坏了, 触发一次读事件, 由onRead按对端关闭处理
+            if (rings != nullptr && rings->isCorrupted()) {
+                rings->rearm();
+            }
+        }
+
         MyUdpClient::MyUdpClient(uint16_t servantId) : MyClient(servantId) {
             socket->socket(AF_INET, SOCK_DGRAM, 0);
             uid = static_cast<uint32_t >(socket->getfd() << 16 | servantId);
@@ -254,6 +559,17 @@ namespace MF {
             this->onConnectFunc = func; //连接成功需要执行的回调
             socket->setNonBlock(); //设置异步
             this->connectTime = MyTimeProvider::now(); //设置连接时间
+
+            //GRO, 服务端批量的响应一次读取
+            readLength = g_max_udp_packet_length;
+            if (config.udpOffload) {
+                if (socket->setUdpGro(true) == 0) {
+                    readLength = g_max_udp_offload_length;
+                } else {
+                    LOG(ERROR) << "udp gro is not supported, error: " << strerror(errno) << std::endl;
+                }
+            }
+
             //调用onConnect
             loop->RunInThreadOrImmediate(std::bind(onConnectFunc, shared_from_this()));
 
@@ -292,9 +608,9 @@ namespace MF {
 
         int32_t MyUdpClient::onRead() {
             int32_t rv = 0;
-            uint32_t len = g_max_udp_packet_length;
+            uint32_t len = readLength;
             while(true) {
-                char* buf = readBuffer->writeable(len);
+                char* buf = reserveReadBuffer(len);
 
                 //读取数据
                 sockaddr_in addr = {0};
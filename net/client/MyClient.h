@@ -5,10 +5,14 @@
 #ifndef MYFRAMEWORK2_MYCLIENT_H
 #define MYFRAMEWORK2_MYCLIENT_H
 
+#include <deque>
 #include <future>
 #include "net/MyGlobal.h"
 #include "net/socket/MySocket.h"
 #include "net/buffer/myIOBuf.h"
+#include "net/buffer/MySKBufferPool.h"
+#include "net/buffer/MyIOBufChain.h"
+#include "net/buffer/MyShmRing.h"
 #include "net/ev/MyWatcher.h"
 #include "util/MyTimeProvider.h"
 
@@ -29,6 +33,9 @@ namespace MF {
         typedef enum enumClientType: int32_t {
             kClientTypeTcp = 0, //tcp
             kClientTypeUdp = 1, //udp
+            kClientTypeUnix = 2, //unix socket(SOCK_STREAM), host为socket文件的路径
+            kClientTypeUnixSeqPacket = 3, //unix socket(SOCK_SEQPACKET), host为socket文件的路径
+            kClientTypeShm = 4, //共享内存, host为MyShmServant的socket文件的路径, 只支持linux
         }ClientType;
         /**
          * client配置
@@ -41,6 +48,9 @@ namespace MF {
             bool autoReconnect{true}; //自动重连
             bool needHeartbeat{true}; //是否需要心跳
             uint32_t heartbeatInterval {30}; //心跳间隔
+            bool udpOffload {false}; //udp是否开启GRO, 内核不支持时自动关闭
+            uint32_t readBudget {g_default_read_budget}; //tcp连接每次可读事件最多读取的字节数, 0表示读到EAGAIN
+            uint32_t shmRingSize {g_default_shm_ring_size}; //共享内存每个方向ring的长度
         };
         class MyClient : public std::enable_shared_from_this<MyClient>{
         public:
@@ -51,7 +61,6 @@ namespace MF {
              */
             MyClient(uint16_t servantId) {
                 socket = new Socket::MySocket();
-                readBuffer = new Buffer::MySKBuffer(g_default_skbuffer_capacity);
             }
 
             /**
@@ -62,8 +71,9 @@ namespace MF {
                     EV::MyWatcherManager::GetInstance()->destroy(connectWatcher); //销毁read watcher
                 }
 
-                if (readBuffer != nullptr) {
-                    delete(readBuffer);
+                //可能不在loop线程析构, 只更新统计
+                if (readBuffer != nullptr && bufferPool != nullptr) {
+                    bufferPool->forget();
                 }
 
                 //重置数据
@@ -79,7 +89,11 @@ namespace MF {
                 return config;
             }
 
-            uint32_t getFd() const {
+            /**
+             * 获取read watcher监听的fd
+             * @return fd
+             */
+            virtual uint32_t getFd() const {
                 return static_cast<uint32_t >(socket->getfd());
             }
 
@@ -173,7 +187,7 @@ namespace MF {
              * @return 可读数据长度
              */
             uint32_t getReadableLength() const {
-                return readBuffer->getReadableLength();
+                return readBuffer == nullptr ? 0 : readBuffer->getReadableLength();
             }
 
             /**
@@ -182,9 +196,14 @@ namespace MF {
              * @return 指针
              */
             char* getReadableBuffer(uint32_t* len) const {
-                return readBuffer->readable(len);
+                return readBuffer == nullptr ? nullptr : readBuffer->readable(len);
             }
 
+            /**
+             * 数据处理完之后归还read buffer, 空闲连接不占用buffer, 只能在loop线程调用
+             */
+            void releaseReadBuffer();
+
             /**
              * 发送数据包
              * @param buffer buffer
@@ -200,6 +219,13 @@ namespace MF {
              */
             virtual int32_t sendPayload(std::unique_ptr<Buffer::MyIOBuf> iobuf) = 0;
 
+            /**
+             * 发送多段数据, 默认合并成一个iobuf之后发送
+             * @param chain chain
+             * @return 0 成功 其他 失败
+             */
+            virtual int32_t sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain);
+
             /**
              * 获取一个完整的数据包
              * @param length length
@@ -225,6 +251,13 @@ namespace MF {
              */
             virtual void onConnect(EV::MyWatcher *watcher) {};
 
+            /**
+             * 获取read buffer的可写指针, 没有buffer时从loop的池中获取
+             * @param length 需要写入的长度
+             * @return 可写指针
+             */
+            char* reserveReadBuffer(uint32_t length);
+
         protected:
             uint64_t uid{0}; //uid
 
@@ -233,7 +266,8 @@ namespace MF {
             EV::MyIOWatcher* connectWatcher{nullptr}; //connect watcher
             EV::MyIOWatcher* readWatcher{nullptr}; //read watcher
 
-            Buffer::MySKBuffer* readBuffer{nullptr}; //read buffer
+            std::shared_ptr<Buffer::MySKBuffer> readBuffer{nullptr}; //read buffer, 有数据时才从池中获取
+            Buffer::MySKBufferPool* bufferPool{nullptr}; //所在loop的read buffer池
 
             ClientLoop* loop{nullptr}; //ev loop
 
@@ -277,8 +311,126 @@ namespace MF {
 
             int32_t sendPayload(std::unique_ptr<Buffer::MyIOBuf> iobuf) override;
 
+            int32_t sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain) override;
+
         protected:
+            /**
+             * 构造函数, 用于其他类型的流式socket
+             * @param servantId servantId
+             * @param domain socket domain
+             * @param type socket类型
+             */
+            MyTcpClient(uint16_t servantId, int32_t domain, int32_t type);
+
             void onConnect(EV::MyWatcher *watcher) override;
+
+            /**
+             * 连接成功之后, 通知上层之前执行, 用于握手
+             * @return 0 成功 其他 错误码, 按连接失败处理
+             */
+            virtual int32_t onConnected() {
+                return 0;
+            }
+
+            /**
+             * 按消息读取一次, 读取长度为g_max_packet_length, 尾部空间不够时先读到备用块
+             * @return 读取到的字节数, 已经追加到readBuffer, 消息被截断时返回-1, errno为EMSGSIZE
+             */
+            int32_t readPacket();
+
+            /**
+             * 放入发送队列并尝试发送, 只能在loop线程调用
+             * @param chain 数据
+             */
+            void queueChain(std::unique_ptr<Buffer::MyIOBufChain> chain);
+
+            /**
+             * 发送队列中的数据, socket写满时监听可写事件, 发完之后取消
+             */
+            void flushWriteQueue();
+
+            /**
+             * socket可写
+             * @param watcher watcher
+             */
+            void onWritable(EV::MyWatcher *watcher);
+
+            int32_t domain {AF_INET}; //socket domain, 重连时使用
+            int32_t type {SOCK_STREAM}; //socket类型, 重连时使用
+            bool packetMode {false}; //是否按消息读取(SOCK_SEQPACKET)
+            uint32_t readHint {g_default_read_size}; //下一次read的最小长度, 根据最近读取的数据量调整
+            Buffer::MyIOBufChain writeQueue; //socket写满时没有发送的数据, 只在loop线程访问
+            std::deque<uint32_t> writeLengths; //按消息发送时发送队列中每个消息的长度
+            EV::MyIOWatcher* drainWatcher {nullptr}; //发送队列不为空时监听可写事件
+        };
+
+        /**
+         * unix socket client, 用于同一台机器上的调用, 不经过tcp/ip协议栈
+         * config.host为socket文件的路径, seqPacket时每次write是一个消息
+         */
+        class MyUnixClient : public MyTcpClient {
+        public:
+            /**
+             * 构造函数
+             * @param servantId servantId
+             * @param seqPacket true SOCK_SEQPACKET false SOCK_STREAM
+             */
+            MyUnixClient(uint16_t servantId, bool seqPacket);
+        };
+
+        /**
+         * 共享内存client, 用于同一台机器上延迟敏感的调用, 对端为MyShmServant
+         * 连接unix socket之后创建共享内存, 通过SCM_RIGHTS传给server, 之后数据只通过共享内存收发
+         * read watcher监听自己的doorbell, 只有在等待数据时server才会敲doorbell
+         * server异常退出时无法通过共享内存发现, 需要依赖心跳
+         */
+        class MyShmClient : public MyUnixClient {
+        public:
+            /**
+             * 构造函数
+             * @param servantId servantId
+             */
+            MyShmClient(uint16_t servantId);
+
+            ~MyShmClient() override;
+
+            /**
+             * 获取doorbell, 握手之前返回socket
+             * @return fd
+             */
+            uint32_t getFd() const override;
+
+            void disconnect() override;
+
+            int32_t onRead() override;
+
+            int32_t sendPayload(const char *buffer, uint32_t length) override;
+
+            int32_t sendPayload(std::unique_ptr<Buffer::MyIOBuf> iobuf) override;
+
+            int32_t sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain) override;
+
+        protected:
+            /**
+             * 创建共享内存, 把fd传给server
+             * @return 0 成功 其他 错误码
+             */
+            int32_t onConnected() override;
+
+            /**
+             * 写入ring, 只能在loop线程调用
+             * @param chain 数据
+             */
+            void writeChain(std::unique_ptr<Buffer::MyIOBufChain> chain);
+
+            /**
+             * 把没有写完的数据写入ring, ring满时等待server读取之后敲doorbell
+             */
+            void flushPending();
+
+        protected:
+            std::unique_ptr<Buffer::MyShmRingPair> rings; //共享内存ring, 每次连接重新创建
+            Buffer::MyIOBufChain pending; //ring满时没有写入的数据, 只在loop线程访问
         };
 
         class MyUdpClient : public MyClient {
@@ -302,7 +454,10 @@ namespace MF {
 
             int32_t sendPayload(std::unique_ptr<Buffer::MyIOBuf> iobuf) override;
 
+            using MyClient::sendPayload;
+
         protected:
+            uint32_t readLength {g_max_udp_packet_length}; //一次读取的最大长度, 开启GRO之后变大
         };
 
         /**
@@ -14,24 +14,49 @@ namespace MF {
 
         struct CommConfig {
             uint32_t handlerThreadCount{1}; //handler的线程数
+            ExecutorType handlerExecutorType{kExecutorThreadPool}; //handler线程池的实现, 默认加锁队列的线程池
             uint32_t ioThreadCount{1}; //io线程池
         };
 
         /**
          * 通信器，用于管理多个Proxy
          */
-        class MyCommunicator {
+        class MyCommunicator : public MySingleton<MyCommunicator> {
         public:
 
             void initialize(const CommConfig& config){
                 this->config = config;
-                handlerExecutor = new MyThreadExecutor<int32_t >(config.handlerThreadCount);
+                handlerExecutor = new MyThreadExecutor<int32_t >(config.handlerThreadCount, config.handlerExecutorType);
                 loops = new ClientLoopManager();
                 if (loops->initialize(config.ioThreadCount)) {
                     LOG(ERROR) << "initialize io thread fail" << std::endl;
                 }
             }
 
+            /**
+             * 初始化每个cpu上的client io线程, 用于threadPerCore模式
+             * 第i个core的proxy只使用绑定在cpus[i]上的io线程, 响应直接在该io线程处理, 不经过线程池
+             * @param cpus 每个core绑定的cpu
+             */
+            void initializeCores(const std::vector<int32_t>& cpus) {
+                std::lock_guard<std::mutex> guard(mutex);
+                for (auto cpu : cpus) {
+                    auto coreLoops = new ClientLoopManager();
+                    if (coreLoops->initialize(1, cpu)) {
+                        LOG(ERROR) << "initialize core io thread fail, cpu: " << cpu << std::endl;
+                    }
+                    cores.push_back(coreLoops);
+                }
+            }
+
+            /**
+             * 设置当前线程所属的core, 在threadPerCore的io线程启动时调用
+             * @param core core的下标, 小于0表示不属于任何core
+             */
+            static void setLocalCore(int32_t core) {
+                localCore() = core;
+            }
+
             /**
              * 更新proxy配置
              * @param servantName servant name
@@ -45,12 +70,20 @@ namespace MF {
                 proxyConfig.clients = config;
                 proxyConfigs[servantName] = proxyConfig;
 
-                //2. 新proxy只做保存
+                //2. 更新每个core上的proxy
+                auto core = coreProxys.find(servantName);
+                if (core != coreProxys.end()) {
+                    for (auto& proxy : core->second) {
+                        proxy->update(proxyConfig);
+                    }
+                }
+
+                //3. 新proxy只做保存
                 if (proxys.find(servantName) == proxys.end()) {
                     return ;
                 }
 
-                //3. 更新旧的proxy
+                //4. 更新旧的proxy
                 auto proxy = proxys[servantName];
 
                 //更新配置
@@ -66,7 +99,27 @@ namespace MF {
             template<typename T>
             std::shared_ptr<T> getServantProxy(const std::string& servantName);
 
+            /**
+             * 获取当前core上的ServantProxy, 连接和响应处理都不离开当前core
+             * 当前线程不属于任何core时和getServantProxy相同
+             * 每个线程第一次获取之后缓存在线程中, 之后不加锁
+             * @tparam T proxy的类型
+             * @param servantName servant name
+             * @return proxy
+             */
+            template<typename T>
+            std::shared_ptr<T> getLocalServantProxy(const std::string& servantName);
+
         protected:
+            /**
+             * 当前线程所属的core
+             * @return core的下标
+             */
+            static int32_t& localCore() {
+                static thread_local int32_t core {-1};
+                return core;
+            }
+
             std::map<std::string, std::shared_ptr<ServantProxy>> proxys; //已经建立的proxys
 
             std::mutex mutex; //proxy 锁
@@ -78,6 +131,10 @@ namespace MF {
             CommConfig config; //配置
 
             std::map<std::string, ProxyConfig> proxyConfigs;
+
+            std::vector<ClientLoopManager*> cores; //每个core的io线程
+
+            std::map<std::string, std::vector<std::shared_ptr<ServantProxy>>> coreProxys; //每个core上的proxy, 用于更新配置
         };
 
         template<typename T>
@@ -105,6 +162,36 @@ namespace MF {
             proxy->update(proxyConfigs[servantName]);
             return dynamic_pointer_cast<T>(proxy);
         }
+
+        template<typename T>
+        std::shared_ptr<T> MyCommunicator::getLocalServantProxy(const std::string &servantName) {
+            auto core = localCore();
+            if (core < 0) {
+                return getServantProxy<T>(servantName);
+            }
+
+            //1. 线程中已经缓存
+            static thread_local std::map<std::string, std::shared_ptr<T>> cache;
+            auto it = cache.find(servantName);
+            if (it != cache.end()) {
+                return it->second;
+            }
+
+            //2. 检查是否有配置
+            std::lock_guard<std::mutex> guard(mutex);
+            if (static_cast<uint32_t >(core) >= cores.size()
+                || proxyConfigs.find(servantName) == proxyConfigs.end()) {
+                return nullptr;
+            }
+
+            //3. 构造只使用当前core的io线程的proxy
+            auto proxy = std::make_shared<T>(cores[core]);
+            proxy->setHandlerExecutor(nullptr);
+            coreProxys[servantName].push_back(proxy);
+            proxy->update(proxyConfigs[servantName]);
+            cache[servantName] = proxy;
+            return proxy;
+        }
     }
 }
 
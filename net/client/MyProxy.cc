@@ -32,6 +32,19 @@ namespace MF {
             return addClient(config, client);
         }
 
+        int32_t MyProxy::addUnixClient(const MF::Client::ClientConfig &config) {
+            //1. 构造client
+            auto client = std::make_shared<MyUnixClient>(
+                    hash(getServantName()) % 0xFFF, config.clientType == kClientTypeUnixSeqPacket);
+            return addClient(config, client);
+        }
+
+        int32_t MyProxy::addShmClient(const MF::Client::ClientConfig &config) {
+            //1. 构造client
+            auto client = std::make_shared<MyShmClient>(hash(getServantName()) % 0xFFF);
+            return addClient(config, client);
+        }
+
         int32_t MyProxy::addClient(const MF::Client::ClientConfig &config, shared_ptr<MF::Client::MyClient> client) {
             //保存client
             loops->addClient(client);
@@ -149,6 +162,9 @@ namespace MF {
                 }
             }while (status == kPacketStatusComplete);
 
+            //数据处理完了, 归还read buffer
+            client->releaseReadBuffer();
+
         }
 
         void MyProxy::onDisconnect(const std::shared_ptr<MyClient>& client) {
@@ -214,6 +230,14 @@ namespace MF {
                         if (self->addUdpClient(*it) != 0) {
                             LOG(ERROR) << "add udp client fail" << std::endl;
                         }
+                    } else if (it->clientType == kClientTypeUnix || it->clientType == kClientTypeUnixSeqPacket) {
+                        if (self->addUnixClient(*it) != 0) {
+                            LOG(ERROR) << "add unix client fail" << std::endl;
+                        }
+                    } else if (it->clientType == kClientTypeShm) {
+                        if (self->addShmClient(*it) != 0) {
+                            LOG(ERROR) << "add shm client fail" << std::endl;
+                        }
                     }
                 }
             });
@@ -248,7 +272,7 @@ namespace MF {
                //心跳消息
                LOG(INFO) << "receive heartbeat message, uid: " << client->getUid()
                          << ", requestId: " << request->getRequestId() << std::endl;
-               this->handlerExecutor->exec([request] () -> int32_t {
+               this->runHandler([request] () -> int32_t {
                    return request->doSuccessAction(nullptr);
 
                });
@@ -256,7 +280,7 @@ namespace MF {
                //业务消息
                auto m = magicMsg.release();
                auto self = dynamic_pointer_cast<ServantProxy>(shared_from_this());
-               this->handlerExecutor->exec([self, m, request] () -> int32_t{
+               this->runHandler([self, m, request] () -> int32_t{
                    auto mm = std::unique_ptr<Protocol::MyMagicMessage>(m);
                    //4. 解码消息内容
                    auto payload = self->decode(mm->getPayload());
@@ -268,6 +292,13 @@ namespace MF {
                    //5. 处理响应
                    return request->doSuccessAction(std::move(payload));
                });
+           } else if (magicMsg->getFlag() == Protocol::kFlagOverload) {
+               //服务端过载, 请求没有处理, 直接失败
+               LOG(WARNING) << "servant overloaded, uid: " << client->getUid()
+                            << ", requestId: " << request->getRequestId() << std::endl;
+               this->runHandler([request] () -> int32_t {
+                   return request->doErrorAction();
+               });
            }
         }
 
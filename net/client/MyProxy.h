@@ -53,7 +53,7 @@ namespace MF {
 
             /**
              * 设置handler executor
-             * @param executor executor
+             * @param executor executor, nullptr表示响应直接在client的io线程处理
              */
             void setHandlerExecutor(MyThreadExecutor<int32_t>* executor) {
                 this->handlerExecutor = executor;
@@ -73,6 +73,18 @@ namespace MF {
 
         protected:
 
+            /**
+             * 执行响应的回调, 没有线程池时在当前io线程执行
+             * @param func 回调
+             */
+            void runHandler(std::function<int32_t()>&& func) {
+                if (handlerExecutor == nullptr) {
+                    func();
+                    return;
+                }
+                handlerExecutor->exec(std::move(func));
+            }
+
             /**
              * 增加tcp client
              * @param config config
@@ -87,6 +99,20 @@ namespace MF {
              */
             virtual int32_t addUdpClient(const ClientConfig& config);
 
+            /**
+             * 增加unix socket client
+             * @param config config, host为socket文件的路径
+             * @return 0 成功 其他失败
+             */
+            virtual int32_t addUnixClient(const ClientConfig& config);
+
+            /**
+             * 增加共享内存client
+             * @param config config, host为MyShmServant的socket文件的路径
+             * @return 0 成功 其他失败
+             */
+            virtual int32_t addShmClient(const ClientConfig& config);
+
             /**
              * 增加client
              * @param client client
@@ -148,7 +174,7 @@ namespace MF {
 
             ClientLoopManager* loops; //事件循环
 
-            MyThreadExecutor<int32_t >* handlerExecutor; //handler的执行线程池
+            MyThreadExecutor<int32_t >* handlerExecutor {nullptr}; //handler的执行线程池
 
             ProxyConfig config; //proxy的配置
 
@@ -11,6 +11,8 @@
 
 #include <thread>
 #include <set>
+#include <map>
+#include <chrono>
 #include "MyWatcher.h"
 #include "util/MyQueue.h"
 
@@ -27,10 +29,14 @@ namespace MF {
             
             /**
              *  @brief 构造函数
+             *
+             *  @param flags libev的flags
              */
             explicit MyLoop(uint32_t flags) {
 #ifdef __APPLE__
                 loop_ = ev_loop_new(EVBACKEND_KQUEUE|flags);
+#elif defined(__linux__)
+                loop_ = ev_loop_new(EVBACKEND_EPOLL|flags);
 #elif _UNIX
                 loop_ = ev_loop_new(EVBACKEND_EPOLL|flags);
 #else
@@ -59,12 +65,11 @@ namespace MF {
                 queue_watcher_ = MyWatcherManager::GetInstance()->create<MyAsyncWatcher>(std::move(func));
                 add(queue_watcher_);
                 
-                idle_watcher_ = MyWatcherManager::GetInstance()->create<MyIdleWatcher>([this] (MyWatcher*) {
-                    if(!this->onIdle()) { //执行空闲任务,如果没有任何任务执行，就休眠10ms
-                        std::this_thread::sleep_for(std::chrono::milliseconds(10)); //休眠10毫秒
-                    }
-                });
-                add(idle_watcher_);
+                //定时执行维护任务, 不再在空闲时休眠
+                tick_watcher_ = MyWatcherManager::GetInstance()->create<MyTimerWatcher>([this] (MyWatcher*) {
+                    this->onTick();
+                }, kTickInterval, kTickInterval);
+                add(tick_watcher_);
             }
             
             /**
@@ -72,7 +77,45 @@ namespace MF {
              */
             ~MyLoop() {
                 MyWatcherManager::GetInstance()->destroy(queue_watcher_); //删除watcher
-                MyWatcherManager::GetInstance()->destroy(idle_watcher_);
+                MyWatcherManager::GetInstance()->destroy(tick_watcher_);
+            }
+
+            /**
+             * 设置忙轮询的时长, 需要在start之前调用
+             * 有io事件之后在该时长内不阻塞等待, 0表示不忙轮询
+             * @param busyPollMicros 忙轮询时长(微秒)
+             */
+            void setBusyPoll(uint32_t busyPollMicros) {
+                busy_poll_us_ = busyPollMicros;
+            }
+
+            /**
+             * 是否开启了忙轮询
+             * @return true 开启
+             */
+            bool isBusyPoll() const {
+                return busy_poll_us_ > 0;
+            }
+
+            /**
+             * 增加忙轮询时的轮询函数, 用于没有fd的数据源(例如共享内存), 只能在loop线程调用
+             * 忙轮询期间每一轮执行poll, 有数据时由poll触发对应的watcher
+             * loop阻塞之前执行park, 返回false表示还有数据, 继续忙轮询
+             * @param poll 轮询函数
+             * @param park 阻塞之前执行的函数, 返回true之后数据源需要通过fd唤醒loop
+             * @return 轮询函数的id
+             */
+            uint64_t addPoller(std::function<void()>&& poll, std::function<bool()>&& park) {
+                pollers_[++poller_id_] = std::make_pair(std::move(poll), std::move(park));
+                return poller_id_;
+            }
+
+            /**
+             * 删除轮询函数, 只能在loop线程调用
+             * @param id addPoller返回的id
+             */
+            void removePoller(uint64_t id) {
+                pollers_.erase(id);
             }
 
             /**
@@ -109,14 +152,29 @@ namespace MF {
              *
              */
             void start() {
+                {
+                    std::lock_guard<std::recursive_mutex> guard(run_mutex_);
+                    running_ = true;
+                }
+
                 while (!exit_) {
-                    auto rv = ev_run(loop_, 0);
+                    auto rv = busy_poll_us_ > 0 ? runBusyPoll() : ev_run(loop_, 0);
                     LOG(INFO) << "loop exit, rv: " << rv;
                     sleep(1);
                     if (rv == 0) { //如果没有事件了，那么就退出循环
                         break;
                     }
                 }
+
+                //退出之后不再处理事件, 执行队列中剩下的函数, 之后提交的函数由调用线程立刻执行
+                std::lock_guard<std::recursive_mutex> guard(run_mutex_);
+                running_ = false;
+                Function f;
+                while (queue_.popFront(f, 0)) {
+                    if (f) {
+                        f();
+                    }
+                }
             }
             
             /**
@@ -134,6 +192,8 @@ namespace MF {
             
             /**
              *  @brief 线程执行
+             *  loop没有在运行(还没有启动或者已经退出)时不会再处理事件, 由调用线程立刻执行
+             *  提交的函数一定会被执行
              *
              *  @param pred 需要执行的函数
              *
@@ -143,14 +203,22 @@ namespace MF {
                 if (std::this_thread::get_id() == threadId) {
                     //立刻执行
                     pred(args...);
-                } else {
-                    //放进队列
-                    queue_.pushBack(std::bind(pred, args...));
-                    {
-                        lock_start
-                        //发出事件信号
-                        queue_watcher_->signal();
-                    }
+                    return;
+                }
+
+                std::lock_guard<std::recursive_mutex> guard(run_mutex_);
+                if (!running_) {
+                    //loop不在运行, 执行期间loop不会启动
+                    pred(args...);
+                    return;
+                }
+
+                //放进队列
+                queue_.pushBack(std::bind(pred, args...));
+                {
+                    lock_start
+                    //发出事件信号
+                    queue_watcher_->signal();
                 }
             }
             
@@ -199,10 +267,66 @@ namespace MF {
 
         protected:
             /**
-             * 当前线程空闲
+             * 定时执行的维护任务, 每kTickInterval秒执行一次
+             */
+            virtual void onTick() {}
+
+            /**
+             *  @brief 忙轮询执行循环
+             *  有io事件之后的busy_poll_us_微秒内只轮询不阻塞, 超过之后阻塞等待下一个事件
+             *
+             *  @return 0 没有事件了
+             */
+            int32_t runBusyPoll() {
+                typedef std::chrono::steady_clock Clock;
+                auto budget = std::chrono::microseconds(busy_poll_us_);
+                auto deadline = Clock::now() + budget;
+                while (!exit_) {
+                    auto count = MyIOWatcher::eventCount();
+                    auto spin = Clock::now() < deadline;
+                    if (spin) {
+                        runPollers();
+                    } else if (!parkPollers()) {
+                        spin = true; //还有数据, 不能阻塞
+                        runPollers();
+                    }
+                    auto rv = ev_run(loop_, spin ? EVRUN_NOWAIT : EVRUN_ONCE);
+                    if (rv == 0) {
+                        return 0;
+                    }
+
+                    if (MyIOWatcher::eventCount() != count) {
+                        deadline = Clock::now() + budget; //有io事件, 继续忙轮询
+                    }
+                }
+                return 1;
+            }
+
+            /**
+             *  @brief 执行所有的轮询函数
              */
-            virtual bool onIdle() { return false;}
+            void runPollers() {
+                //poll中可能删除自己
+                for (auto it = pollers_.begin(); it != pollers_.end(); ) {
+                    auto cur = it++;
+                    cur->second.first();
+                }
+            }
 
+            /**
+             *  @brief loop阻塞之前让所有的数据源改为通过fd唤醒
+             *
+             *  @return true 全部可以阻塞 false 还有数据
+             */
+            bool parkPollers() {
+                bool rv = true;
+                for (auto it = pollers_.begin(); it != pollers_.end(); ++it) {
+                    if (!it->second.second()) {
+                        rv = false;
+                    }
+                }
+                return rv;
+            }
         protected:
             MyLoop(MyLoop& r) = delete; //不允许拷贝
             MyLoop& operator= (MyLoop& r) = delete; //不允许赋值
@@ -210,9 +334,17 @@ namespace MF {
             ev_loop_t* loop_; //循环
             MyThreadQueue<Function> queue_; //需要执行的任务队列
             MyAsyncWatcher* queue_watcher_; //队列的watcher
-            MyIdleWatcher* idle_watcher_; //空闲的watcher
+            MyTimerWatcher* tick_watcher_; //维护任务的定时器
+            uint32_t busy_poll_us_ {0}; //忙轮询时长(微秒)
+            //忙轮询时的轮询函数和阻塞之前执行的函数, 只在loop线程访问
+            std::map<uint64_t, std::pair<std::function<void()>, std::function<bool()>>> pollers_;
+            uint64_t poller_id_ {0}; //轮询函数的id
+
+            static constexpr ev_tstamp kTickInterval = 1.0; //维护任务的执行间隔(秒)
             bool exit_ {false}; //退出循环
             std::mutex mutex_;
+            std::recursive_mutex run_mutex_; //保护running_, 和队列中剩余函数的执行互斥
+            bool running_ {false}; //loop是否在处理事件
 
             std::thread::id threadId; //线程id
         };
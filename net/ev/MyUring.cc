@@ -0,0 +1,428 @@
+//
+// Created by mingweiliu on 2019/1/20.
+//
+
+#include "net/ev/MyUring.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __linux__
+//老的内核头文件中没有的定义
+#ifndef IORING_ACCEPT_MULTISHOT
+#define IORING_ACCEPT_MULTISHOT (1U << 0) //linux 5.19
+#endif
+#ifndef IORING_RECV_MULTISHOT
+#define IORING_RECV_MULTISHOT (1U << 1) //linux 6.0
+#endif
+#ifndef IORING_ASYNC_CANCEL_ALL
+#define IORING_ASYNC_CANCEL_ALL (1U << 0) //linux 5.19
+#define IORING_ASYNC_CANCEL_FD (1U << 1)
+#endif
+#ifndef IORING_REGISTER_PBUF_RING
+#define IORING_REGISTER_PBUF_RING 22 //linux 5.19
+#endif
+#endif
+
+namespace MF {
+    namespace EV {
+#ifdef __linux__
+        namespace {
+            int32_t uringSetup(uint32_t entries, struct io_uring_params* params) {
+                return static_cast<int32_t >(::syscall(__NR_io_uring_setup, entries, params));
+            }
+
+            int32_t uringEnter(int32_t fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+                return static_cast<int32_t >(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+            }
+
+            int32_t uringRegister(int32_t fd, uint32_t opcode, const void* arg, uint32_t count) {
+                return static_cast<int32_t >(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+            }
+
+            //和内核共享的计数器, 读取对端的更新需要acquire, 发布自己的更新需要release
+            uint32_t loadAcquire(const uint32_t* p) {
+                return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+            }
+
+            void storeRelease(uint32_t* p, uint32_t v) {
+                __atomic_store_n(p, v, __ATOMIC_RELEASE);
+            }
+        }
+#endif
+
+        MyUring::~MyUring() {
+            destroy();
+        }
+
+        int32_t MyUring::initialize(uint32_t entries, uint32_t bufferCount, uint32_t bufferSize) {
+#ifdef __linux__
+            //1. 创建io_uring, 映射提交和完成队列
+            struct io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            ringFd = uringSetup(entries, &params);
+            if (ringFd < 0) {
+                return -1;
+            }
+
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+            }
+
+            sqRing = ::mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED) {
+                sqRing = nullptr;
+                destroy();
+                return -1;
+            }
+
+            if (params.features & IORING_FEAT_SINGLE_MMAP) {
+                cqRing = sqRing;
+            } else {
+                cqRing = ::mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+                if (cqRing == MAP_FAILED) {
+                    cqRing = nullptr;
+                    destroy();
+                    return -1;
+                }
+            }
+
+            sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+            auto sqeMem = ::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+            if (sqeMem == MAP_FAILED) {
+                destroy();
+                return -1;
+            }
+            sqes = static_cast<struct io_uring_sqe*>(sqeMem);
+
+            auto sq = static_cast<char*>(sqRing);
+            sqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+            sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+            sqEntries = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_entries);
+            sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+            sqLocalTail = sqSubmitted = *sqTail;
+
+            auto cq = static_cast<char*>(cqRing);
+            cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            //2. 注册provided buffer ring, 多次recv由内核从中选择buffer
+            if (bufferCount == 0 || (bufferCount & (bufferCount - 1)) != 0 || bufferCount > 32768) {
+                errno = EINVAL;
+                destroy();
+                return -1;
+            }
+
+            bufRingSize = bufferCount * sizeof(struct io_uring_buf);
+            auto ringMem = ::mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ringMem == MAP_FAILED) {
+                destroy();
+                return -1;
+            }
+            bufRing = static_cast<struct io_uring_buf_ring*>(ringMem);
+
+            struct io_uring_buf_reg reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = reinterpret_cast<uint64_t >(bufRing);
+            reg.ring_entries = bufferCount;
+            reg.bgid = kBufferGroup;
+            if (uringRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+                ::munmap(bufRing, bufRingSize);
+                bufRing = nullptr; //没有注册成功, 不需要注销
+                destroy();
+                return -1;
+            }
+
+            this->bufferCount = bufferCount;
+            this->bufferSize = bufferSize;
+            bufMask = bufferCount - 1;
+            buffers.resize(static_cast<size_t >(bufferCount) * bufferSize);
+            for (uint32_t i = 0; i < bufferCount; ++i) {
+                pushBuffer(static_cast<uint16_t >(i));
+            }
+
+            //3. 完成事件通过eventfd通知loop
+            eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (eventFd < 0 || uringRegister(ringFd, IORING_REGISTER_EVENTFD, &eventFd, 1) != 0) {
+                destroy();
+                return -1;
+            }
+            return 0;
+#else
+            errno = ENOSYS;
+            return -1;
+#endif
+        }
+
+        void MyUring::destroy() {
+#ifdef __linux__
+            if (bufRing != nullptr) {
+                ::munmap(bufRing, bufRingSize);
+                bufRing = nullptr;
+            }
+            if (sqes != nullptr) {
+                ::munmap(sqes, sqesSize);
+                sqes = nullptr;
+            }
+            if (cqRing != nullptr && cqRing != sqRing) {
+                ::munmap(cqRing, cqRingSize);
+            }
+            cqRing = nullptr;
+            if (sqRing != nullptr) {
+                ::munmap(sqRing, sqRingSize);
+                sqRing = nullptr;
+            }
+#endif
+            //关闭io_uring时内核取消所有还没有完成的请求
+            if (ringFd >= 0) {
+                ::close(ringFd);
+                ringFd = -1;
+            }
+            if (eventFd >= 0) {
+                ::close(eventFd);
+                eventFd = -1;
+            }
+            callbacks.clear();
+        }
+
+#ifdef __linux__
+        struct io_uring_sqe* MyUring::getSqe() {
+            if (ringFd < 0) {
+                return nullptr;
+            }
+
+            //队列满了, 先把已经填好的提交给内核
+            if (getFreeSqes() == 0 && submit() < 0) {
+                return nullptr;
+            }
+            if (getFreeSqes() == 0) {
+                errno = EBUSY;
+                return nullptr;
+            }
+
+            auto index = sqLocalTail & sqMask;
+            auto sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            ++sqLocalTail;
+            return sqe;
+        }
+
+        uint32_t MyUring::getFreeSqes() const {
+            return sqEntries - (sqLocalTail - loadAcquire(sqHead));
+        }
+
+        void MyUring::pushBuffer(uint16_t bid) {
+            //C++中__DECLARE_FLEX_ARRAY展开后bufs的偏移不是0, 直接按数组访问
+            auto& buf = reinterpret_cast<struct io_uring_buf*>(bufRing)[bufTail & bufMask];
+            buf.addr = reinterpret_cast<uint64_t >(&buffers[static_cast<size_t >(bid) * bufferSize]);
+            buf.len = bufferSize;
+            buf.bid = bid;
+            ++bufTail;
+            __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+        }
+#endif
+
+        uint64_t MyUring::accept(int32_t fd, Callback&& callback) {
+#ifdef __linux__
+            auto sqe = getSqe();
+            if (sqe == nullptr) {
+                return 0;
+            }
+
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->user_data = ++nextId;
+            callbacks[nextId] = std::move(callback);
+            return nextId;
+#else
+            return 0;
+#endif
+        }
+
+        uint64_t MyUring::recv(int32_t fd, Callback&& callback) {
+#ifdef __linux__
+            auto sqe = getSqe();
+            if (sqe == nullptr) {
+                return 0;
+            }
+
+            //长度为0, 由内核从buffer group中选择buffer
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = fd;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = kBufferGroup;
+            sqe->user_data = ++nextId;
+            callbacks[nextId] = std::move(callback);
+            return nextId;
+#else
+            return 0;
+#endif
+        }
+
+        int32_t MyUring::send(int32_t fd, const struct iovec *iov, uint32_t count, Callback&& callback) {
+#ifdef __linux__
+            if (count == 0 || count > sqEntries) {
+                errno = EINVAL;
+                return -1;
+            }
+
+            //链接的请求不能跨越两次提交, 空间不够时先提交
+            if (getFreeSqes() < count) {
+                submit();
+                if (getFreeSqes() < count) {
+                    errno = EBUSY;
+                    return -1;
+                }
+            }
+
+            for (uint32_t i = 0; i < count; ++i) {
+                auto sqe = getSqe();
+                sqe->opcode = IORING_OP_SEND;
+                sqe->fd = fd;
+                sqe->addr = reinterpret_cast<uint64_t >(iov[i].iov_base);
+                sqe->len = static_cast<uint32_t >(iov[i].iov_len);
+                sqe->msg_flags = MSG_NOSIGNAL;
+                sqe->flags = i + 1 < count ? IOSQE_IO_LINK : 0; //按顺序执行, 前一个没有发完时后面的取消
+                sqe->user_data = ++nextId;
+                callbacks[nextId] = callback;
+            }
+            return 0;
+#else
+            errno = ENOSYS;
+            return -1;
+#endif
+        }
+
+        void MyUring::cancel(uint64_t id) {
+#ifdef __linux__
+            if (id == 0 || callbacks.find(id) == callbacks.end()) {
+                return; //已经完成了
+            }
+
+            auto sqe = getSqe();
+            if (sqe == nullptr) {
+                return;
+            }
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = id;
+            sqe->user_data = 0; //取消请求自己的完成事件不需要处理
+#endif
+        }
+
+        void MyUring::cancelFd(int32_t fd) {
+#ifdef __linux__
+            auto sqe = getSqe();
+            if (sqe == nullptr) {
+                return;
+            }
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = fd;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = 0;
+#endif
+        }
+
+        const char* MyUring::getBuffer(uint32_t flags) const {
+#ifdef __linux__
+            if ((flags & IORING_CQE_F_BUFFER) == 0) {
+                return nullptr;
+            }
+            auto bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            return &buffers[static_cast<size_t >(bid) * bufferSize];
+#else
+            return nullptr;
+#endif
+        }
+
+        void MyUring::releaseBuffer(uint32_t flags) {
+#ifdef __linux__
+            if ((flags & IORING_CQE_F_BUFFER) != 0) {
+                pushBuffer(static_cast<uint16_t >(flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+#endif
+        }
+
+        int32_t MyUring::submit() {
+#ifdef __linux__
+            if (ringFd < 0) {
+                return -1;
+            }
+
+            uint32_t count = sqLocalTail - sqSubmitted;
+            if (count == 0) {
+                return 0;
+            }
+
+            //发布填好的sqe, 一次系统调用提交
+            storeRelease(sqTail, sqLocalTail);
+            sqSubmitted = sqLocalTail;
+            ++enterCount;
+            int32_t rv;
+            do {
+                rv = uringEnter(ringFd, count, 0, 0);
+            } while (rv < 0 && errno == EINTR);
+            return rv;
+#else
+            return -1;
+#endif
+        }
+
+        uint32_t MyUring::reap() {
+#ifdef __linux__
+            if (ringFd < 0) {
+                return 0;
+            }
+
+            //清除eventfd的计数
+            uint64_t value = 0;
+            while (::read(eventFd, &value, sizeof(value)) > 0) {}
+
+            uint32_t count = 0;
+            uint32_t head = *cqHead;
+            while (head != loadAcquire(cqTail)) {
+                //1. 先取出完成事件并且归还位置, 回调中可能提交新的请求
+                auto cqe = cqes[head & cqMask];
+                storeRelease(cqHead, ++head);
+                ++count;
+
+                //2. 调用回调, 没有后续事件时删除
+                if (cqe.user_data == 0) {
+                    continue;
+                }
+                auto it = callbacks.find(cqe.user_data);
+                if (it == callbacks.end()) {
+                    continue;
+                }
+                Callback callback;
+                if (cqe.flags & IORING_CQE_F_MORE) {
+                    callback = it->second;
+                } else {
+                    callback = std::move(it->second);
+                    callbacks.erase(it);
+                }
+                callback(cqe.res, cqe.flags);
+            }
+            return count;
+#else
+            return 0;
+#endif
+        }
+    }
+}
@@ -0,0 +1,204 @@
+//
+// Created by mingweiliu on 2019/1/20.
+//
+
+#ifndef MYFRAMEWORK2_MYURING_H
+#define MYFRAMEWORK2_MYURING_H
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <sys/uio.h>
+#include "util/MyCommon.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+namespace MF {
+    namespace EV {
+
+        /**
+         * io_uring的提交和完成队列, 直接使用系统调用, 不依赖liburing
+         * 每个loop一个, 只能在loop线程访问
+         * 完成事件通过注册的eventfd通知, eventfd由libev监听, 所以现有的watcher可以和io_uring一起使用
+         * 支持: 多次accept, 使用provided buffer ring的多次recv, 按顺序链接的send
+         */
+        class MyUring {
+        public:
+            /**
+             * 完成回调
+             * res 系统调用的结果, 小于0时为-errno
+             * flags cqe的flags, IORING_CQE_F_MORE表示还会有后续的完成事件, IORING_CQE_F_BUFFER表示使用了provided buffer
+             */
+            typedef std::function<void (int32_t res, uint32_t flags)> Callback;
+
+            MyUring() = default;
+
+            ~MyUring();
+
+            /**
+             * 初始化io_uring和接收使用的provided buffer ring
+             * @param entries 提交队列的长度
+             * @param bufferCount 接收buffer的个数, 必须是2的幂
+             * @param bufferSize 每个接收buffer的长度
+             * @return 0 成功 -1 失败, 内核不支持时errno为ENOSYS或者EINVAL
+             */
+            int32_t initialize(uint32_t entries, uint32_t bufferCount, uint32_t bufferSize);
+
+            /**
+             * 有完成事件时可读的eventfd
+             * @return fd
+             */
+            int32_t getEventFd() const {
+                return eventFd;
+            }
+
+            /**
+             * 多次accept, 每个新连接一个完成事件, res为新连接的fd
+             * @param fd 监听socket
+             * @param callback 回调
+             * @return 请求id, 用于取消, 0表示失败
+             */
+            uint64_t accept(int32_t fd, Callback&& callback);
+
+            /**
+             * 多次recv, 数据放在provided buffer中, 通过getBuffer获取, 处理完之后需要releaseBuffer
+             * buffer用完时完成事件为-ENOBUFS, 并且不再有后续事件, 需要重新提交
+             * @param fd socket
+             * @param callback 回调
+             * @return 请求id, 用于取消, 0表示失败
+             */
+            uint64_t recv(int32_t fd, Callback&& callback);
+
+            /**
+             * 按顺序发送多段数据, 每段一个send, 前一个失败或者没有发完时后面的都会被取消(-ECANCELED)
+             * 每段完成时都会调用一次回调, 发送期间数据不能被释放
+             * @param fd socket
+             * @param iov 数据
+             * @param count 段数, 不能超过提交队列的长度
+             * @param callback 回调
+             * @return 0 成功 -1 失败
+             */
+            int32_t send(int32_t fd, const struct iovec* iov, uint32_t count, Callback&& callback);
+
+            /**
+             * 取消请求, 请求最后一个完成事件为-ECANCELED
+             * @param id 请求id
+             */
+            void cancel(uint64_t id);
+
+            /**
+             * 取消fd上所有的请求, 需要在关闭fd之前提交
+             * @param fd socket
+             */
+            void cancelFd(int32_t fd);
+
+            /**
+             * 获取recv使用的provided buffer
+             * @param flags 完成事件的flags
+             * @return buffer, 完成事件没有使用buffer时为nullptr
+             */
+            const char* getBuffer(uint32_t flags) const;
+
+            /**
+             * 归还recv使用的provided buffer
+             * @param flags 完成事件的flags
+             */
+            void releaseBuffer(uint32_t flags);
+
+            /**
+             * 提交所有还没有提交的请求, loop阻塞之前调用, 一轮产生的请求只需要一次系统调用
+             * @return 提交的请求个数, -1 失败
+             */
+            int32_t submit();
+
+            /**
+             * 处理所有的完成事件, eventfd可读时调用
+             * @return 处理的完成事件个数
+             */
+            uint32_t reap();
+
+            /**
+             * 提交和完成的统计
+             * @return 累计的io_uring_enter次数
+             */
+            uint64_t getEnterCount() const {
+                return enterCount;
+            }
+
+        protected:
+#ifdef __linux__
+            /**
+             * 获取一个空闲的sqe, 队列满时先提交
+             * @return sqe, nullptr表示失败
+             */
+            struct io_uring_sqe* getSqe();
+
+            /**
+             * 提交队列中空闲的sqe个数
+             * @return 个数
+             */
+            uint32_t getFreeSqes() const;
+
+            /**
+             * 把buffer放回provided buffer ring
+             * @param bid buffer id
+             */
+            void pushBuffer(uint16_t bid);
+#endif
+
+            /**
+             * 释放所有资源
+             */
+            void destroy();
+
+        protected:
+            MyUring(const MyUring&) = delete;
+            MyUring& operator=(const MyUring&) = delete;
+
+        protected:
+            int32_t ringFd {-1}; //io_uring的fd
+            int32_t eventFd {-1}; //完成事件通知
+#ifdef __linux__
+            //提交队列
+            void* sqRing {nullptr};
+            size_t sqRingSize {0};
+            uint32_t* sqHead {nullptr};
+            uint32_t* sqTail {nullptr};
+            uint32_t sqMask {0};
+            uint32_t sqEntries {0};
+            uint32_t* sqArray {nullptr};
+            struct io_uring_sqe* sqes {nullptr};
+            size_t sqesSize {0};
+            uint32_t sqLocalTail {0}; //已经填好但是还没有发布给内核的sqe
+            uint32_t sqSubmitted {0}; //已经发布给内核的sqe
+
+            //完成队列
+            void* cqRing {nullptr};
+            size_t cqRingSize {0};
+            uint32_t* cqHead {nullptr};
+            uint32_t* cqTail {nullptr};
+            uint32_t cqMask {0};
+            struct io_uring_cqe* cqes {nullptr};
+
+            //provided buffer ring
+            struct io_uring_buf_ring* bufRing {nullptr};
+            size_t bufRingSize {0};
+            uint16_t bufTail {0};
+            uint32_t bufMask {0};
+#endif
+            std::vector<char> buffers; //接收buffer, bufferCount * bufferSize
+            uint32_t bufferSize {0};
+            uint32_t bufferCount {0};
+
+            uint64_t nextId {0}; //请求id, 0保留给不需要回调的请求
+            std::unordered_map<uint64_t, Callback> callbacks; //未完成的请求
+            uint64_t enterCount {0}; //io_uring_enter次数
+
+            static const uint16_t kBufferGroup = 0; //provided buffer的group id
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYURING_H
@@ -185,7 +185,17 @@ namespace MF {
              */
             MyIOWatcher(MyWatcher::COB && pred)
             : MyWatcherBase<ev_io>(std::move(pred)){
-                ev_init(&watcher_, callback);
+                ev_init(&watcher_, ioCallback);
+            }
+
+            /**
+             *  @brief 当前线程处理过的io事件个数, 用于判断loop是否空闲
+             *
+             *  @return 事件个数
+             */
+            static uint64_t& eventCount() {
+                static thread_local uint64_t count = 0;
+                return count;
             }
             
             /**
@@ -214,7 +224,23 @@ namespace MF {
                     is_listened_ = false;
                 }
             }
+
+            /**
+             *  @brief 不经过fd直接触发一次事件, 在loop的本轮执行回调, 只能在loop线程调用
+             *
+             *  @param revents 事件, 回调中可以通过events()区分
+             */
+            void feed(int32_t revents) {
+                if (event_.loop) {
+                    ev_feed_event(event_.loop, &watcher_, revents);
+                }
+            }
         protected:
+            //io事件的回调函数, 先计数再执行
+            static void ioCallback(struct ev_loop* loop, ev_io* watcher, int32_t revents) {
+                ++eventCount();
+                callback(loop, watcher, revents);
+            }
         private:
         };
         
@@ -390,6 +416,36 @@ namespace MF {
         private:
         };
         
+        //prepare事件, 每次loop阻塞等待之前执行
+        class MyPrepareWatcher : public MyWatcherBase<ev_prepare> {
+        public:
+            /**
+             *  @brief 构造 watcher
+             */
+            MyPrepareWatcher(MyWatcher::COB && pred)
+            : MyWatcherBase<ev_prepare>(std::move(pred)){
+                ev_prepare_init(&watcher_, callback);
+                is_valid_ = true;
+            }
+
+            //添加到事件循环
+            void append(struct ev_loop* loop) override {
+                ev_prepare_start(loop, &watcher_);
+                is_listened_ = true;
+                event_.loop = loop;
+            }
+
+            //从循环删除事件
+            void subtract() override {
+                if (event_.loop) {
+                    ev_prepare_stop(event_.loop, &watcher_);
+                    is_listened_ = false;
+                }
+            }
+        protected:
+        private:
+        };
+
         //async事件
         class MyAsyncWatcher : public MyWatcherBase<ev_async> {
         public:
@@ -443,6 +499,7 @@ namespace MF {
                 RegisterObject<MyStatWatcher>(MAKE_NAME(MyStatWatcher));
                 RegisterObject<MyIdleWatcher>(MAKE_NAME(MyIdleWatcher));
                 RegisterObject<MyAsyncWatcher>(MAKE_NAME(MyAsyncWatcher));
+                RegisterObject<MyPrepareWatcher>(MAKE_NAME(MyPrepareWatcher));
             }
             
             MyWatcherManager(MyWatcherManager& r) = delete;
@@ -511,6 +568,13 @@ namespace MF {
                 add(static_cast<MyWatcher*>(obj));
                 return obj;
             }
+
+            template<typename T, typename Pred>
+            typename std::enable_if<std::is_same<T, MyPrepareWatcher>::value, T*>::type create(Pred&& pred) {
+                auto obj = static_cast<T*>(factory_.MakeObject(MAKE_NAME(MyPrepareWatcher), pred));
+                add(static_cast<MyWatcher*>(obj));
+                return obj;
+            }
             
             /**
              *  @brief 删除一个watcher
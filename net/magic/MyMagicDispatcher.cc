@@ -16,8 +16,35 @@ namespace MF {
             }
         }
 
+        int32_t MyMagicDispatcher::handleOverload(const std::unique_ptr<Buffer::MyIOBuf> &iobuf,
+                                                  std::shared_ptr<Server::MyContext> context) {
+            //1. 只解析消息头
+            auto reqMsg = std::unique_ptr<Protocol::MyMagicMessage>(new Protocol::MyMagicMessage());
+            reqMsg->decode(iobuf);
+            if (!context->isNeedResponse()) {
+                return kHandleResultSuccess;
+            }
+
+            //2. 回复过载响应, 不带payload
+            auto rspMsg = std::unique_ptr<Protocol::MyMagicMessage>(new Protocol::MyMagicMessage());
+            rspMsg->setRequestId(reqMsg->getRequestId());
+            rspMsg->setServerNumber(reqMsg->getServerNumber());
+            rspMsg->setIsRequest(0);
+            rspMsg->setVersion(reqMsg->getVersion());
+            rspMsg->setFlag(Protocol::kFlagOverload);
+            rspMsg->setLength(rspMsg->headLen());
+            context->sendPayload(rspMsg->encodeChain());
+            return kHandleResultSuccess;
+        }
+
+        std::string MyMagicDispatcher::getCommand(const std::unique_ptr<Buffer::MyIOBuf> &packet) {
+            //只读取消息头, 不移动读指针
+            return Protocol::MyMagicMessage::getCommand(static_cast<const char*>(packet->readable()),
+                                                         packet->getReadableLength());
+        }
+
         int32_t MyMagicDispatcher::dispatchPacket(const std::unique_ptr<Buffer::MyIOBuf>& request,
-                                                 std::unique_ptr<Buffer::MyIOBuf> &response
+                                                 std::unique_ptr<Buffer::MyIOBufChain> &response
                                                  , std::shared_ptr<Server::MyContext> context) {
 
             //1. 解码消息
@@ -29,7 +56,7 @@ namespace MF {
                 LOG(INFO) << "receive heartbeat message, requestId: " << reqMsg->getRequestId() << std::endl;
                 //返回心跳响应
                 reqMsg->setIsRequest(0); //设置为响应
-                response = std::move(reqMsg->encode());
+                response = reqMsg->encodeChain();
                 return kHandleResultSuccess;
             }
 
@@ -48,6 +75,7 @@ namespace MF {
                 rspMsg->setServerNumber(reqMsg->getServerNumber());
                 rspMsg->setIsRequest(0);
                 rspMsg->setVersion(reqMsg->getVersion());
+                rspMsg->setFlag(Protocol::kFlagData);
 
                 if (rspBuf != nullptr) {
                     rspMsg->setLength(rspMsg->headLen() + rspBuf->getReadableLength());
@@ -55,7 +83,7 @@ namespace MF {
                 } else {
                     rspMsg->setLength(rspMsg->headLen());
                 }
-                response = std::move(rspMsg->encode());
+                response = rspMsg->encodeChain(); //payload直接挂到响应上，不拷贝
             }
             return rv;
         }
@@ -24,6 +24,23 @@ namespace MF {
              */
             virtual ~MyMagicDispatcher();
 
+            /**
+             * servant过载, 回复一个只有消息头的过载响应
+             * @param iobuf 数据包
+             * @param context context
+             * @return 结果
+             */
+            int32_t handleOverload(const std::unique_ptr<Buffer::MyIOBuf>& iobuf,
+                                   std::shared_ptr<Server::MyContext> context) override;
+
+            /**
+             * 从消息头解析命令, 用于决定是否在io线程执行
+             * 心跳为"heartbeat", 数据为server number
+             * @param packet 完整的数据包
+             * @return 命令
+             */
+            std::string getCommand(const std::unique_ptr<Buffer::MyIOBuf>& packet) override;
+
         protected:
             /**
              * 分发数据包
@@ -32,7 +49,7 @@ namespace MF {
              * @return 分发结果
              */
             int32_t dispatchPacket(const std::unique_ptr<Buffer::MyIOBuf>& request,
-                                   std::unique_ptr<Buffer::MyIOBuf> &response
+                                   std::unique_ptr<Buffer::MyIOBufChain> &response
                                    , std::shared_ptr<Server::MyContext> context) override;
             /**
              * 分发收到的数据内容
@@ -24,6 +24,26 @@ namespace MF {
             return payload;
         }
 
+        std::unique_ptr<Buffer::MyIOBufChain> MyMagicMessage::encodeChain() {
+            //1. 编码消息头
+            std::unique_ptr<Buffer::MyIOBuf> head(Buffer::MyIOBuf::create(headLen()));
+            head->write<uint32_t >(length);
+            head->write<uint8_t >(flag);
+            head->write<uint16_t >(version);
+            head->write<int8_t >(isRequest);
+            head->write<uint64_t >(requestId);
+            head->write<uint32_t >(serverNumber);
+
+            //2. 挂上数据体, 再把消息头放到最前面
+            auto chain = Buffer::MyIOBufChain::create();
+            if (this->payload != nullptr) {
+                chain->append(std::move(this->payload));
+            }
+            chain->prepend(std::move(head));
+
+            return chain;
+        }
+
         void MyMagicMessage::decode(const std::unique_ptr<MF::Buffer::MyIOBuf> &payload) {
             length = payload->read<uint32_t >();
             flag = payload->read<uint8_t >();
@@ -32,9 +52,9 @@ namespace MF {
             requestId = payload->read<uint64_t >();
             serverNumber = payload->read<uint32_t >();
 
+            //数据包是切片时, payload直接引用同一段内存
             if (payload->getReadableLength() > 0) {
-                this->payload = Buffer::MyIOBuf::create(length - headLen());
-                this->payload->write<void*>(payload->readable(), payload->getReadableLength());
+                this->payload = payload->split(payload->getReadableLength());
             }
         }
 
@@ -109,6 +129,28 @@ namespace MF {
             uint32_t packetLen = getPacketLength(buf, length);
             return packetLen <= length ? kPacketStatusComplete : kPacketStatusIncomplete;
         }
+
+        std::string MyMagicMessage::getCommand(const char *buf, uint32_t length) {
+            //消息头: | length | flag | version | isRequest | requestId | serverNumber |
+            const uint32_t flagOffset = sizeof(uint32_t);
+            const uint32_t serverOffset = flagOffset + sizeof(uint8_t) + sizeof(uint16_t)
+                                          + sizeof(int8_t) + sizeof(uint64_t);
+            if (buf == nullptr || length < serverOffset + sizeof(uint32_t)) {
+                return std::string();
+            }
+
+            uint8_t flag = 0;
+            memcpy(&flag, buf + flagOffset, sizeof(uint8_t));
+            if (flag == kFlagHeartbeat) {
+                return "heartbeat";
+            } else if (flag == kFlagRoute) {
+                return "route";
+            }
+
+            uint32_t serverNumber = 0;
+            memcpy(&serverNumber, buf + serverOffset, sizeof(uint32_t));
+            return std::to_string(serverNumber);
+        }
     }
 }
 
@@ -7,6 +7,7 @@
 
 #include "net/MyGlobal.h"
 #include "net/buffer/myIOBuf.h"
+#include "net/buffer/MyIOBufChain.h"
 
 namespace MF {
     namespace Protocol {
@@ -15,6 +16,7 @@ namespace MF {
             kFlagData = 0, //数据
             kFlagHeartbeat = 1, //心跳
             kFlagRoute = 2, //路由
+            kFlagOverload = 3, //服务端过载, 请求没有处理
         };
         /**
          * 消息的基类
@@ -37,6 +39,13 @@ namespace MF {
              */
             virtual std::unique_ptr<Buffer::MyIOBuf> encode();
 
+            /**
+             * 编码成chain, 消息头单独一个块, payload直接挂到chain上不拷贝
+             * 编码之后payload会被转移到chain中
+             * @return chain
+             */
+            virtual std::unique_ptr<Buffer::MyIOBufChain> encodeChain();
+
             /**
              * 解码消息
              * @param payload payload
@@ -103,6 +112,15 @@ namespace MF {
              */
             static int32_t isPacketComplete(const char* buf, uint32_t length);
 
+            /**
+             * 只解析消息头得到命令, 不解码整个消息
+             * 心跳为"heartbeat", 路由为"route", 数据为server number的十进制字符串
+             * @param buf 完整的数据包
+             * @param length 数据长度
+             * @return 命令, 消息头不完整时为空
+             */
+            static std::string getCommand(const char* buf, uint32_t length);
+
         protected:
             uint32_t length; //消息的总长度
             uint16_t version; //协议版本
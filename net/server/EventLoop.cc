@@ -22,20 +22,44 @@ namespace MF {
             }
         }
 
-        int32_t EventLoopManager::initialize(uint32_t count) {
+        int32_t EventLoopManager::initialize(uint32_t count, uint32_t busyPollMicros, bool pinCpu,
+                std::function<void(uint32_t)> threadInit) {
             if (count == 0) { //系统自行决定
                 return -1;
             }
 
+            //uid中只有8位loop下标, 超过之后不同loop的uid会重复
+            if (count > MyChannelTable::kMaxLoops) {
+                LOG(ERROR) << "too many io threads, count: " << count
+                           << ", use: " << MyChannelTable::kMaxLoops << std::endl;
+                count = MyChannelTable::kMaxLoops;
+            }
+
             int rv = 0;
+            auto cpus = MyCommon::getAllowedCpus(); //taskset或者cgroup限制之后可用的cpu
             for (auto i = 0; i < count; ++i) {
                 EventLoop* loop = new EventLoop(EVFLAG_AUTO);
-                std::thread t([loop]() {
+                loop->setIndex(static_cast<uint32_t >(i));
+                loop->setBusyPoll(busyPollMicros);
+                if (backend == kLoopBackendIoUring && loop->enableUring() != 0) {
+                    LOG(ERROR) << "io_uring is not supported, use epoll, index: " << i
+                               << ", error: " << strerror(errno) << std::endl;
+                }
+                std::thread t([loop, i, threadInit]() {
+                    if (threadInit) {
+                        threadInit(static_cast<uint32_t >(i));
+                    }
                     loop->start();
                 });
                 //保存线程id
                 loop->setThreadId(t.get_id());
 
+                //绑定cpu, 避免io线程在cpu之间迁移
+                if (pinCpu && MyCommon::pinThread(t.native_handle(), cpus[i % cpus.size()]) != 0) {
+                    LOG(ERROR) << "pin io thread to cpu fail, index: " << i
+                               << ", cpu: " << cpus[i % cpus.size()] << std::endl;
+                }
+
                 std::unique_lock<std::mutex> lock(mutex_);
                 if(!cond_.wait_for(lock, std::chrono::seconds(3), [&t]{return t.joinable();})) {
                     rv = -1;
@@ -56,42 +80,211 @@ namespace MF {
             return loops_[index];
         }
 
-        EventLoop::EventLoop(uint32_t flags) : MyLoop(flags) {}
+        uint64_t EventLoopManager::getMemoryPerChannel() const {
+            uint64_t bytes = 0;
+            uint64_t count = 0;
+            for (auto it = loops_.begin(); it != loops_.end(); ++it) {
+                bytes += (*it)->getBufferPool()->getBytes();
+                count += (*it)->getChannelCount();
+            }
+            return count > 0 ? bytes / count : 0;
+        }
+
+        EventLoop::EventLoop(uint32_t flags)
+        : MyLoop(flags), timeoutWheel(MyTimeProvider::now())
+        , bufferPool(g_default_skbuffer_capacity, g_default_buffer_pool_idle) {
+            auto flush = [this] (EV::MyWatcher*) {
+                this->flushDirtyChannels();
+            };
+            flushWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyAsyncWatcher>(flush);
+            prepareWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyPrepareWatcher>(flush);
+            add(flushWatcher);
+            add(prepareWatcher);
+        }
 
         EventLoop::~EventLoop() {
+            EV::MyWatcherManager::GetInstance()->destroy(flushWatcher);
+            EV::MyWatcherManager::GetInstance()->destroy(prepareWatcher);
             channels.clear();
+            channelTable.clear();
+
+            //channel关闭之后再释放, 关闭io_uring时内核取消还没有完成的请求
+            if (uringWatcher != nullptr) {
+                EV::MyWatcherManager::GetInstance()->destroy(uringWatcher);
+                uringWatcher = nullptr;
+            }
+            delete uring;
+            uring = nullptr;
+        }
+
+        int32_t EventLoop::enableUring() {
+            if (uring != nullptr) {
+                return 0;
+            }
+
+            //1. 创建io_uring和接收buffer
+            auto ring = new EV::MyUring();
+            if (ring->initialize(g_default_uring_entries, g_default_uring_buffer_count,
+                    g_default_uring_buffer_size) != 0) {
+                auto err = errno;
+                delete ring;
+                errno = err;
+                return -1;
+            }
+            uring = ring;
+
+            //2. 完成事件由eventfd通知
+            uringWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>([this](EV::MyWatcher*) {
+                this->onUringEvent();
+            }, uring->getEventFd(), EV_READ);
+            add(uringWatcher);
+            return 0;
+        }
+
+        void EventLoop::onUringEvent() {
+            //回调中产生的新请求由prepare watcher在loop阻塞之前统一提交
+            uring->reap();
         }
 
         void EventLoop::addChannel(std::shared_ptr<MF::Server::MyChannel> channel) {
-            channels[channel->getUid()] = channel;
+            if (MyChannelTable::isSlotUid(channel->getUid())) {
+                if (!channelTable.insert(channel->getUid(), channel)) {
+                    LOG(ERROR) << "insert channel fail, uid: " << channel->getUid() << std::endl;
+                    return;
+                }
+                channelCount.fetch_add(1, std::memory_order_relaxed);
+            } else if (channels.insert(std::make_pair(channel->getUid(), channel)).second) {
+                channelCount.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                channels[channel->getUid()] = channel;
+            }
+
+            //时间轮只在io线程访问
+            if (channel->getIdleTimeout() > 0) {
+                RunInThreadOrImmediate([this, channel]() {
+                    this->scheduleTimeout(channel);
+                });
+            }
         }
 
         void EventLoop::removeChannel(std::shared_ptr<MF::Server::MyChannel> channel) {
             channel->close(); //关闭channel
-            channels.erase(channel->getUid());
+            bool erased = MyChannelTable::isSlotUid(channel->getUid())
+                    ? channelTable.erase(channel->getUid())
+                    : channels.erase(channel->getUid()) > 0;
+            if (erased) {
+                channelCount.fetch_sub(1, std::memory_order_relaxed);
+            }
         }
 
         std::shared_ptr<MyChannel> EventLoop::findChannel(uint64_t uid) {
-            return channels.find(uid) != channels.end() ? channels[uid] : nullptr;
+            //1. tcp连接直接按照fd查找
+            if (MyChannelTable::isSlotUid(uid)) {
+                return channelTable.find(uid);
+            }
+
+            //2. udp连接
+            auto it = channels.find(uid);
+            return it != channels.end() ? it->second : nullptr;
+        }
+
+        uint64_t EventLoop::allocateUid(uint32_t fd) {
+            return channelTable.allocate(fd);
         }
 
-        bool EventLoop::onIdle() {
-            if (MyTimeProvider::now() - lastCheckTime < 1) { //没有检查
-                return false;
+        void EventLoop::markDirty(std::shared_ptr<MyChannel> channel) {
+            //1. 已经在待发送列表中了
+            if (!channel->markWritePending()) {
+                return;
+            }
+            dirtyChannels.push(std::move(channel));
+
+            //2. io线程自己产生的响应, 在loop阻塞之前由prepare watcher发送
+            if (std::this_thread::get_id() == threadId) {
+                return;
+            }
+
+            //3. 一批响应只唤醒一次
+            if (!flushPending.exchange(true)) {
+                flushWatcher->signal();
             }
+        }
+
+        void EventLoop::flushDirtyChannels() {
+            //先清除通知标记, 之后放入的channel会重新唤醒
+            flushPending = false;
+
+            std::shared_ptr<MyChannel> channel;
+            while (dirtyChannels.pop(channel)) {
+                channel->clearWritePending();
 
-            //检查是否有超时任务
-            auto it = channels.begin();
-            while (it != channels.end()) {
-                if (it->second->checkTimeout()) {
-                    it->second->close(); //关闭socket
-                    it = channels.erase(it);
-                } else {
-                    it++;
+                //channel已经被删除了
+                if (findChannel(channel->getUid()) != channel) {
+                    continue;
                 }
+
+                if (channel->onWrite() != 0) {
+                    LOG(ERROR) << "send data fail, close socket, uid: " << channel->getUid() << std::endl;
+                    removeChannel(channel);
+                }
+            }
+
+            for (auto it = flushHooks.begin(); it != flushHooks.end(); ++it) {
+                it->second();
             }
 
-            lastCheckTime = MyTimeProvider::now();
+            //这一轮产生的io_uring请求一次提交
+            if (uring != nullptr) {
+                uring->submit();
+            }
+        }
+
+        uint64_t EventLoop::addFlushHook(std::function<void()> &&hook) {
+            flushHooks[++flushHookId] = std::move(hook);
+            return flushHookId;
+        }
+
+        void EventLoop::removeFlushHook(uint64_t id) {
+            flushHooks.erase(id);
+        }
+
+        void EventLoop::onTick() {
+            //回收切片已经释放的read buffer
+            bufferPool.reclaim();
+
+            //只处理到期的channel
+            timeoutWheel.advance(MyTimeProvider::now(), [this](std::weak_ptr<MyChannel>& weak) {
+                this->onChannelExpire(weak);
+            });
+        }
+
+        void EventLoop::scheduleTimeout(std::shared_ptr<MyChannel> channel) {
+            timeoutWheel.add(channel, channel->getLastReceiveTime() + channel->getIdleTimeout());
+        }
+
+        void EventLoop::onChannelExpire(std::weak_ptr<MyChannel>& weak) {
+            //1. channel已经被删除了
+            auto channel = weak.lock();
+            if (channel == nullptr) {
+                return;
+            }
+
+            if (findChannel(channel->getUid()) != channel) {
+                return;
+            }
+
+            //2. 期间收到过数据, 按照最后接收时间重新计时
+            if (MyTimeProvider::now() < channel->getLastReceiveTime() + channel->getIdleTimeout()) {
+                scheduleTimeout(channel);
+                return;
+            }
+
+            //3. 已经超时
+            if (channel->checkTimeout()) {
+                removeChannel(channel); //关闭socket
+            } else {
+                timeoutWheel.add(channel, MyTimeProvider::now() + channel->getIdleTimeout());
+            }
         }
     }
 }
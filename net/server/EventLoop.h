@@ -7,7 +7,12 @@
 
 #include "net/MyGlobal.h"
 #include "net/ev/MyLoop.h"
+#include "net/ev/MyUring.h"
 #include "net/server/MyChannel.h"
+#include "util/MyMpscQueue.h"
+#include "util/MyTimingWheel.h"
+#include "net/server/MyChannelTable.h"
+#include "net/buffer/MySKBufferPool.h"
 namespace MF {
     namespace Server {
 
@@ -38,13 +43,145 @@ namespace MF {
              */
             std::shared_ptr<MyChannel> findChannel(uint64_t uid);
 
+            /**
+             * 为新的tcp连接分配uid, 只能在io线程调用
+             * @param fd 连接的fd
+             * @return uid
+             */
+            uint64_t allocateUid(uint32_t fd);
+
+            /**
+             * 标记channel有响应需要发送, 可以在任意线程调用
+             * 同一个channel在发送之前只会放入一次, 同一批响应只唤醒一次loop
+             * @param channel channel
+             */
+            void markDirty(std::shared_ptr<MyChannel> channel);
+
+            /**
+             * 增加发送完所有待发送channel之后执行的函数, 例如批量发送udp响应, 只能在io线程调用
+             * @param hook 函数
+             * @return 函数的id, 用于删除
+             */
+            uint64_t addFlushHook(std::function<void()>&& hook);
+
+            /**
+             * 删除发送之后执行的函数, 只能在io线程调用
+             * @param id addFlushHook返回的id
+             */
+            void removeFlushHook(uint64_t id);
+
+            uint32_t getIndex() const {
+                return index;
+            }
+
+            /**
+             * 获取read buffer池, 只能在io线程获取和归还buffer
+             * @return buffer池
+             */
+            Buffer::MySKBufferPool* getBufferPool() {
+                return &bufferPool;
+            }
+
+            /**
+             * 获取channel个数, 可以在其他线程读取
+             * @return 个数
+             */
+            uint64_t getChannelCount() const {
+                return channelCount.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * 记录一次可读事件中read的次数
+             * @param calls read的次数
+             */
+            void addReadStat(uint32_t calls) {
+                readWakeups.fetch_add(1, std::memory_order_relaxed);
+                readCalls.fetch_add(calls, std::memory_order_relaxed);
+            }
+
+            /**
+             * 获取tcp可读事件的次数, 可以在其他线程读取
+             * @return 次数
+             */
+            uint64_t getReadWakeups() const {
+                return readWakeups.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * 获取tcp read的总次数, 除以可读事件的次数就是每次唤醒的read次数
+             * @return 次数
+             */
+            uint64_t getReadCalls() const {
+                return readCalls.load(std::memory_order_relaxed);
+            }
+
+            void setIndex(uint32_t index) {
+                EventLoop::index = index;
+                channelTable.setLoopIndex(index);
+            }
+
+            /**
+             * 使用io_uring收发数据, 需要在loop启动之前调用
+             * 完成事件通过eventfd通知, 所以libev的watcher照常使用
+             * @return 0 成功 -1 内核不支持, 继续使用epoll
+             */
+            int32_t enableUring();
+
+            /**
+             * 获取io_uring, 只能在io线程使用
+             * @return io_uring, 没有开启时为nullptr
+             */
+            EV::MyUring* getUring() {
+                return uring;
+            }
+
         protected:
-            bool onIdle() override;
+            void onTick() override;
+
+            /**
+             * 发送所有待发送channel的响应, 只在io线程调用
+             */
+            void flushDirtyChannels();
+
+            /**
+             * eventfd可读, 处理io_uring的完成事件
+             */
+            void onUringEvent();
+
+            /**
+             * 把channel放入超时时间轮, 到期时间为最后接收时间加上空闲超时时间
+             * @param channel channel
+             */
+            void scheduleTimeout(std::shared_ptr<MyChannel> channel);
+
+            /**
+             * 时间轮中的channel到期, 没有超时的重新放入时间轮
+             * @param weak channel
+             */
+            void onChannelExpire(std::weak_ptr<MyChannel>& weak);
 
         protected:
-            std::map<uint64_t , std::shared_ptr<MyChannel> > channels; //连接map
+            MyChannelTable channelTable; //tcp连接, 以fd为下标
+            std::map<uint64_t , std::shared_ptr<MyChannel> > channels; //udp连接map
+            MyTimingWheel<std::weak_ptr<MyChannel>> timeoutWheel; //空闲超时的时间轮, 以秒为tick
+
+            MyMpscQueue<std::shared_ptr<MyChannel>> dirtyChannels; //有响应需要发送的channel
+            std::atomic<bool> flushPending {false}; //是否已经发出了唤醒通知
+            EV::MyAsyncWatcher* flushWatcher {nullptr}; //其他线程产生响应时唤醒loop
+            EV::MyPrepareWatcher* prepareWatcher {nullptr}; //loop阻塞之前发送io线程自己产生的响应
+            std::map<uint64_t, std::function<void()>> flushHooks; //发送完所有channel之后执行
+            uint64_t flushHookId {0}; //flush hook的id
 
-            uint32_t lastCheckTime {0};
+            uint32_t index {0}; //在loop manager中的下标
+
+            EV::MyUring* uring {nullptr}; //io_uring, 没有开启时为nullptr
+            EV::MyIOWatcher* uringWatcher {nullptr}; //监听io_uring完成事件的eventfd
+
+            Buffer::MySKBufferPool bufferPool; //连接使用的read buffer池, 只在io线程获取和归还
+            std::atomic<uint64_t> channelCount {0}; //channel个数
+
+            std::atomic<uint64_t> readWakeups {0}; //tcp可读事件的次数
+            std::atomic<uint64_t> readCalls {0}; //tcp read的次数
         };
 
         class EventLoopManager {
@@ -59,9 +196,22 @@ namespace MF {
              *  @brief 初始化loop mananger
              *
              *  @param count loop的个数
+             *  @param busyPollMicros 忙轮询时长(微秒), 0表示不忙轮询
+             *  @param pinCpu 是否把每个io线程绑定到一个cpu上, 从进程允许的cpu中依次选择
+             *  @param threadInit 每个io线程启动loop之前在该线程中执行, 参数为loop的下标
+             *
+             */
+            int32_t initialize(uint32_t count, uint32_t busyPollMicros = 0, bool pinCpu = false,
+                               std::function<void(uint32_t)> threadInit = nullptr);
+
+            /**
+             *  @brief 设置io线程的事件后端, 需要在initialize之前调用
              *
+             *  @param backend 后端
              */
-            int32_t initialize(uint32_t count);
+            void setBackend(LoopBackend backend) {
+                this->backend = backend;
+            }
 
             /**
              *  @brief 根据index获取对应的loop
@@ -72,6 +222,22 @@ namespace MF {
              */
             EventLoop* get(uint32_t index);
 
+            /**
+             *  @brief 获取loop的个数
+             *
+             *  @return loop的个数
+             */
+            uint32_t size() const {
+                return static_cast<uint32_t >(loops_.size());
+            }
+
+            /**
+             *  @brief 获取平均每个连接占用的read buffer内存, 包括池中空闲的和还被切片引用的buffer
+             *
+             *  @return 字节数, 没有连接时返回0
+             */
+            uint64_t getMemoryPerChannel() const;
+
             /**
              *  @brief 停止io线程
              */
@@ -107,6 +273,12 @@ namespace MF {
                     return nullptr;
                 }
 
+                //channel表分配的uid中带有loop的下标
+                if (MyChannelTable::isSlotUid(uid)) {
+                    auto index = MyChannelTable::loopOf(uid);
+                    return index < loops_.size() ? loops_[index] : nullptr;
+                }
+
                 return loops_[uid % loops_.size()];
             }
 
@@ -176,6 +348,7 @@ namespace MF {
             std::condition_variable cond_;
 
             std::atomic<int32_t> cur_index_ {0}; //当前循环到的线程标识
+            LoopBackend backend {kLoopBackendEpoll}; //io线程的事件后端
         };
     }
 }
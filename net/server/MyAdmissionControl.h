@@ -0,0 +1,163 @@
+//
+// Created by mingweiliu on 2019/1/22.
+//
+
+#ifndef MYFRAMEWORK2_MYADMISSIONCONTROL_H
+#define MYFRAMEWORK2_MYADMISSIONCONTROL_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace MF {
+    namespace Server {
+
+        /**
+         * 根据handler任务在队列中的等待时间做准入控制, 使用CoDel的控制律
+         * 等待时间持续interval都超过target时进入过载状态, 之后按照间隔拒绝新的数据包:
+         * 第count次拒绝之后的下一次拒绝在interval/sqrt(count)之后, 过载持续时拒绝的频率逐渐增加
+         * 两次拒绝之间的数据包照常放行, 它们出队时的等待时间低于target时退出过载状态
+         * 队列已经清空时直接退出过载状态
+         * 退出之后很快再次过载时从上一次的拒绝频率附近继续, 不从头开始
+         * onDequeue在handler线程调用, shouldReject在io线程调用
+         */
+        class MyAdmissionControl {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            /**
+             * 构造函数
+             * @param targetMicros 等待时间的目标(微秒)
+             * @param intervalMicros 超过目标持续多久之后进入过载状态, 也是第一次拒绝之后的间隔(微秒)
+             */
+            MyAdmissionControl(uint32_t targetMicros, uint32_t intervalMicros)
+            : target(targetMicros), interval(intervalMicros) {
+            }
+
+            /**
+             * 记录任务开始执行的时间
+             * @param enqueueTime 任务放入队列的时间
+             */
+            void onDequeue(Clock::time_point enqueueTime) {
+                auto now = Clock::now();
+                auto sojourn = std::chrono::duration_cast<std::chrono::microseconds>(now - enqueueTime).count();
+
+                //1. 低于目标, 队列已经消化
+                if (sojourn < target) {
+                    reset();
+                    return;
+                }
+
+                //2. 第一次超过目标, 开始计时
+                auto nowMicros = toMicros(now);
+                int64_t expected = 0;
+                if (firstAboveTime.compare_exchange_strong(expected, nowMicros + interval)) {
+                    return;
+                }
+
+                //3. 持续超过目标一个interval, 进入过载状态, 多个handler线程同时调用时只进入一次
+                bool idle = false;
+                if (nowMicros < expected || !overloaded.compare_exchange_strong(idle, true)) {
+                    return;
+                }
+
+                //最近刚退出过载状态时从上一次的拒绝次数继续, 否则从1开始
+                auto count = dropCount.load(std::memory_order_relaxed);
+                auto delta = count - lastCount.load(std::memory_order_relaxed);
+                auto recent = nowMicros - dropNext.load(std::memory_order_relaxed) < 16 * interval;
+                dropCount.store(delta > 1 && recent ? delta : 1, std::memory_order_relaxed);
+                lastCount.store(dropCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                dropNext.store(nowMicros, std::memory_order_relaxed); //马上拒绝下一个数据包
+            }
+
+            /**
+             * 新的数据包是否需要拒绝
+             * 过载时到了下一次拒绝的时间才拒绝, 然后按照控制律计算下一次拒绝的时间
+             * @param queued handler队列中还没有开始执行的任务数
+             * @return true 拒绝
+             */
+            bool shouldReject(size_t queued) {
+                if (!overloaded.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+
+                //1. 队列已经清空
+                if (queued == 0) {
+                    reset();
+                    return false;
+                }
+
+                //2. 还没有到下一次拒绝的时间, 放行
+                auto nowMicros = toMicros(Clock::now());
+                auto next = dropNext.load(std::memory_order_relaxed);
+                if (nowMicros < next) {
+                    return false;
+                }
+
+                //3. 拒绝, 下一次拒绝在interval/sqrt(count)之后, 多个io线程同时调用时只拒绝一个
+                //很久没有数据包时从现在开始计算, 避免一次拒绝一连串的数据包
+                auto count = dropCount.load(std::memory_order_relaxed) + 1;
+                auto base = nowMicros - next > interval ? nowMicros : next;
+                auto following = base + static_cast<int64_t >(interval / std::sqrt(static_cast<double >(count)));
+                if (!dropNext.compare_exchange_strong(next, following)) {
+                    return false;
+                }
+                dropCount.store(count, std::memory_order_relaxed);
+                return true;
+            }
+
+            /**
+             * 是否过载
+             * @return true 过载, 需要拒绝新的数据包
+             */
+            bool isOverloaded() const {
+                return overloaded.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * 记录一次拒绝
+             */
+            void onReject() {
+                rejected.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            /**
+             * 获取拒绝的数据包个数
+             * @return 个数
+             */
+            uint64_t getRejected() const {
+                return rejected.load(std::memory_order_relaxed);
+            }
+
+        private:
+            /**
+             * 退出过载状态
+             */
+            void reset() {
+                if (firstAboveTime.load(std::memory_order_relaxed) != 0) {
+                    firstAboveTime.store(0, std::memory_order_relaxed);
+                }
+                if (overloaded.load(std::memory_order_relaxed)) {
+                    overloaded.store(false, std::memory_order_relaxed);
+                }
+            }
+
+            static int64_t toMicros(Clock::time_point time) {
+                return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+            }
+
+        private:
+            int64_t target {0}; //等待时间的目标(微秒)
+            int64_t interval {0}; //持续时间(微秒)
+            std::atomic<int64_t> firstAboveTime {0}; //超过目标之后进入过载状态的时间, 0表示没有超过
+            std::atomic<bool> overloaded {false}; //是否过载
+            std::atomic<int64_t> dropNext {0}; //过载时下一次拒绝的时间(微秒)
+            std::atomic<uint32_t> dropCount {0}; //这一次过载以来拒绝的次数, 决定拒绝的间隔
+            std::atomic<uint32_t> lastCount {0}; //进入过载状态时的拒绝次数
+            std::atomic<uint64_t> rejected {0}; //拒绝的数据包个数
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYADMISSIONCONTROL_H
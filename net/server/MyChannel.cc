@@ -6,34 +6,166 @@
 #include "util/MyCommon.h"
 #include "util/MyTimeProvider.h"
 #include "net/server/EventLoop.h"
+#include "net/socket/MySocketIO.h"
 
 namespace MF {
     namespace Server {
 
         MyChannel::MyChannel(Socket::MySocket *socket) : socket(socket) {
-            this->uid = static_cast<uint32_t >(socket->getfd()); //TODO: 先设置成fd
-            this->readBuf = new Buffer::MySKBuffer(g_default_skbuffer_capacity);
-            this->writeBuf= new Buffer::MySKBuffer(g_default_skbuffer_capacity);
+            this->uid = static_cast<uint32_t >(socket->getfd()); //默认使用fd, tcp连接加入loop之前由loop重新分配
             this->lastReceiveTime = MyTimeProvider::now();
         }
 
         MyChannel::~MyChannel() {
-            if (this->readBuf != nullptr) {
-                delete(this->readBuf);
+            //可能不在io线程析构, 只更新统计
+            if (bufferPool != nullptr) {
+                if (readBuf != nullptr) {
+                    bufferPool->forget();
+                }
+                if (spareReadBuf != nullptr) {
+                    bufferPool->forget();
+                }
+            }
+        }
+
+        std::shared_ptr<Buffer::MySKBuffer> MyChannel::newReadBuffer() {
+            if (bufferPool != nullptr) {
+                return bufferPool->acquire();
+            }
+            return std::make_shared<Buffer::MySKBuffer>(g_default_skbuffer_capacity);
+        }
+
+        void MyChannel::dropReadBuffer(std::shared_ptr<Buffer::MySKBuffer> &&buf) {
+            if (buf == nullptr) {
+                return;
             }
 
-            if (this->writeBuf != nullptr) {
-                delete(this->writeBuf);
+            if (bufferPool != nullptr) {
+                bufferPool->release(std::move(buf));
+            } else {
+                buf.reset();
             }
         }
 
+        void MyChannel::releaseReadBuffer() {
+            //还有不完整的数据包时保留, 还被切片引用的buffer由池在切片释放之后回收
+            if (readBuf != nullptr && readBuf->getReadableLength() == 0) {
+                dropReadBuffer(std::move(readBuf));
+            }
+            dropReadBuffer(std::move(spareReadBuf));
+        }
+
         std::unique_ptr<Buffer::MyIOBuf> MyChannel::fetchPacket(uint32_t length) {
+            if (readBuf == nullptr) {
+                return nullptr;
+            }
+
             uint32_t readLen = length;
             char* tmp = readBuf->getReadableAndMove(&readLen);
+            if (tmp == nullptr) {
+                return nullptr;
+            }
+
+            //直接在read buffer上切片，read buffer在所有切片释放之前不会被改写
+            return Buffer::MyIOBuf::slice(readBuf, tmp, readLen);
+        }
+
+        char* MyChannel::reserveReadBuffer(uint32_t length) {
+            //空闲之后第一次读取
+            if (readBuf == nullptr) {
+                readBuf = newReadBuffer();
+            }
+
+            //1. 没有切片引用read buffer，可以随意整理和扩容
+            if (readBuf.use_count() == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire); //保证切片的读取已经完成
+                return readBuf->writeable(length);
+            }
+
+            //2. 还有切片在引用，尾部空间足够的话直接追加
+            char* buf = readBuf->appendable(length);
+            if (buf != nullptr) {
+                return buf;
+            }
+
+            //3. 切换到新的buffer, 优先复用已经没有切片引用的备用buffer
+            std::shared_ptr<Buffer::MySKBuffer> fresh;
+            if (spareReadBuf != nullptr && spareReadBuf.use_count() == 1) {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                fresh = std::move(spareReadBuf);
+            } else {
+                fresh = newReadBuffer();
+            }
+
+            //只需要拷贝还没有组成完整数据包的部分
+            uint32_t len = readBuf->getReadableLength();
+            if (len > 0) {
+                char* tail = readBuf->getReadableAndMove(&len);
+                memcpy(fresh->getWriteableAndMove(len), tail, len);
+            }
 
-            std::unique_ptr<Buffer::MyIOBuf> buf = Buffer::MyIOBuf::create(readLen);
-            buf->write<char*>(tmp, readLen);
-            return std::move(buf);
+            //旧buffer等切片全部释放之后再复用
+            dropReadBuffer(std::move(spareReadBuf));
+            spareReadBuf = std::move(readBuf);
+            readBuf = std::move(fresh);
+            return readBuf->writeable(length);
+        }
+
+        uint32_t MyChannel::sendResponse(const char *buf, uint32_t length) {
+            {
+                //拷贝到队列尾部的块中, 块写满之后才分配新的块
+                std::lock_guard<std::mutex> guard(responseMutex);
+                responseQueue.write(buf, length);
+                if (keepBoundary) {
+                    responseLengths.push_back(length);
+                }
+            }
+
+            //通知loop有数据需要发送, 同一批响应只唤醒一次
+            if (loop != nullptr) {
+                loop->markDirty(shared_from_this());
+            }
+            return length;
+        }
+
+        uint32_t MyChannel::sendResponse(std::unique_ptr<Buffer::MyIOBufChain> chain) {
+            uint32_t length = chain->getReadableLength();
+            {
+                //小的响应拷贝之后chain在handler线程释放, 大的响应直接挂上, 不拷贝
+                std::lock_guard<std::mutex> guard(responseMutex);
+                if (length <= g_response_copy_limit) {
+                    struct iovec iov[IOV_MAX];
+                    while (!chain->empty()) {
+                        auto count = chain->readableIovec(iov, IOV_MAX);
+                        uint32_t copied = 0;
+                        for (uint32_t i = 0; i < count; ++i) {
+                            responseQueue.write(iov[i].iov_base, static_cast<uint32_t >(iov[i].iov_len));
+                            copied += static_cast<uint32_t >(iov[i].iov_len);
+                        }
+                        chain->moveReadable(copied);
+                    }
+                } else {
+                    responseQueue.append(*chain);
+                }
+                if (keepBoundary) {
+                    responseLengths.push_back(length);
+                }
+            }
+
+            //通知loop有数据需要发送, 同一批响应只唤醒一次
+            if (loop != nullptr) {
+                loop->markDirty(shared_from_this());
+            }
+            return length;
+        }
+
+        void MyChannel::takeResponses(Buffer::MyIOBufChain &queue, std::deque<uint32_t> *lengths) {
+            std::lock_guard<std::mutex> guard(responseMutex);
+            queue.append(responseQueue);
+            if (lengths != nullptr) {
+                lengths->insert(lengths->end(), responseLengths.begin(), responseLengths.end());
+            }
+            responseLengths.clear();
         }
 
         /**
@@ -44,12 +176,8 @@ namespace MF {
             MyChannel::readWatcher = readWatcher;
         }
 
-        /**
-         * 设置写数据watcher
-         * @param writeWatcher
-         */
-        void MyChannel::setWriteWatcher(EV::MyAsyncWatcher *writeWatcher) {
-            MyChannel::writeWatcher = writeWatcher;
+        void MyChannel::setDrainWatcher(EV::MyIOWatcher *drainWatcher) {
+            MyChannel::drainWatcher = drainWatcher;
         }
 
         void MyChannel::setTimeoutWatcher(EV::MyTimerWatcher *timeoutWatcher) {
@@ -76,6 +204,54 @@ namespace MF {
             onTimeoutFunc = func;
         }
 
+        void MyChannel::setWatermark(uint32_t high, uint32_t low) {
+            writeHighWatermark = high;
+            writeLowWatermark = low < high ? low : high;
+        }
+
+        void MyChannel::setOnWatermarkFunc(MF::Server::MyChannel::OnWatermarkFunc &&func) {
+            onWatermarkFunc = func;
+        }
+
+        void MyChannel::checkWatermark(uint32_t pending) {
+            if (writeHighWatermark == 0) {
+                return; //不限制
+            }
+
+            if (!writeBlocked && pending > writeHighWatermark) {
+                //1. 越过高水位, 暂停读取，不再接收新的请求
+                writeBlocked = true;
+                setReadEnabled(false);
+                LOG(INFO) << "write buffer above high watermark, pause reading, uid: " << uid
+                          << ", pending: " << pending << std::endl;
+            } else if (writeBlocked && pending <= writeLowWatermark) {
+                //2. 回落到低水位，恢复读取
+                writeBlocked = false;
+                setReadEnabled(true);
+                LOG(INFO) << "write buffer below low watermark, resume reading, uid: " << uid
+                          << ", pending: " << pending << std::endl;
+            } else {
+                return; //状态没有变化
+            }
+
+            //3. 通知上层
+            if (onWatermarkFunc) {
+                onWatermarkFunc(shared_from_this(), writeBlocked);
+            }
+        }
+
+        void MyChannel::setReadEnabled(bool enabled) {
+            if (readWatcher == nullptr) {
+                return;
+            }
+
+            if (!enabled && readWatcher->is_listened()) {
+                loop->remove(readWatcher);
+            } else if (enabled && !readWatcher->is_listened()) {
+                loop->add(readWatcher);
+            }
+        }
+
         EventLoop* MyChannel::getLoop() const {
             return loop;
         }
@@ -92,58 +268,228 @@ namespace MF {
 
         int32_t MyTcpChannel::onRead() {
             int32_t rv = 0;
-            uint32_t len = 1024;
+            uint32_t calls = 0;
+            uint32_t total = 0;
             while (true) {
-                char *buf = readBuf->writeable(len);
-                auto read = socket->read(buf, len);
+                //1. 先读到buffer尾部的空闲空间, 空间不够时多读到备用块, 不整理也不扩容buffer
+                char* buf = reserveReadBuffer(0);
+                uint32_t tail = readBuf->getTailLength();
+                uint32_t want = packetMode ? g_max_packet_length : readHint;
+                auto read = Socket::MySocketIO::read(socket, buf, tail, want, packetMode,
+                        [this](uint32_t length) -> char* {
+                            return this->reserveReadBuffer(length);
+                        }, [this](uint32_t length) {
+                            this->readBuf->moveWriteable(length);
+                        });
+                ++calls;
                 if (read > 0) {
-                    readBuf->moveWriteable(static_cast<uint32_t >(read));
+                    auto length = static_cast<uint32_t >(read);
                     rv += read;
+                    total += length;
+
+                    //2. 没有读满说明内核缓冲区已经读空, 不需要再读一次EAGAIN, 按消息读取时一次只返回一个消息
+                    if (!packetMode && length < tail + (tail >= want ? 0 : want)) {
+                        break;
+                    }
+                    readHint = std::min(readHint * 2, g_max_read_size);
+
+                    //3. 超过预算之后让出loop, 剩下的数据下一轮再读
+                    if (readBudget > 0 && total >= readBudget) {
+                        break;
+                    }
                 } else if (read == 0) {
                     rv = 0; //对端关闭了
                     break;
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EMSGSIZE) {
+                    rv = -1; //消息被截断了, 连接上的数据已经不完整
+                    break;
                 } else {
-                    rv = -1; //读取失败了
+                    rv = rv > 0 ? rv : -1; //读取失败了, EAGAIN时已经读到的数据照常处理
                     break;
                 }
             }
+
+            //4. 最近的数据量变小了, 减小下一次的读取长度
+            if (total < readHint / 4 && readHint > g_default_read_size) {
+                readHint /= 2;
+            }
+
+            if (loop != nullptr) {
+                loop->addReadStat(calls);
+            }
             lastReceiveTime = MyTimeProvider::now(); //设置最后一次接收到消息的时间
             return rv;
         }
 
         int32_t MyTcpChannel::onWrite() {
-            std::lock_guard<std::mutex> guard(writeBufMutex); //尝试加锁
-            //1. 获取可发送的长度
-            uint32_t len = this->writeBuf->getReadableLength();
-            char* buf = this->writeBuf->readable(&len);
-            uint32_t send = 0;
-            while(send < len) {
-                int32_t rv = socket->write(static_cast<void*>(buf + send), len - send);
+            //1. 取出handler线程放入的响应, 挂到发送队列上
+            takeResponses(writeQueue, packetMode ? &writeLengths : nullptr);
+            if (uring != nullptr) {
+                return submitSends();
+            }
+
+            struct iovec iov[IOV_MAX];
+            while (packetMode && !writeLengths.empty()) {
+                //2. 按消息发送时一次系统调用正好是一个响应, 不能合并也不能拆开
+                auto rv = Socket::MySocketIO::writeFrame(socket, writeQueue, writeLengths.front());
+                if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break; //发送缓冲区满了，剩下的数据保留在队列中
+                }
+                if (rv < 0) {
+                    return -1; //发送失败
+                }
+                writeLengths.pop_front();
+            }
+
+            while (!packetMode && !writeQueue.empty()) {
+                //2. 字节流一次最多发送IOV_MAX个块
+                auto count = writeQueue.readableIovec(iov, IOV_MAX);
+                int32_t rv = socket->writev(iov, count);
+                if (rv < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                if (rv < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break; //发送缓冲区满了，剩下的数据保留在队列中
+                }
+
                 if (rv <= 0) {
-                    break;
+                    return -1; //发送失败
                 }
 
-                send += rv; //保存已发送的数据长度
+                //释放已经发送的块
+                writeQueue.moveReadable(static_cast<uint32_t >(rv));
+            }
+            uint32_t pending = writeQueue.getReadableLength();
+
+            //3. 还有数据没有发完, 等socket可写之后继续发送; 发完了就停止监听
+            if (drainWatcher != nullptr) {
+                if (pending > 0 && !drainWatcher->is_listened()) {
+                    loop->add(drainWatcher);
+                } else if (pending == 0 && drainWatcher->is_listened()) {
+                    loop->remove(drainWatcher);
+                }
             }
 
-            //2. 移动指针
-            writeBuf->moveReadable(len);
-            return send >= len ? 0 : -1; //检查发送的字节数和可发送的字节数是否一致
+            //4. 检查水位
+            checkWatermark(pending);
+            return 0;
         }
 
-        uint32_t MyTcpChannel::sendResponse(const char *buf, uint32_t length) {
-            std::lock_guard<std::mutex> guard(writeBufMutex); //尝试加锁
-            char* tmp = this->writeBuf->getWriteableAndMove(length);
-            if (tmp != nullptr) {
-                memcpy(tmp, buf, length); //拷贝数据
+        void MyTcpChannel::startRecv() {
+            if (uring == nullptr || socket == nullptr || recvId != 0) {
+                return;
+            }
 
-                //发送可写请求
-                this->writeWatcher->signal();
+            //recv的数据在provided buffer中, 回调不需要延长channel的生命周期
+            std::weak_ptr<MyChannel> weak = shared_from_this();
+            auto ring = uring;
+            recvId = uring->recv(socket->getfd(), [weak, ring](int32_t res, uint32_t flags) {
+                auto channel = std::static_pointer_cast<MyTcpChannel>(weak.lock());
+                if (channel == nullptr) {
+                    ring->releaseBuffer(flags);
+                    return;
+                }
+                channel->onRecvComplete(res, flags);
+            });
+            if (recvId == 0) {
+                LOG(ERROR) << "submit recv fail, uid: " << uid << ", error: " << strerror(errno) << std::endl;
+            }
+        }
+
+        void MyTcpChannel::onRecvComplete(int32_t res, uint32_t flags) {
+            //1. 拷贝到read buffer之后马上归还provided buffer, 切片和不完整的数据包都不占用io_uring的buffer
+            if (res > 0) {
+                memcpy(reserveReadBuffer(static_cast<uint32_t >(res)), uring->getBuffer(flags), static_cast<size_t >(res));
+                readBuf->moveWriteable(static_cast<uint32_t >(res));
+                lastReceiveTime = MyTimeProvider::now();
+                if (loop != nullptr) {
+                    loop->addReadStat(1);
+                }
+            }
+            uring->releaseBuffer(flags);
+
+            //2. 没有后续事件时这次recv已经结束了
+            if (!(flags & IORING_CQE_F_MORE)) {
+                recvId = 0;
+            }
+
+            //3. 交给servant处理数据或者关闭连接, 关闭之后socket为nullptr
+            if (onRecvFunc) {
+                onRecvFunc(shared_from_this(), res);
+            }
+
+            //4. buffer用完或者被取消之后重新提交, 暂停读取时等恢复之后再提交
+            if (!writeBlocked) {
+                startRecv();
+            }
+        }
+
+        void MyTcpChannel::setReadEnabled(bool enabled) {
+            if (uring == nullptr) {
+                MyChannel::setReadEnabled(enabled);
+                return;
+            }
+
+            if (enabled) {
+                startRecv();
+            } else if (recvId != 0) {
+                uring->cancel(recvId); //取消的完成事件到达时recvId才清零
+            }
+        }
+
+        int32_t MyTcpChannel::submitSends() {
+            //1. 上一批还没有完成, 完成之后会继续发送
+            if (sendInflight > 0 || writeQueue.empty() || socket == nullptr) {
+                checkWatermark(writeQueue.getReadableLength());
+                return 0;
+            }
+
+            //2. 队列头部的块按顺序链接提交, 前一个没有发完时后面的会被取消
+            struct iovec iov[g_max_uring_linked_sends];
+            auto count = writeQueue.readableIovec(iov, g_max_uring_linked_sends);
+            auto self = std::static_pointer_cast<MyTcpChannel>(shared_from_this()); //发送期间保留channel和数据
+            if (uring->send(socket->getfd(), iov, count, [self](int32_t res, uint32_t) {
+                self->onSendComplete(res);
+            }) != 0) {
+                return -1;
+            }
+            sendInflight = count;
+
+            //3. 检查水位
+            checkWatermark(writeQueue.getReadableLength());
+            return 0;
+        }
+
+        void MyTcpChannel::onSendComplete(int32_t res) {
+            //1. 释放已经发送的数据, 没有发完时后面的send被取消, 剩下的数据还在队列头部
+            --sendInflight;
+            if (res > 0) {
+                writeQueue.moveReadable(static_cast<uint32_t >(res));
+            } else if (res < 0 && res != -ECANCELED) {
+                sendError = true;
+            }
+
+            //2. 一批都完成之后再继续, 连接已经关闭时不再发送
+            if (sendInflight > 0 || socket == nullptr) {
+                return;
+            }
+
+            if (sendError || onWrite() != 0) {
+                LOG(ERROR) << "send data fail, close socket, uid: " << uid << std::endl;
+                loop->removeChannel(shared_from_this());
             }
-            return length;
         }
 
         void MyTcpChannel::close() {
+            //关闭fd之前取消io_uring上所有的请求, 发送中的数据在取消完成之前由回调持有
+            if (uring != nullptr && socket != nullptr) {
+                uring->cancelFd(socket->getfd());
+                uring->submit();
+            }
+
             if (socket != nullptr) {
                 delete(socket);
                 socket = nullptr;
@@ -154,9 +500,9 @@ namespace MF {
                 readWatcher = nullptr;
             }
 
-            if (writeWatcher != nullptr) {
-                EV::MyWatcherManager::GetInstance()->destroy(writeWatcher);
-                writeWatcher = nullptr;
+            if (drainWatcher != nullptr) {
+                EV::MyWatcherManager::GetInstance()->destroy(drainWatcher);
+                drainWatcher = nullptr;
             }
 
             if (timeoutWatcher != nullptr) {
@@ -165,24 +511,216 @@ namespace MF {
             }
         }
 
-        MyUdpChannel::MyUdpChannel(MF::Socket::MySocket *socket, const std::string& ip, uint16_t port)
-        : MyChannel(socket){
-            this->ip = ip;
-            this->port = port;
+        MyShmChannel::MyShmChannel(Socket::MySocket *socket) : MyChannel(socket) {}
+
+        int32_t MyShmChannel::onControl() {
+            //1. 握手之后unix socket上不会再有数据, 可读表示对端关闭
+            if (isAttached()) {
+                char c;
+                auto rv = socket->read(&c, sizeof(c));
+                if (rv > 0) {
+                    LOG(ERROR) << "unexpected data on shm control socket, uid: " << uid << std::endl;
+                    errno = EPROTO;
+                    return -1;
+                }
+                return rv;
+            }
+
+            //2. 接收共享内存和doorbell的fd
+            int32_t fds[Buffer::MyShmRingPair::kFdCount];
+            uint32_t count = Buffer::MyShmRingPair::kFdCount;
+            uint32_t magic = 0;
+            auto rv = socket->readFds(fds, &count, &magic, sizeof(magic));
+            if (rv <= 0) {
+                return rv;
+            }
+
+            //3. 校验握手消息, 映射共享内存
+            if (rv != sizeof(magic) || magic != g_shm_handshake_magic || count != Buffer::MyShmRingPair::kFdCount) {
+                LOG(ERROR) << "invalid shm handshake, uid: " << uid << ", length: " << rv
+                           << ", fds: " << count << std::endl;
+                for (uint32_t i = 0; i < count; ++i) {
+                    ::close(fds[i]);
+                }
+                errno = EPROTO;
+                return -1;
+            }
+            if (rings.attach(fds, count) != 0) {
+                errno = EPROTO;
+                return -1;
+            }
+
+            LOG(INFO) << "shm channel attached, uid: " << uid << ", capacity: " << rings.getCapacity() << std::endl;
+            lastReceiveTime = MyTimeProvider::now();
+            return rv;
+        }
+
+        void MyShmChannel::setDoorbellWatcher(EV::MyIOWatcher *doorbellWatcher) {
+            this->doorbellWatcher = doorbellWatcher;
+            loop->add(doorbellWatcher);
+
+            //1. 忙轮询时由loop每一轮检查ring, loop阻塞之前再改为等待doorbell
+            if (loop->isBusyPoll()) {
+                pollerId = loop->addPoller([this]() {
+                    this->pollRing();
+                }, [this]() -> bool {
+                    return this->rings.park();
+                });
+                return;
+            }
+
+            //2. 否则一直等待doorbell, 握手之前client已经写入的数据需要马上读取
+            if (!rings.park()) {
+                doorbellWatcher->feed(EV_READ | EV_CUSTOM);
+            }
+        }
+
+        void MyShmChannel::pollRing() {
+            if (rings.getReceivable() > 0 || rings.isPeerClosed()) {
+                doorbellWatcher->feed(EV_READ | EV_CUSTOM);
+            }
+        }
+
+        int32_t MyShmChannel::onRead() {
+            //1. doorbell可读时需要清除计数, 由轮询触发时不需要系统调用
+            rings.wake(!(doorbellWatcher->events() & EV_CUSTOM));
+
+            //2. doorbell也可能是对端释放了空间, 继续写入之前没有写完的响应
+            if (!writeQueue.empty()) {
+                onWrite();
+            }
+
+            //3. 从ring拷贝到read buffer, 没有数据时改为等待doorbell, 忙轮询时由loop统一处理
+            bool busyPoll = loop != nullptr && loop->isBusyPoll();
+            uint32_t total = 0;
+            while (readBudget == 0 || total < readBudget) {
+                auto length = rings.getReceivable();
+                if (length == 0) {
+                    if (busyPoll || rings.park()) {
+                        break;
+                    }
+                    continue; //设置等待之后又有了数据
+                }
+
+                if (readBudget > 0) {
+                    length = std::min(length, readBudget - total);
+                }
+                auto read = rings.receive(reserveReadBuffer(length), length);
+                readBuf->moveWriteable(read);
+                total += read;
+            }
+
+            //4. 超过预算还有数据, 或者对端已经关闭, 没有忙轮询时需要自己触发下一轮
+            bool closed = rings.isPeerClosed();
+            if (!busyPoll && total > 0 && (closed || (readBudget > 0 && total >= readBudget))) {
+                rings.rearm();
+            }
+
+            if (total == 0) {
+                if (closed) {
+                    return 0; //对端关闭了
+                }
+                errno = EAGAIN;
+                return -1;
+            }
+
+            lastReceiveTime = MyTimeProvider::now(); //设置最后一次接收到消息的时间
+            return static_cast<int32_t >(total);
+        }
+
+        int32_t MyShmChannel::onWrite() {
+            //1. 取出handler线程放入的响应
+            takeResponses(writeQueue);
+
+            //2. 直接从iobuf拷贝到ring, 不合并; ring满时对端读取之后会敲doorbell
+            struct iovec iov[IOV_MAX];
+            while (isAttached() && !writeQueue.empty()) {
+                auto count = writeQueue.readableIovec(iov, IOV_MAX);
+                uint32_t length = 0;
+                for (uint32_t i = 0; i < count; ++i) {
+                    length += static_cast<uint32_t >(iov[i].iov_len);
+                }
+
+                auto written = rings.send(iov, static_cast<int32_t >(count), length);
+                writeQueue.moveReadable(written);
+                if (written < length) {
+                    break;
+                }
+            }
+
+            //共享内存被对端写坏了, 触发一次读事件, 由onRead按对端关闭处理
+            if (rings.isCorrupted()) {
+                rings.rearm();
+            }
+
+            //3. 检查水位
+            checkWatermark(writeQueue.getReadableLength());
+            return 0;
+        }
+
+        void MyShmChannel::close() {
+            //通知对端, client不需要等待unix socket关闭
+            rings.close();
+
+            if (pollerId != 0 && loop != nullptr) {
+                loop->removePoller(pollerId);
+                pollerId = 0;
+            }
+
+            if (doorbellWatcher != nullptr) {
+                EV::MyWatcherManager::GetInstance()->destroy(doorbellWatcher);
+                doorbellWatcher = nullptr;
+            }
+
+            if (readWatcher != nullptr) {
+                EV::MyWatcherManager::GetInstance()->destroy(readWatcher);
+                readWatcher = nullptr;
+            }
+
+            if (timeoutWatcher != nullptr) {
+                EV::MyWatcherManager::GetInstance()->destroy(timeoutWatcher);
+                timeoutWatcher = nullptr;
+            }
 
+            if (socket != nullptr) {
+                delete(socket);
+                socket = nullptr;
+            }
+        }
+
+        MyUdpChannel::MyUdpChannel(MF::Socket::MySocket *socket, const MyUdpPeerKey& peer)
+        : MyChannel(socket), peer(peer) {
             //重新生成uid
-            this->uid = createUid(ip, port);
+            this->uid = createUid();
+            this->keepBoundary = true; //每个响应是一个数据包
+            this->addrLen = peer.toSockaddr(addr);
+        }
+
+        void MyUdpChannel::setOnCloseFunc(MF::Server::MyUdpChannel::OnCloseFunc &&func) {
+            onCloseFunc = func;
+        }
+
+        int32_t MyUdpChannel::appendPacket(const char *buf, uint32_t length) {
+            char* tmp = reserveReadBuffer(length);
+            memcpy(tmp, buf, length);
+            readBuf->moveWriteable(length);
+            lastReceiveTime = MyTimeProvider::now(); //设置最后一次接收到消息的时间
+            return static_cast<int32_t >(length);
+        }
+
+        void MyUdpChannel::setSendBatch(std::shared_ptr<MyUdpSendBatch> sendBatch) {
+            MyUdpChannel::sendBatch = sendBatch;
         }
 
         int32_t MyUdpChannel::onRead() {
-            uint32_t len = g_max_udp_packet_length;
-            char* buf = this->readBuf->writeable(len);
+            uint32_t len = readLength;
+            char* buf = reserveReadBuffer(len);
 
             //读取数据
-            sockaddr_in addr;
-            socklen_t addrLen = sizeof(addr);
-            bzero(&addr, addrLen);
-            int32_t readLen = this->socket->readFrom(reinterpret_cast<sockaddr*>(&addr), &addrLen, buf, len);
+            sockaddr_storage from;
+            socklen_t fromLen = sizeof(from);
+            bzero(&from, fromLen);
+            int32_t readLen = this->socket->readFrom(reinterpret_cast<sockaddr*>(&from), &fromLen, buf, len);
             if (readLen <= 0) {
                 LOG(ERROR) << "read data fail, readLen: " << readLen << std::endl;
                 return -1;
@@ -195,76 +733,46 @@ namespace MF {
         }
 
         int32_t MyUdpChannel::onWrite() {
-            std::lock_guard<std::mutex> guard(writeBufMutex); //尝试加锁
-            int32_t rv = 0;
-            do {
-                //1. 获取可发送的长度
-                uint32_t len = this->writeBuf->getReadableLength();
-                uint32_t flagLen = sizeof(uint32_t);
-                //数据包长度不够，不做发送
-                if (len <= sizeof(uint32_t)) { //正常来说不会走进来
-                    break;
+            Buffer::MyIOBufChain responses;
+            std::deque<uint32_t> lengths;
+            takeResponses(responses, &lengths);
+            for (auto length : lengths) {
+                //1. 每个响应是一个数据包, 需要拷贝成一段
+                auto iobuf = Buffer::MyIOBuf::create(length > 0 ? length : 1);
+                responses.read(iobuf->tail(), length);
+                iobuf->moveWriteable(length);
+
+                //2. 放入loop的批量发送, loop发送完所有channel之后统一发出
+                if (sendBatch != nullptr) {
+                    sendBatch->add(addr, addrLen, std::move(iobuf));
+                    continue;
                 }
 
-                //2. 获取即将发送的数据包长度
-                char* buf = this->writeBuf->readable(&flagLen);
-                uint32_t flag = 0;
-                memcpy(&flag, buf, flagLen);
-                if (flag > len - flagLen) { //编码出错了
-                    rv = -1;
-                    break;
+                //3. 单独发送
+                if (socket->writeTo(reinterpret_cast<sockaddr*>(&addr), addrLen,
+                        iobuf->readable(), iobuf->getReadableLength()) <= 0) {
+                    LOG(ERROR) << "send packet fail, uid: " << uid << ", error: " << strerror(errno) << std::endl;
                 }
-                this->writeBuf->moveReadable(flagLen); //移动指针
-
-                //3. 发送数据
-                uint32_t send = 0;
-                buf = this->writeBuf->readable(&flag);
-                while(send < flag) {
-                    //需要确认多线程调用writeTo是否ok？
-                    int32_t sent = socket->writeTo(
-                            this->ip, this->port, static_cast<void*>(buf + send), flag - send);
-                    if (sent <= 0) {
-                        break;
-                    }
-
-                    send += sent; //保存已发送的数据长度
-                }
-
-                //2. 移动指针
-                writeBuf->moveReadable(flag);
-            } while(true);
-            return rv; //返回发送结果
+            }
+            return 0; //返回发送结果
         }
 
-        uint64_t MyUdpChannel::createUid(const std::string &ip, uint16_t port) {
-            return static_cast<uint64_t > (std::hash<std::string>()(ip + ":" + MyCommon::tostr(port)));
-        }
-
-        uint32_t MyUdpChannel::sendResponse(const char *buf, uint32_t length) {
-            std::lock_guard<std::mutex> guard(writeBufMutex); //尝试加锁
-            //1. 开头的四个字节用于记录数据包长度
-            uint32_t flagLen = sizeof(length);
-            char* tmp = this->writeBuf->getWriteableAndMove(length + flagLen);
-            if (tmp != nullptr) {
-                memcpy(tmp, &length, flagLen);
-                memcpy(tmp + flagLen, buf, length); //拷贝数据
-
-                //发送可写请求
-                this->writeWatcher->signal();
-            }
-            return length;
+        uint64_t MyUdpChannel::createUid() {
+            //只在新的对端出现时调用, 不在每个数据包的路径上
+            static std::atomic<uint64_t> nextUid {0};
+            return (++nextUid) & ~MyChannelTable::kSlotFlag;
         }
 
         void MyUdpChannel::close() {
-            if (writeWatcher != nullptr) {
-                EV::MyWatcherManager::GetInstance()->destroy(writeWatcher);
-                writeWatcher = nullptr;
-            }
-
             if (timeoutWatcher != nullptr) {
                 EV::MyWatcherManager::GetInstance()->destroy(timeoutWatcher);
                 timeoutWatcher = nullptr;
             }
+
+            //通知servant删除对端
+            if (!closed.exchange(true) && onCloseFunc) {
+                onCloseFunc(peer);
+            }
         }
     }
 }
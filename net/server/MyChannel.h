@@ -5,13 +5,24 @@
 #ifndef MYFRAMEWORK2_MYCHANNEL_H
 #define MYFRAMEWORK2_MYCHANNEL_H
 
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
 #include "net/ev/MyLoop.h"
 #include "net/MyGlobal.h"
 #include "net/socket/MySocket.h"
 #include "net/buffer/MySKBuffer.h"
+#include "net/buffer/MySKBufferPool.h"
 #include "net/ev/MyWatcher.h"
+#include "net/ev/MyUring.h"
 #include "net/buffer/myIOBuf.h"
+#include "net/buffer/MyIOBufChain.h"
+#include "net/buffer/MyShmRing.h"
 #include "util/MyTimeProvider.h"
+#include "util/MyMpscQueue.h"
+#include "net/server/MyUdpBatch.h"
+#include "net/server/MyUdpPeerTable.h"
 
 namespace MF {
     namespace Server {
@@ -20,6 +31,7 @@ namespace MF {
         class MyChannel : public std::enable_shared_from_this<MyChannel>{
         public:
             typedef std::function<bool (std::shared_ptr<MyChannel>)> OnTimeoutFunc;
+            typedef std::function<void (std::shared_ptr<MyChannel>, bool)> OnWatermarkFunc;
             /**
              * 构造函数
              * @param socket socket
@@ -46,7 +58,7 @@ namespace MF {
              * @return 可读数据长度
              */
             uint32_t getReadableLength() const {
-                return readBuf->getReadableLength();
+                return readBuf == nullptr ? 0 : readBuf->getReadableLength();
             }
 
             /**
@@ -55,28 +67,49 @@ namespace MF {
              * @return 指针
              */
             char* getReadableBuffer(uint32_t* len) const {
-                return readBuf->readable(len);
+                return readBuf == nullptr ? nullptr : readBuf->readable(len);
             }
 
+            /**
+             * 设置read buffer池, 需要是读取数据的线程所在loop的池
+             * @param bufferPool buffer池
+             */
+            void setBufferPool(Buffer::MySKBufferPool* bufferPool) {
+                this->bufferPool = bufferPool;
+            }
+
+            /**
+             * 数据处理完之后归还read buffer, 空闲连接不占用buffer, 只能在读取数据的线程调用
+             */
+            void releaseReadBuffer();
+
             /**
              * 有数据可以发送了
              */
             virtual int32_t onWrite() = 0;
 
             /**
-             * 将可以读的数据读出来
+             * 将可以读的数据读出来, 返回的是read buffer上的切片，不拷贝数据
              * @param length
              * @return
              */
             std::unique_ptr<Buffer::MyIOBuf> fetchPacket(uint32_t length);
 
             /**
-             * 发送响应
+             * 发送响应, 数据会被拷贝一次
              * @param buf  buffer
              * @param length  length
              * @return 发送的数据字节数
              */
-            virtual uint32_t sendResponse(const char* buf, uint32_t length) = 0;
+            virtual uint32_t sendResponse(const char* buf, uint32_t length);
+
+            /**
+             * 发送多段数据组成的响应, 可以在任意线程调用
+             * 响应放入无锁队列，由所在的io线程取出发送
+             * @param chain chain
+             * @return 发送的数据字节数
+             */
+            virtual uint32_t sendResponse(std::unique_ptr<Buffer::MyIOBufChain> chain);
 
             /**
              * 设置read watcher
@@ -85,10 +118,10 @@ namespace MF {
             void setReadWatcher(EV::MyIOWatcher *readWatcher);
 
             /**
-             * 设置write watcher
-             * @param writeWatcher
+             * 设置socket可写watcher, 发送缓冲区满时用于等待可写
+             * @param drainWatcher
              */
-            void setWriteWatcher(EV::MyAsyncWatcher *writeWatcher);
+            void setDrainWatcher(EV::MyIOWatcher *drainWatcher);
 
             /**
              * 设置超时watcher
@@ -113,6 +146,42 @@ namespace MF {
              */
             void setOnTimeoutFunc(OnTimeoutFunc&& func);
 
+            /**
+             * 标记有待发送的响应
+             * @return true 之前没有标记，需要放入loop的待发送列表
+             */
+            bool markWritePending() {
+                return !writePending.exchange(true);
+            }
+
+            /**
+             * 清除待发送标记, 在io线程发送之前调用
+             */
+            void clearWritePending() {
+                writePending = false;
+            }
+
+            /**
+             * 设置待发送数据的高低水位
+             * @param high 高水位, 0表示不限制
+             * @param low 低水位
+             */
+            void setWatermark(uint32_t high, uint32_t low);
+
+            /**
+             * 设置越过水位时的通知函数
+             * @param func
+             */
+            void setOnWatermarkFunc(OnWatermarkFunc&& func);
+
+            /**
+             * 待发送数据是否超过了高水位
+             * @return true 已超过, 暂停读取
+             */
+            bool isWriteBlocked() const {
+                return writeBlocked;
+            }
+
             /**
              * 获取uid
              * @return uid
@@ -121,31 +190,99 @@ namespace MF {
                 return uid;
             }
 
+            void setUid(uint64_t uid) {
+                MyChannel::uid = uid;
+            }
+
             EventLoop *getLoop() const;
 
             void setLoop(EventLoop *loop);
 
             uint32_t getLastReceiveTime() const;
 
+            uint32_t getIdleTimeout() const {
+                return idleTimeout;
+            }
+
+            /**
+             * 设置空闲超时时间, 超过该时间没有收到数据时检查超时
+             * @param idleTimeout 超时时间(s), 0表示不检查
+             */
+            void setIdleTimeout(uint32_t idleTimeout) {
+                MyChannel::idleTimeout = idleTimeout;
+            }
+
+        protected:
+            /**
+             * 获取read buffer的可写指针
+             * 如果read buffer仍然被切片引用，并且尾部空间不够，那么就切换到新的buffer
+             * @param length 需要写入的长度
+             * @return 可写指针
+             */
+            char* reserveReadBuffer(uint32_t length);
+
+            /**
+             * 获取新的read buffer, 有buffer池时从池中获取
+             * @return buffer
+             */
+            std::shared_ptr<Buffer::MySKBuffer> newReadBuffer();
+
+            /**
+             * 归还read buffer
+             * @param buf buffer
+             */
+            void dropReadBuffer(std::shared_ptr<Buffer::MySKBuffer>&& buf);
+
+            /**
+             * 根据待发送数据的长度检查水位, 只能在io线程调用
+             * 越过高水位时暂停读取，回落到低水位之后恢复读取
+             * @param pending 待发送数据的长度
+             */
+            void checkWatermark(uint32_t pending);
+
+            /**
+             * 暂停或者恢复读取, 默认停止或者重新开启read watcher
+             * @param enabled true 恢复读取 false 暂停读取
+             */
+            virtual void setReadEnabled(bool enabled);
+
+            /**
+             * 取出handler线程放入的所有响应, 只能在io线程调用
+             * @param queue 响应追加到该队列, 不拷贝
+             * @param lengths 每个响应的长度, 只有保留消息边界时才有
+             */
+            void takeResponses(Buffer::MyIOBufChain& queue, std::deque<uint32_t>* lengths = nullptr);
+
         protected:
             uint64_t uid{0}; //连接的标识id
 
             Socket::MySocket* socket{nullptr}; //socket
             EV::MyIOWatcher* readWatcher{nullptr}; //connectWatcher;
-            EV::MyAsyncWatcher* writeWatcher{nullptr}; //writeWatcher;
             EV::MyTimerWatcher* timeoutWatcher{nullptr}; //timeout watcher
+            EV::MyIOWatcher* drainWatcher{nullptr}; //socket可写watcher, 有未发送完的数据时才监听
             EventLoop* loop; //事件循环
 
-            //write buffer
-            Buffer::MySKBuffer* writeBuf {nullptr};
-            std::mutex writeBufMutex;
+            //待发送的响应, handler线程加锁放入，io线程加锁一次全部取出
+            std::mutex responseMutex;
+            Buffer::MyIOBufChain responseQueue;
+            std::vector<uint32_t> responseLengths; //每个响应的长度, 只有保留消息边界时才记录
+            bool keepBoundary {false}; //是否需要保留消息边界, 每个响应单独发送
+            std::atomic<bool> writePending{false}; //是否已经在loop的待发送列表中
 
-            //read buffer
-            Buffer::MySKBuffer* readBuf {nullptr};
+            //read buffer, 有数据时才从池中获取, fetchPacket返回的切片会持有引用
+            std::shared_ptr<Buffer::MySKBuffer> readBuf {nullptr};
+            Buffer::MySKBufferPool* bufferPool {nullptr}; //read buffer池
+            std::shared_ptr<Buffer::MySKBuffer> spareReadBuf {nullptr}; //备用的read buffer, 切片全部释放之后可以复用
 
             uint32_t lastReceiveTime{0}; //最近一次接收到消息的时间
+            uint32_t idleTimeout{0}; //空闲超时时间
 
             OnTimeoutFunc onTimeoutFunc; //channel超时检查函数
+
+            uint32_t writeHighWatermark{0}; //待发送数据的高水位
+            uint32_t writeLowWatermark{0}; //待发送数据的低水位
+            std::atomic<bool> writeBlocked{false}; //是否已经越过高水位
+            OnWatermarkFunc onWatermarkFunc; //越过水位的通知函数
         };
 
         /**
@@ -153,18 +290,171 @@ namespace MF {
          */
         class MyTcpChannel : public MyChannel {
         public:
+            typedef std::function<void (std::shared_ptr<MyChannel>, int32_t)> OnRecvFunc;
+
             MyTcpChannel(Socket::MySocket *socket);
 
             int32_t onRead() override;
 
             int32_t onWrite() override;
 
-            uint32_t sendResponse(const char *buf, uint32_t length) override;
-
             /**
              * 关闭channel，需要关闭socket和所有watcher
              */
             void close() override;
+
+            /**
+             * 设置每次可读事件最多读取的字节数
+             * 超过之后剩下的数据留在内核中, 水平触发会在下一轮再次通知, 同一个loop上的其他连接先得到处理
+             * @param readBudget 字节数, 0表示读到EAGAIN
+             */
+            void setReadBudget(uint32_t readBudget) {
+                this->readBudget = readBudget;
+            }
+
+            /**
+             * 设置按消息读取, 用于SOCK_SEQPACKET
+             * 每次read只返回一个消息, 读取长度为g_max_packet_length, 消息被截断时关闭连接
+             * 每个响应单独作为一个消息发送
+             * @param flag true 按消息读取
+             */
+            void setPacketMode(bool flag) {
+                this->packetMode = flag;
+                this->keepBoundary = flag;
+            }
+
+            /**
+             * 使用loop的io_uring收发数据, 不再使用read/drain watcher, 加入loop之前设置
+             * @param uring loop的io_uring
+             * @param func 收到数据或者recv结束时的回调, 参数为recv的结果, 数据已经追加到read buffer
+             */
+            void setUring(EV::MyUring* uring, OnRecvFunc&& func) {
+                this->uring = uring;
+                this->onRecvFunc = func;
+            }
+
+            /**
+             * 提交多次recv, 已经有未结束的recv时不重复提交, 只能在io线程调用
+             */
+            void startRecv();
+
+        protected:
+            /**
+             * 暂停读取时取消io_uring的recv, 恢复时重新提交
+             * @param enabled true 恢复读取 false 暂停读取
+             */
+            void setReadEnabled(bool enabled) override;
+
+            /**
+             * io_uring的recv完成, 从provided buffer拷贝到read buffer之后马上归还
+             * @param res recv的结果
+             * @param flags cqe的flags
+             */
+            void onRecvComplete(int32_t res, uint32_t flags);
+
+            /**
+             * 使用io_uring发送发送队列头部的数据, 上一批没有完成时不提交
+             * @return 0 成功 -1 失败
+             */
+            int32_t submitSends();
+
+            /**
+             * io_uring的一个send完成, 一批都完成之后继续发送剩下的数据
+             * @param res send的结果
+             */
+            void onSendComplete(int32_t res);
+
+        protected:
+            //正在发送的响应, 每个响应的iobuf直接挂在队列上, 发送时使用writev, 只在io线程访问
+            Buffer::MyIOBufChain writeQueue;
+            uint32_t readHint {g_default_read_size}; //下一次read的长度, 根据最近读取的数据量调整
+            uint32_t readBudget {g_default_read_budget}; //每次可读事件最多读取的字节数, 0表示不限制
+            bool packetMode {false}; //是否按消息读取
+            std::deque<uint32_t> writeLengths; //按消息发送时发送队列中每个响应的长度
+
+            EV::MyUring* uring {nullptr}; //loop的io_uring, nullptr表示使用watcher
+            OnRecvFunc onRecvFunc; //io_uring收到数据的回调
+            uint64_t recvId {0}; //未结束的多次recv, 0表示没有
+            uint32_t sendInflight {0}; //已经提交还没有完成的send个数, 期间发送队列头部的数据不能释放
+            bool sendError {false}; //这一批send中有失败的
+        };
+
+        /**
+         * 共享内存channel, 用于同一台机器上的client
+         * unix socket只用于传递共享内存的fd和检测对端关闭, 数据通过两个共享内存ring收发
+         * read watcher监听unix socket, doorbell watcher监听自己的doorbell
+         */
+        class MyShmChannel : public MyChannel {
+        public:
+            MyShmChannel(Socket::MySocket *socket);
+
+            /**
+             * 握手之前从unix socket接收共享内存的fd, 握手之后socket可读表示对端关闭
+             * @return >0 成功 0 对端关闭 -1 失败, errno为EAGAIN时表示还没有收到
+             */
+            int32_t onControl();
+
+            /**
+             * 从ring中读取数据, 忙轮询时由loop的轮询函数触发
+             * @return 读取的字节数, 0 对端关闭 -1 没有数据, errno为EAGAIN
+             */
+            int32_t onRead() override;
+
+            /**
+             * 把响应写入ring, ring满时剩下的数据保留, 对端读取之后通过doorbell通知继续写入
+             * @return 0 成功
+             */
+            int32_t onWrite() override;
+
+            /**
+             * 关闭channel，需要通知对端, 关闭socket和所有watcher
+             */
+            void close() override;
+
+            /**
+             * 是否已经完成握手
+             * @return true 已完成
+             */
+            bool isAttached() const {
+                return rings.isReady();
+            }
+
+            /**
+             * 获取自己的doorbell
+             * @return fd
+             */
+            int32_t getDoorbell() const {
+                return rings.getDoorbell();
+            }
+
+            /**
+             * 设置doorbell watcher并开始监听, loop开启忙轮询时同时注册轮询函数, 只能在io线程调用
+             * @param doorbellWatcher
+             */
+            void setDoorbellWatcher(EV::MyIOWatcher* doorbellWatcher);
+
+            /**
+             * 设置每次可读事件最多从ring中读取的字节数
+             * 超过之后通过doorbell触发下一轮, 同一个loop上的其他连接先得到处理
+             * @param readBudget 字节数, 0表示读到ring为空
+             */
+            void setReadBudget(uint32_t readBudget) {
+                this->readBudget = readBudget;
+            }
+
+        protected:
+            /**
+             * 忙轮询时检查ring中是否有数据, 有数据时触发doorbell watcher
+             */
+            void pollRing();
+
+        protected:
+            Buffer::MyShmRingPair rings; //共享内存ring
+            EV::MyIOWatcher* doorbellWatcher {nullptr}; //doorbell watcher
+            uint64_t pollerId {0}; //loop中轮询函数的id, 0表示没有注册
+            uint32_t readBudget {g_default_read_budget}; //每次可读事件最多读取的字节数, 0表示不限制
+            //ring满时没有写入的响应, 只在io线程访问
+            Buffer::MyIOBufChain writeQueue;
         };
 
         /**
@@ -172,24 +462,74 @@ namespace MF {
          */
         class MyUdpChannel : public MyChannel {
         public:
-            MyUdpChannel(Socket::MySocket* socket, const std::string& ip, uint16_t port);
+            typedef std::function<void (const MyUdpPeerKey&)> OnCloseFunc;
+
+            MyUdpChannel(Socket::MySocket* socket, const MyUdpPeerKey& peer);
 
             int32_t onRead() override;
 
             int32_t onWrite() override;
 
-            static uint64_t createUid(const std::string& ip, uint16_t port);
+            /**
+             * 生成新的uid, 全局递增, 最高位留给channel表分配的uid
+             * @return uid
+             */
+            static uint64_t createUid();
+
+            const MyUdpPeerKey& getPeer() const {
+                return peer;
+            }
+
+            /**
+             * 是否已经关闭
+             * @return true 已关闭
+             */
+            bool isClosed() const {
+                return closed;
+            }
 
-            uint32_t sendResponse(const char *buf, uint32_t length) override;
+            /**
+             * 设置关闭时的通知函数, 用于从servant的对端表中删除
+             * @param func
+             */
+            void setOnCloseFunc(OnCloseFunc&& func);
 
             /**
              * 关闭channel, 不需要关闭socket和readwatcher
              */
             void close() override;
 
+            /**
+             * 放入servant批量收到的一个数据包
+             * @param buf 数据包
+             * @param length 数据包长度
+             * @return 放入的长度
+             */
+            int32_t appendPacket(const char* buf, uint32_t length);
+
+            /**
+             * 设置批量发送, 为空时每个响应单独发送
+             * @param sendBatch 所在loop的批量发送
+             */
+            void setSendBatch(std::shared_ptr<MyUdpSendBatch> sendBatch);
+
+            /**
+             * 设置一次读取的最大长度, 开启GRO之后内核会合并多个数据包
+             * @param readLength 长度
+             */
+            void setReadLength(uint32_t readLength) {
+                this->readLength = readLength;
+            }
+
         private:
-            std::string ip;
-            uint16_t port;
+            MyUdpPeerKey peer; //对端地址
+            sockaddr_storage addr; //发送使用的对端地址
+            socklen_t addrLen {0};
+            std::atomic<bool> closed {false}; //是否已经关闭
+            OnCloseFunc onCloseFunc; //关闭时的通知函数
+
+            std::shared_ptr<MyUdpSendBatch> sendBatch {nullptr}; //所在loop的批量发送
+            uint32_t readLength {g_max_udp_packet_length}; //一次读取的最大长度
         };
     }
 }
@@ -0,0 +1,173 @@
+//
+// Created by mingweiliu on 2019/1/15.
+//
+
+#ifndef MYFRAMEWORK2_MYCHANNELTABLE_H
+#define MYFRAMEWORK2_MYCHANNELTABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace MF {
+    namespace Server {
+        class MyChannel; //预定义
+
+        /**
+         * 以fd为下标的channel表, 每个loop一个, 只在io线程访问
+         * uid的格式: | 1位标记 | 23位generation | 8位loop下标 | 32位fd |
+         * 每次分配slot时generation加1, fd被复用之后旧的uid不会再查到新的channel
+         */
+        class MyChannelTable {
+        public:
+            static const uint64_t kSlotFlag = 1ULL << 63; //slab分配的uid的标记位
+            static const uint32_t kGenerationBits = 23;
+            static const uint32_t kLoopBits = 8;
+            static const uint32_t kSlotBits = 32;
+            static const uint32_t kMaxLoops = 1U << kLoopBits; //uid中能区分的loop个数
+
+            /**
+             * 是否是channel表分配的uid
+             * @param uid uid
+             * @return true 是
+             */
+            static bool isSlotUid(uint64_t uid) {
+                return (uid & kSlotFlag) != 0;
+            }
+
+            /**
+             * 获取uid中的slot下标
+             * @param uid uid
+             * @return slot下标, 即fd
+             */
+            static uint32_t slotOf(uint64_t uid) {
+                return static_cast<uint32_t >(uid & ((1ULL << kSlotBits) - 1));
+            }
+
+            /**
+             * 获取uid中的loop下标
+             * @param uid uid
+             * @return loop下标
+             */
+            static uint32_t loopOf(uint64_t uid) {
+                return static_cast<uint32_t >((uid >> kSlotBits) & ((1ULL << kLoopBits) - 1));
+            }
+
+            /**
+             * 获取uid中的generation
+             * @param uid uid
+             * @return generation
+             */
+            static uint32_t generationOf(uint64_t uid) {
+                return static_cast<uint32_t >((uid >> (kSlotBits + kLoopBits)) & ((1ULL << kGenerationBits) - 1));
+            }
+
+            /**
+             * 构造函数
+             * @param loopIndex 所属loop的下标
+             */
+            explicit MyChannelTable(uint32_t loopIndex = 0) : loopIndex(loopIndex) {}
+
+            void setLoopIndex(uint32_t loopIndex) {
+                MyChannelTable::loopIndex = loopIndex;
+            }
+
+            /**
+             * 为新的连接分配uid, generation加1
+             * @param fd 连接的fd
+             * @return uid
+             */
+            uint64_t allocate(uint32_t fd) {
+                if (fd >= slots.size()) {
+                    slots.resize(fd + 1 > slots.size() * 2 ? fd + 1 : slots.size() * 2);
+                }
+
+                auto& slot = slots[fd];
+                slot.generation = (slot.generation + 1) & ((1U << kGenerationBits) - 1);
+                return kSlotFlag
+                       | (static_cast<uint64_t >(slot.generation) << (kSlotBits + kLoopBits))
+                       | (static_cast<uint64_t >(loopIndex & ((1U << kLoopBits) - 1)) << kSlotBits)
+                       | fd;
+            }
+
+            /**
+             * 保存channel, uid必须是allocate分配的
+             * @param uid uid
+             * @param channel channel
+             * @return true 成功 false uid已经失效
+             */
+            bool insert(uint64_t uid, std::shared_ptr<MyChannel> channel) {
+                auto slot = find(uid, false);
+                if (slot == nullptr) {
+                    return false;
+                }
+
+                slot->channel = std::move(channel);
+                return true;
+            }
+
+            /**
+             * 查找channel
+             * @param uid uid
+             * @return channel, 不存在或者generation不一致时返回nullptr
+             */
+            std::shared_ptr<MyChannel> find(uint64_t uid) const {
+                auto slot = find(uid, true);
+                return slot == nullptr ? nullptr : slot->channel;
+            }
+
+            /**
+             * 删除channel
+             * @param uid uid
+             * @return true 成功 false 不存在
+             */
+            bool erase(uint64_t uid) {
+                auto slot = find(uid, true);
+                if (slot == nullptr) {
+                    return false;
+                }
+
+                slot->channel = nullptr;
+                return true;
+            }
+
+            /**
+             * 删除所有channel
+             */
+            void clear() {
+                slots.clear();
+            }
+
+        private:
+            struct Slot {
+                std::shared_ptr<MyChannel> channel {nullptr};
+                uint32_t generation {0};
+            };
+
+            /**
+             * 根据uid查找slot
+             * @param uid uid
+             * @param occupied 是否要求slot中有channel
+             * @return slot, 失效时返回nullptr
+             */
+            Slot* find(uint64_t uid, bool occupied) const {
+                auto fd = slotOf(uid);
+                if (!isSlotUid(uid) || fd >= slots.size()) {
+                    return nullptr;
+                }
+
+                auto slot = const_cast<Slot*>(&slots[fd]);
+                if (slot->generation != generationOf(uid) || (occupied && slot->channel == nullptr)) {
+                    return nullptr;
+                }
+                return slot;
+            }
+
+        private:
+            std::vector<Slot> slots; //以fd为下标的slot
+            uint32_t loopIndex {0}; //所属loop的下标
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYCHANNELTABLE_H
@@ -25,9 +25,22 @@ namespace MF {
         }
 
         void MyContext::sendPayload(std::unique_ptr<MF::Buffer::MyIOBuf> iobuf) {
-            char* buf = static_cast<char*>(iobuf->readable());
-            uint32_t length = iobuf->getReadableLength();
-            return sendPayload(buf, length);
+            auto chain = Buffer::MyIOBufChain::create();
+            chain->append(std::move(iobuf));
+            return sendPayload(std::move(chain));
+        }
+
+        void MyContext::sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain) {
+            auto c = channel.lock();
+            uint32_t length = chain->getReadableLength();
+            if (c == nullptr || c->sendResponse(std::move(chain)) != length) {
+                LOG(ERROR) << "send response fail, len: " << length << std::endl;
+            }
+        }
+
+        bool MyContext::isWriteBlocked() const {
+            auto c = channel.lock();
+            return c != nullptr && c->isWriteBlocked();
         }
 
         void MyContext::close() {
@@ -37,6 +37,12 @@ namespace MF {
              */
             void sendPayload(std::unique_ptr<Buffer::MyIOBuf> iobuf);
 
+            /**
+             * 发送多段数据组成的响应
+             * @param chain chain
+             */
+            void sendPayload(std::unique_ptr<Buffer::MyIOBufChain> chain);
+
             /**
              * 关闭连接
              */
@@ -50,6 +56,12 @@ namespace MF {
                 return channel.lock();
             }
 
+            /**
+             * 连接上待发送的数据是否超过了高水位
+             * @return true 超过高水位，应该暂缓发送
+             */
+            bool isWriteBlocked() const;
+
             bool isNeedResponse() const;
 
             void setNeedResponse(bool needResponse);
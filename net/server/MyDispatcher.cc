@@ -16,7 +16,7 @@ namespace MF {
             LOG(INFO) << "MyDispatcher::handlePackets" << std::endl;
 
             //1. 分发消息
-            std::unique_ptr<Buffer::MyIOBuf> rsp;
+            std::unique_ptr<Buffer::MyIOBufChain> rsp;
             int32_t rv;
             if((rv = dispatchPacket(req, rsp, context)) != kHandleResultSuccess) {
                 LOG(ERROR) << "dispatchPayload packet fail, close connection" << std::endl;
@@ -25,12 +25,23 @@ namespace MF {
             }
 
             //2. 发送响应
-            if (context->isNeedResponse() && rsp->getReadableLength() > 0) {
+            if (context->isNeedResponse() && rsp != nullptr && rsp->getReadableLength() > 0) {
                 context->sendPayload(std::move(rsp));
             }
             return rv;
         }
 
+        int32_t MyDispatcher::handlePackets(std::vector<MyPacket>& packets) {
+            int32_t rv = kHandleResultSuccess;
+            for (auto& packet : packets) {
+                auto result = handlePacket(packet.iobuf, packet.context);
+                if (result != kHandleResultSuccess) {
+                    rv = result;
+                }
+            }
+            return rv;
+        }
+
         int32_t MyDispatcher::isPacketComplete(const char *buf, uint32_t length) {
             return codec->isPacketComplete(buf, length);
         }
@@ -46,5 +57,54 @@ namespace MF {
         void MyDispatcher::setPostFilter(std::unique_ptr<MyFilter> filter) {
             this->postFilter = std::move(filter);
         }
+
+        void MyDispatcher::setInline(const std::string &cmd, bool enable) {
+            inlinePolicies[cmd].enable = enable;
+        }
+
+        void MyDispatcher::setInlineAll(bool enable) {
+            inlineAll = enable;
+        }
+
+        void MyDispatcher::setInlineBudget(uint32_t micros) {
+            inlineBudgetMicros = micros;
+        }
+
+        bool MyDispatcher::shouldRunInline(const std::string &cmd) {
+            auto it = inlinePolicies.find(cmd);
+            if (it == inlinePolicies.end()) {
+                return inlineAll && !inlineAllDemoted.load(std::memory_order_relaxed);
+            }
+            return it->second.enable && !it->second.demoted.load(std::memory_order_relaxed);
+        }
+
+        void MyDispatcher::onInlineFinished(const std::string &cmd, uint64_t micros) {
+            if (inlineBudgetMicros == 0) {
+                return;
+            }
+
+            auto it = inlinePolicies.find(cmd);
+            auto& overruns = it == inlinePolicies.end() ? inlineAllOverruns : it->second.overruns;
+            auto& demoted = it == inlinePolicies.end() ? inlineAllDemoted : it->second.demoted;
+
+            //1. 没有超时, 重新计数, 已经是0时不写, 避免多个io线程争用
+            if (micros <= inlineBudgetMicros) {
+                if (overruns.load(std::memory_order_relaxed) != 0) {
+                    overruns.store(0, std::memory_order_relaxed);
+                }
+                return;
+            }
+
+            //2. 连续超过耗时上限, 之后改回线程池执行, 避免阻塞io线程
+            //   只超时一次可能是io线程被调度出去了, 不改
+            if (overruns.fetch_add(1, std::memory_order_relaxed) + 1 < g_inline_overrun_limit) {
+                return;
+            }
+            if (!demoted.exchange(true)) {
+                LOG(WARNING) << "inline handler exceeds budget, move to handler pool, cmd: " << cmd
+                             << ", cost: " << micros << "us, budget: " << inlineBudgetMicros << "us"
+                             << ", overruns: " << g_inline_overrun_limit << std::endl;
+            }
+        }
     }
 }
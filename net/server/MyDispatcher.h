@@ -6,6 +6,8 @@
 #define MYFRAMEWORK2_MYDISPATCHER_H
 
 #include <map>
+#include <vector>
+#include <atomic>
 #include "net/MyGlobal.h"
 #include "net/protocol/MyCodec.h"
 #include "net/server/MyContext.h"
@@ -15,6 +17,14 @@
 namespace MF {
     namespace Server {
 
+        /**
+         * 一次读取中解析出来的完整数据包, 批量分发时使用
+         */
+        struct MyPacket {
+            std::unique_ptr<Buffer::MyIOBuf> iobuf; //数据包
+            std::shared_ptr<MyContext> context; //数据包的context
+        };
+
         class MyDispatcher {
         public:
             /**
@@ -30,6 +40,14 @@ namespace MF {
             virtual int32_t handlePacket(
                     const std::unique_ptr<Buffer::MyIOBuf>& iobuf, std::shared_ptr<MyContext> context);
 
+            /**
+             * 批量处理同一个连接一次读取到的多个数据包, 在一个handler任务中执行
+             * 默认逐个调用handlePacket, 需要批量处理时(例如合并写库)可以重写
+             * @param packets 数据包, 按照收到的顺序排列
+             * @return 0 全部成功 其他 最后一个失败的结果
+             */
+            virtual int32_t handlePackets(std::vector<MyPacket>& packets);
+
             /**
              * 处理链接超时
              * @param context 上下文
@@ -42,6 +60,30 @@ namespace MF {
              */
             virtual int32_t handleClose(std::shared_ptr<MyContext> context) {return kHandleResultSuccess;}
 
+            /**
+             * 连接上待发送的数据超过了高水位, 已经暂停读取
+             * 可以通过context->isWriteBlocked()检查当前状态
+             * @param context context
+             */
+            virtual int32_t handleWriteBlocked(std::shared_ptr<MyContext> context) {return kHandleResultSuccess;}
+
+            /**
+             * 待发送的数据回落到低水位, 已经恢复读取
+             * @param context context
+             */
+            virtual int32_t handleWriteResumed(std::shared_ptr<MyContext> context) {return kHandleResultSuccess;}
+
+            /**
+             * servant过载, 数据包没有进入handler线程池, 在io线程调用, 不能阻塞
+             * 默认直接丢弃, 协议支持时可以回复一个过载响应让对端尽快失败
+             * @param iobuf 数据包
+             * @param context context
+             */
+            virtual int32_t handleOverload(
+                    const std::unique_ptr<Buffer::MyIOBuf>& /*iobuf*/, std::shared_ptr<MyContext> /*context*/) {
+                return kHandleResultSuccess;
+            }
+
             /**
              * 数据包是否完整
              * @param buf buffer
@@ -70,15 +112,68 @@ namespace MF {
              */
             void setPostFilter(std::unique_ptr<MyFilter> filter);
 
+            /**
+             * 设置命令是否在io线程直接执行, 需要在servant启动之前调用
+             * 命令由getCommand返回
+             * @param cmd 命令
+             * @param enable true 在io线程执行 false 在handler线程池执行
+             */
+            void setInline(const std::string& cmd, bool enable);
+
+            /**
+             * 设置没有单独配置的命令是否在io线程直接执行
+             * @param enable true 在io线程执行
+             */
+            void setInlineAll(bool enable);
+
+            /**
+             * 设置io线程执行handler的耗时上限, 超过之后该命令改回线程池执行
+             * @param micros 耗时上限(微秒), 0表示不限制
+             */
+            void setInlineBudget(uint32_t micros);
+
+            /**
+             * 是否有命令需要在io线程执行
+             * @return true 有
+             */
+            bool isInlineEnabled() const {
+                return inlineAll || !inlinePolicies.empty();
+            }
+
+            /**
+             * 获取数据包的命令, 用于按命令选择执行的线程
+             * 默认所有的数据包都是同一个命令
+             * @param packet 完整的数据包
+             * @return 命令
+             */
+            virtual std::string getCommand(const std::unique_ptr<Buffer::MyIOBuf>& /*packet*/) {
+                return std::string();
+            }
+
+            /**
+             * 命令是否需要在io线程执行, 可以在多个io线程同时调用
+             * @param cmd 命令
+             * @return true 在io线程执行
+             */
+            bool shouldRunInline(const std::string& cmd);
+
+            /**
+             * 记录命令在io线程执行的耗时, 连续g_inline_overrun_limit次超过上限时改回线程池执行
+             * @param cmd 命令
+             * @param micros 耗时(微秒)
+             */
+            void onInlineFinished(const std::string& cmd, uint64_t micros);
+
         protected:
             /**
              * 分发数据包
-             * @param message message
+             * @param request request
+             * @param response 编码后的响应, 由多个iobuf组成, 发送时不再拷贝
              * @return 0 成功 其他失败
              */
             virtual int32_t dispatchPacket(
                     const std::unique_ptr<Buffer::MyIOBuf>& request
-                    , std::unique_ptr<Buffer::MyIOBuf>& response
+                    , std::unique_ptr<Buffer::MyIOBufChain>& response
                     , std::shared_ptr<MyContext> context) = 0;
 
             Protocol::MyCodec* codec; //不同类型消息的编解码器
@@ -86,6 +181,18 @@ namespace MF {
             std::unique_ptr<MyFilter> preFilter{nullptr}; //前置过滤器
 
             std::unique_ptr<MyFilter> postFilter{nullptr}; //后置过滤器
+
+            //命令的执行方式
+            struct InlinePolicy {
+                bool enable {false}; //是否在io线程执行
+                std::atomic<bool> demoted {false}; //是否因为超时改回了线程池
+                std::atomic<uint32_t> overruns {0}; //连续超时的次数
+            };
+            std::map<std::string, InlinePolicy> inlinePolicies; //单独配置的命令, 启动之后只读
+            bool inlineAll {false}; //没有单独配置的命令是否在io线程执行
+            std::atomic<bool> inlineAllDemoted {false}; //没有单独配置的命令是否已经改回线程池
+            std::atomic<uint32_t> inlineAllOverruns {0}; //没有单独配置的命令连续超时的次数
+            uint32_t inlineBudgetMicros {g_default_inline_budget_us}; //io线程执行的耗时上限
         };
     }
 }
@@ -4,6 +4,8 @@
 
 #include "net/server/MyServant.h"
 #include "net/client/MyCommunicator.h"
+#include <sys/stat.h>
+#include <future>
 namespace MF {
     namespace Server{
 
@@ -15,11 +17,64 @@ namespace MF {
         int32_t MyServant::initialize(const MF::Server::ServantConfig &config) {
             this->config = config;
 
-            //1. 初始化handler线程池
-            this->handlerExecutor = new MyThreadExecutor<int32_t >(this->config.handlerThreadCount);
+            //1. 绑定loop时所有handler都在io线程执行, 不需要线程池
+            if (this->pinned) {
+                this->dispatcher->setInlineAll(true);
+                this->dispatcher->setInlineBudget(0); //没有线程池可以改回
+                return 0;
+            }
+
+            //2. 初始化handler线程池
+            this->handlerExecutor = new MyThreadExecutor<int32_t >(this->config.handlerThreadCount, this->config.handlerExecutorType);
+            if (this->config.admissionTargetMicros > 0) {
+                this->admission.reset(new MyAdmissionControl(
+                        this->config.admissionTargetMicros, this->config.admissionIntervalMicros));
+            }
+
+            //3. 在io线程执行的handler
+            if (this->config.inlineHandler) {
+                this->dispatcher->setInlineAll(true);
+            }
+            this->dispatcher->setInlineBudget(this->config.inlineBudgetMicros);
             return 0;
         }
 
+        void MyServant::pinToLoop(EventLoop *loop) {
+            this->loop = loop;
+            this->pinned = true;
+        }
+
+        int32_t MyServant::runHandler(std::function<int32_t()>&& func, bool wait) {
+            //1. 绑定了loop, 直接在io线程执行
+            if (pinned) {
+                return func();
+            }
+
+            //2. 放入handler线程池, 开始执行时记录排队时间
+            if (admission != nullptr) {
+                auto enqueueTime = MyAdmissionControl::Clock::now();
+                auto admission = this->admission.get();
+                func = [admission, enqueueTime, handler = std::move(func)] () -> int32_t {
+                    admission->onDequeue(enqueueTime);
+                    return handler();
+                };
+            }
+            auto future = handlerExecutor->exec(std::move(func));
+            return wait ? future.get() : 0;
+        }
+
+        std::shared_ptr<MyChannel> MyServant::findChannel(uint64_t uid) {
+            return pinned ? loop->findChannel(uid) : loopManager->findChannel(uid);
+        }
+
+        void MyServant::removeChannel(std::shared_ptr<MyChannel> channel) {
+            if (pinned) {
+                loop->removeChannel(channel);
+            } else {
+                loopManager->removeChannel(channel);
+            }
+        }
+
         void MyServant::stopServant() {
             //关闭socket
             if (socket != nullptr) {
@@ -43,11 +98,11 @@ namespace MF {
 
         void MyServant::onWrite(MF::EV::MyWatcher *watcher) {
             LOG(INFO) << "MyServant::onWrite" << std::endl;
-            //1. 获取uid
-            uint64_t uid = dynamic_cast<EV::MyAsyncWatcher*>(watcher)->getUid();
+            //1. 获取uid, socket重新可写了
+            uint64_t uid = dynamic_cast<EV::MyIOWatcher*>(watcher)->getUid();
 
             //2. 检查channel是否有效
-            auto channel = loopManager->findChannel(uid);
+            auto channel = findChannel(uid);
             if (channel == nullptr) {
                 LOG(ERROR) << "channel is null, uid: " << uid << std::endl;
                 return;
@@ -56,11 +111,20 @@ namespace MF {
             //3. 发送数据
             if(channel->onWrite() != 0) {
                 LOG(ERROR) << "send data fail, close socket, uid: " << channel->getUid() << std::endl;
-                loopManager->removeChannel(channel);
+                removeChannel(channel);
                 return ;
             }
         }
 
+        void MyServant::onWatermark(std::shared_ptr<MyChannel> channel, bool blocked) {
+            //通知上层, 不等待处理结果
+            auto context = std::make_shared<MyContext>(std::weak_ptr<MyChannel>(channel));
+            runHandler([this, context, blocked] () -> int32_t {
+                return blocked ? this->dispatcher->handleWriteBlocked(context)
+                               : this->dispatcher->handleWriteResumed(context);
+            }, false);
+        }
+
         //链接超时了，需要断开
         bool MyServant::onTimeout(std::shared_ptr<MyChannel> channel) {
             //1. 检查是否超时
@@ -71,14 +135,12 @@ namespace MF {
             LOG(INFO) << "MyServant::onTimeout" << std::endl;
             //2. 通知上层
             auto context = std::make_shared<MyContext>(std::weak_ptr<MyChannel>(channel));
-            auto future = handlerExecutor->exec([this, context] () -> int32_t {
+            //3. 等待上层处理完毕
+            auto rv = runHandler([this, context] () -> int32_t {
                 //上层处理
                 this->dispatcher->handleTimeout(context);
                 return 0;
-            });
-
-            //4. 等待上层处理完毕
-            auto rv = future.get();
+            }, true);
             if (rv == 0) {
                 //需要关闭socket
                 LOG(INFO) << "close connection, uid: " << channel->getUid() << std::endl;
@@ -90,6 +152,7 @@ namespace MF {
 
         void MyServant::handlePackets(shared_ptr<MF::Server::MyChannel> channel) {
             int32_t status = kPacketStatusIncomplete;
+            std::vector<MyPacket> batch; //一次读取中所有需要放入线程池的数据包
             do {
                 //获取可读数据的长度
                 uint32_t len = channel->getReadableLength();
@@ -110,21 +173,37 @@ namespace MF {
                 } else if (status == kPacketStatusError) {
                     //数据包出错了, 需std::move(要断开连接)
                     LOG(ERROR) << "packet error, uid: " << channel->getUid() << ", length: " << len << std::endl;
+                    dispatchBatch(batch); //之前的数据包先于close处理
                     onReadError(channel);
                 } else if (status == kPacketStatusComplete) {
-                    onReadComplete(channel, buf, len);
+                    onReadComplete(channel, buf, len, batch);
+                    if (batch.size() >= config.dispatchBatchSize) {
+                        dispatchBatch(batch);
+                    }
+
+                    //连接已经被关闭了, 例如在io线程执行的handler关闭了连接
+                    if (findChannel(channel->getUid()) != channel) {
+                        break;
+                    }
                 }
             } while(status == kPacketStatusComplete);
+
+            //所有完整的数据包一起分发
+            dispatchBatch(batch);
+
+            //数据处理完了, 归还read buffer
+            channel->releaseReadBuffer();
         }
 
-        void MyServant::onReadComplete(std::shared_ptr<MyChannel> channel, const char* buf, uint32_t len) {
+        void MyServant::onReadComplete(std::shared_ptr<MyChannel> channel, const char* buf, uint32_t len,
+                                       std::vector<MyPacket>& batch) {
             //数据包完整了，那么需要调用dispatcher来处理
             //获取完成数据包长度
             uint32_t packetLen = dispatcher->getPacketLength(buf, len);
             if (packetLen <= 0) {
                 LOG(ERROR) << "packet length is invalid, uid: " << channel->getUid() << std::endl;
                 //关闭channel
-                loopManager->removeChannel(channel);
+                removeChannel(channel);
                 return ;
             }
             //获取完整的数据包
@@ -135,25 +214,69 @@ namespace MF {
             }
             //获取context
             auto context = std::make_shared<MyContext>(std::weak_ptr<MyChannel>(channel));
-            Buffer::MyIOBuf* iobuf = packet.release();
 
-            //处理数据包
-            this->handlerExecutor->exec([this, iobuf, context]() -> int32_t {
-                //重新构造unique_ptr
-                std::unique_ptr<Buffer::MyIOBuf> req(iobuf);
-                return this->dispatcher->handlePacket(req, context);
-            });
+            //不阻塞的handler直接在io线程执行, 响应在loop阻塞之前发送
+            if (dispatcher->isInlineEnabled()) {
+                auto cmd = dispatcher->getCommand(packet);
+                if (dispatcher->shouldRunInline(cmd)) {
+                    //之前的数据包先分发, 保证同一个连接上的数据包按顺序处理
+                    dispatchBatch(batch);
+                    auto begin = std::chrono::steady_clock::now();
+                    dispatcher->handlePacket(packet, context);
+                    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - begin).count();
+                    dispatcher->onInlineFinished(cmd, static_cast<uint64_t >(cost));
+                    return;
+                }
+            }
+
+            //过载时不再放入线程池, 由dispatcher直接拒绝
+            if (admission != nullptr && admission->shouldReject(handlerExecutor->getJobNum())) {
+                admission->onReject();
+                dispatchBatch(batch); //拒绝的响应不能早于之前的数据包
+                dispatcher->handleOverload(packet, context);
+                return;
+            }
+
+            //等待批量分发
+            batch.push_back(MyPacket{std::move(packet), context});
+        }
+
+        void MyServant::dispatchBatch(std::vector<MyPacket> &batch) {
+            if (batch.empty()) {
+                return;
+            }
+
+            //1. 只有一个数据包, 单独分发
+            if (batch.size() == 1) {
+                Buffer::MyIOBuf* iobuf = batch[0].iobuf.release();
+                auto context = std::move(batch[0].context);
+                batch.clear();
+
+                runHandler([this, iobuf, context]() -> int32_t {
+                    //重新构造unique_ptr
+                    std::unique_ptr<Buffer::MyIOBuf> req(iobuf);
+                    return this->dispatcher->handlePacket(req, context);
+                }, false);
+                return;
+            }
+
+            //2. 多个数据包作为一个任务, 只入队、唤醒一次
+            auto packets = std::make_shared<std::vector<MyPacket>>(std::move(batch));
+            batch.clear();
+            runHandler([this, packets]() -> int32_t {
+                return this->dispatcher->handlePackets(*packets);
+            }, false);
         }
 
         void MyServant::onReadError(shared_ptr<MF::Server::MyChannel> channel) {
             //1. 回掉到上层
             auto context = std::make_shared<MyContext>(std::weak_ptr<MyChannel>(channel));
-            auto future = handlerExecutor->exec([this, context] () -> int32_t {
+            //等待处理结束
+            runHandler([this, context] () -> int32_t {
                 return this->dispatcher->handleClose(context);
-            });
-
-            future.get(); //等待处理结束
-            loopManager->removeChannel(channel);
+            }, true);
+            removeChannel(channel);
         }
 
         void MyServant::registerServant(const std::string& routeServantName) {
@@ -180,6 +303,8 @@ namespace MF {
 
             //设置已注册
             registered = true;
+            nodeId = rsp->nodeid();
+            reportedOverload = false;
 
             //注册成功
             LOG(INFO) << "register servant success, name: " << config.name
@@ -218,92 +343,324 @@ namespace MF {
                       << std::endl;
         }
 
-        int32_t MyTcpServant::startServant() {
+        void MyServant::syncStatus(const std::string& routeServantName) {
+            //1. 状态没有变化不需要同步
+            auto overloaded = isOverloaded();
+            if (!registered || overloaded == reportedOverload) {
+                return;
+            }
+
+            auto proxy = Client::MyCommunicator::GetInstance()
+                    ->getServantProxy<Route::MyRouteProxy>(routeServantName);
+            if (proxy == nullptr) {
+                LOG(ERROR) << "cant find proxy, routeName: " << routeServantName << std::endl;
+                return;
+            }
+
+            //2. 同步过载状态
+            auto req = std::unique_ptr<OperateReq>(new OperateReq());
+            req->set_nodeid(nodeId);
+            req->set_status(overloaded ? kNodeStatusOverload : kNodeStatusOnline);
+            auto rsp = proxy->setServantStatus(std::move(req));
+            if (rsp == nullptr) {
+                LOG(ERROR) << "sync servant status fail, name: " << config.name
+                           << ", overloaded: " << overloaded << std::endl;
+                return;
+            }
+            reportedOverload = overloaded;
+
+            LOG(INFO) << "sync servant status success, name: " << config.name
+                      << ", nodeId: " << nodeId
+                      << ", overloaded: " << overloaded
+                      << ", rejected: " << admission->getRejected()
+                      << std::endl;
+        }
+
+        MyTcpServant::MyTcpServant(EventLoopManager *loopManager, MyDispatcher *dispatcher)
+        : MyServant(loopManager, dispatcher) {
+        }
+
+        Socket::MySocket* MyTcpServant::createListener() {
             std::string host = config.host;
             uint16_t port = config.port;
             //1. 构造socket
-            socket = new Socket::MySocket();
-            if (socket->socket(PF_INET, SOCK_STREAM, 0) != 0) {
+            auto listener = new Socket::MySocket();
+            if (listener->socket(PF_INET, SOCK_STREAM, 0) != 0) {
                 LOG(ERROR) << "create socket fail, host: " << host << ", port: " << port
                 << ", error: " << strerror(errno) << std::endl;
-                return -1; //初始化失败
+                delete(listener);
+                return nullptr; //初始化失败
             }
 
             //设置属性, 异步socket
-            socket->setNonBlock();
-            socket->setReusePort(true); //重用端口
+            listener->setNonBlock();
+            listener->setReusePort(true); //重用端口
 
             //2. bind
-            if (socket->bind(host, port) != 0) {
+            if (listener->bind(host, port) != 0) {
                 LOG(ERROR) << "bind socket fail, host: " << host << ", port: " << port
                 << ", error: " << strerror(errno) << std::endl;
-                return -1; //初始化失败
+                delete(listener);
+                return nullptr; //初始化失败
             }
 
             //3. listen
-            if (socket->listen(g_default_listen_backlog) != 0) {
+            if (listener->listen(config.listenBacklog) != 0) {
                 LOG(ERROR) << "listen socket fail, host: " << host << ", port: " << port
                         << ", error: " << strerror(errno) << std::endl;
-                return -1; //初始化失败
+                delete(listener);
+                return nullptr; //初始化失败
             }
 
-            //4. 构造watcher
-            readWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
-                    std::bind(&MyTcpServant::onAccept, this, std::placeholders::_1), socket->getfd(), EV_READ);
-            loop->add(readWatcher);
+            return listener;
+        }
 
+        int32_t MyTcpServant::startServant() {
+            //1. 单个监听socket, 在servant所在的loop上accept, 绑定loop的servant每个loop各有一个
+            if (!config.reusePort || pinned) {
+                socket = createListener();
+                if (socket == nullptr) {
+                    return -1;
+                }
+
+                //io_uring的accept不需要watcher
+                if (useUring(loop, socket)) {
+                    acceptIds.resize(1);
+                    auto listener = socket;
+                    loop->RunInThreadOrImmediate([this, listener]() {
+                        this->startUringAccept(this->loop, listener, 0);
+                    });
+                    return 0;
+                }
+
+                readWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
+                        std::bind(&MyTcpServant::onAccept, this, std::placeholders::_1), socket->getfd(), EV_READ);
+                loop->add(readWatcher);
+                return 0;
+            }
+
+            //2. 每个loop一个监听socket, 新连接由accept的loop直接持有
+            acceptIds.resize(loopManager->size()); //loop线程中写入, 之后不能再扩容
+            for (uint32_t i = 0; i < loopManager->size(); ++i) {
+                auto listener = createListener();
+                if (listener == nullptr) {
+                    stopServant();
+                    return -1;
+                }
+
+                auto acceptLoop = loopManager->get(i);
+                if (useUring(acceptLoop, listener)) {
+                    listeners.push_back(listener);
+                    acceptLoop->RunInThreadOrImmediate([this, acceptLoop, listener, i]() {
+                        this->startUringAccept(acceptLoop, listener, i);
+                    });
+                    continue;
+                }
+
+                auto watcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
+                        std::bind(&MyTcpServant::onAccept, this, std::placeholders::_1), listener->getfd(), EV_READ);
+                watcher->setUid(i); //记录loop的下标
+                listeners.push_back(listener);
+                acceptWatchers.push_back(watcher);
+                acceptLoop->add(watcher);
+            }
+
+            LOG(INFO) << "servant listen with reuseport, name: " << config.name
+                      << ", listeners: " << listeners.size() << std::endl;
             return 0;
         }
 
+        void MyTcpServant::stopServant() {
+            //1. 之后到达的io_uring accept完成事件直接关闭连接
+            acceptStopped->store(true);
+
+            //2. 单个监听socket的io_uring accept在servant所在的loop上取消, 关闭fd不会结束已经提交的请求
+            if (listeners.empty() && !acceptIds.empty()) {
+                auto done = std::make_shared<std::promise<void>>();
+                auto future = done->get_future();
+                loop->RunInThreadOrImmediate([this, done]() {
+                    auto uring = this->loop->getUring();
+                    if (uring != nullptr) {
+                        uring->cancel(this->acceptIds[0]);
+                        uring->submit();
+                    }
+                    done->set_value();
+                });
+                future.wait();
+            }
+            MyServant::stopServant();
+
+            //3. 每个监听socket属于不同的loop, 需要在所在的loop中关闭, 避免和onAccept并发
+            //loop不在运行时由当前线程关闭, 所以一定会完成
+            std::vector<std::future<void>> futures;
+            for (size_t i = 0; i < listeners.size(); ++i) {
+                auto watcher = i < acceptWatchers.size() ? acceptWatchers[i] : nullptr;
+                auto listener = listeners[i];
+                auto acceptLoop = loopManager->get(static_cast<uint32_t >(i));
+                auto done = std::make_shared<std::promise<void>>();
+                futures.push_back(done->get_future());
+
+                auto close = [this, i, acceptLoop, watcher, listener, done]() {
+                    if (watcher != nullptr) {
+                        EV::MyWatcherManager::GetInstance()->destroy(watcher);
+                    }
+                    auto uring = acceptLoop->getUring();
+                    if (uring != nullptr && i < this->acceptIds.size() && this->acceptIds[i] != 0) {
+                        uring->cancel(this->acceptIds[i]);
+                        uring->submit(); //关闭fd之前提交
+                    }
+                    delete(listener); //关闭socket
+                    done->set_value();
+                };
+
+                acceptLoop->RunInThreadOrImmediate(close);
+            }
+
+            //等待所有loop确认关闭, 之前onAccept还可能访问listeners
+            for (auto& future : futures) {
+                future.wait();
+            }
+            acceptWatchers.clear();
+            listeners.clear();
+        }
+
         //on accept
         void MyTcpServant::onAccept(EV::MyWatcher* watcher) {
-            auto accepted = new Socket::MySocket();
-            if(socket->accept(accepted) != 0) {
-                LOG(ERROR) << "accept client fail" << std::endl;
-                return ;
+            //1. 找到触发事件的监听socket
+            auto listener = socket;
+            EventLoop* acceptLoop = pinned ? loop : nullptr; //绑定loop时连接都留在自己的loop上
+            if (config.reusePort && !pinned) {
+                auto index = dynamic_cast<EV::MyIOWatcher*>(watcher)->getUid();
+                listener = listeners[index];
+                acceptLoop = loopManager->get(static_cast<uint32_t >(index)); //连接留在accept的loop上
+            }
+
+            //2. 循环accept, 直到没有新的连接或者用完本次的额度, 剩下的连接等下一次事件
+            std::vector<std::vector<Socket::MySocket*>> batches(loopManager->size());
+            uint32_t budget = config.acceptBudget > 0 ? config.acceptBudget : 1;
+            for (uint32_t i = 0; i < budget; ++i) {
+                auto accepted = listener->accept();
+                if (accepted == nullptr) {
+                    auto err = errno;
+                    if (err != EAGAIN && err != EWOULDBLOCK && err != EINTR) {
+                        LOG(ERROR) << "accept client fail, error: " << strerror(err) << std::endl;
+                    }
+                    break;
+                }
+
+                auto ioLoop = acceptLoop != nullptr ? acceptLoop : loopManager->getByUid(accepted->getfd());
+                batches[ioLoop->getIndex()].push_back(accepted);
             }
 
-           createChannel(accepted);
+            //3. 每个loop只投递一次, 在loop自己的线程构造channel
+            for (uint32_t i = 0; i < batches.size(); ++i) {
+                if (!batches[i].empty()) {
+                    dispatchAccepted(loopManager->get(i), std::move(batches[i]));
+                }
+            }
         }
 
-        MyTcpServant::MyTcpServant(EventLoopManager *loopManager, MyDispatcher *dispatcher)
-        : MyServant(loopManager, dispatcher) {}
+        void MyTcpServant::dispatchAccepted(EventLoop* ioLoop, std::vector<Socket::MySocket*>&& sockets) {
+            ioLoop->RunInThreadOrImmediate([this, ioLoop, sockets]() {
+                this->createChannels(ioLoop, sockets);
+            });
+        }
 
-        void MyTcpServant::createChannel(Socket::MySocket *socket) {
-            //构造Channel
-            auto channel = std::make_shared<MyTcpChannel>(socket);
+        void MyTcpServant::startUringAccept(EventLoop* acceptLoop, Socket::MySocket* listener, uint32_t index) {
+            //servant停止之后不再访问servant, 已经accept的连接直接关闭
+            auto stopped = acceptStopped;
+            if (stopped->load()) {
+                return;
+            }
 
-            //将新连接加入到evloop中
-            auto ioLoop = loopManager->getByUid(channel->getUid()); //根据uid获取evloop
-            if (ioLoop == nullptr) {
-                LOG(ERROR) << "get next loop fail" << std::endl;
-                return ;
+            acceptIds[index] = acceptLoop->getUring()->accept(listener->getfd(),
+                    [this, stopped, acceptLoop, listener, index](int32_t res, uint32_t flags) {
+                if (stopped->load()) {
+                    if (res >= 0) {
+                        ::close(res);
+                    }
+                    return;
+                }
+                this->onUringAccept(acceptLoop, listener, index, res, flags);
+            });
+            if (acceptIds[index] == 0) {
+                LOG(ERROR) << "submit accept fail, name: " << config.name << ", error: " << strerror(errno) << std::endl;
             }
+        }
 
-            //构造watcher
-            EV::MyIOWatcher* ioWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
-                    std::bind(&MyTcpServant::onRead, this, std::placeholders::_1), socket->getfd(), EV_READ);
-            EV::MyAsyncWatcher* writeWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyAsyncWatcher>(
-                    std::bind(&MyTcpServant::onWrite, this, std::placeholders::_1));
+        void MyTcpServant::onUringAccept(EventLoop* acceptLoop, Socket::MySocket* listener, uint32_t index,
+                                         int32_t res, uint32_t flags) {
+            //1. 每个完成事件一个新连接, 和onAccept一样分配到loop
+            if (res >= 0) {
+                auto accepted = listener->adopt(res);
+                auto ioLoop = (config.reusePort || pinned) ? acceptLoop : loopManager->getByUid(accepted->getfd());
+                dispatchAccepted(ioLoop, std::vector<Socket::MySocket*>{accepted});
+            } else if (res != -ECANCELED) {
+                LOG(ERROR) << "accept client fail, error: " << strerror(-res) << std::endl;
+            }
 
-            //设置ev data
-            ioWatcher->setUid(channel->getUid());
-            writeWatcher->setUid(channel->getUid());
+            //2. 出错之后多次accept会结束, 需要重新提交
+            if (!(flags & IORING_CQE_F_MORE)) {
+                acceptIds[index] = 0;
+                if (res != -ECANCELED) {
+                    startUringAccept(acceptLoop, listener, index);
+                }
+            }
+        }
 
-            //开启事件监听
-            ioLoop->add(ioWatcher);
-            ioLoop->add(writeWatcher);
+        void MyTcpServant::createChannels(EventLoop* ioLoop, const std::vector<Socket::MySocket*>& sockets) {
+            for (auto it = sockets.begin(); it != sockets.end(); ++it) {
+                createChannel(*it, ioLoop);
+            }
+        }
 
-            //保存watcher
-            channel->setReadWatcher(ioWatcher);
-            channel->setWriteWatcher(writeWatcher);
+        void MyTcpServant::createChannel(Socket::MySocket *socket, EventLoop* ioLoop) {
+            //构造Channel
+            auto channel = std::make_shared<MyTcpChannel>(socket);
+
+            //分配uid, uid中带有loop的下标和generation
+            channel->setUid(ioLoop->allocateUid(static_cast<uint32_t >(socket->getfd())));
+
+            //字节流连接在loop开启io_uring时由io_uring收发, 不需要watcher
+            auto uring = ioLoop->getUring();
+            if (uring != nullptr && socket->getType() == SOCK_STREAM) {
+                channel->setUring(uring, std::bind(&MyTcpServant::onRecv, this,
+                        std::placeholders::_1, std::placeholders::_2));
+            } else {
+                //构造watcher
+                EV::MyIOWatcher* ioWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
+                        std::bind(&MyTcpServant::onRead, this, std::placeholders::_1), socket->getfd(), EV_READ);
+                EV::MyIOWatcher* drainWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
+                        std::bind(&MyTcpServant::onWrite, this, std::placeholders::_1), socket->getfd(), EV_WRITE);
+
+                //设置ev data
+                ioWatcher->setUid(channel->getUid());
+                drainWatcher->setUid(channel->getUid());
+
+                //开启事件监听, drain watcher在有数据没有发完时才开启
+                ioLoop->add(ioWatcher);
+
+                //保存watcher
+                channel->setReadWatcher(ioWatcher);
+                channel->setDrainWatcher(drainWatcher);
+            }
 
             //设置超时检查函数
             channel->setOnTimeoutFunc(std::bind(&MyTcpServant::onTimeout, this, std::placeholders::_1));
+            channel->setIdleTimeout(config.timeout);
+            channel->setReadBudget(config.readBudget);
+            channel->setPacketMode(socket->getType() == SOCK_SEQPACKET);
+            channel->setBufferPool(ioLoop->getBufferPool()); //在io线程读取
+
+            //设置待发送数据的水位
+            channel->setWatermark(config.writeHighWatermark, config.writeLowWatermark);
+            channel->setOnWatermarkFunc(std::bind(&MyTcpServant::onWatermark, this,
+                    std::placeholders::_1, std::placeholders::_2));
 
             //保存iothread
             channel->setLoop(ioLoop);
-            loopManager->addChannel(channel);
+            ioLoop->addChannel(channel);
+            channel->startRecv(); //没有使用io_uring时什么也不做
 
             LOG(INFO) << "client connected, ip: " << socket->getRemoteHost()
             << ", port: " << socket->getRemotePort()
@@ -315,7 +672,7 @@ namespace MF {
             uint64_t uid = dynamic_cast<EV::MyIOWatcher*>(watcher)->getUid();
 
             //2. 获取channel
-            auto channel = loopManager->findChannel(uid);
+            auto channel = findChannel(uid);
             if (channel == nullptr) {
                 LOG(ERROR) << "find channel fail, uid: " << uid << std::endl;
                 return nullptr;
@@ -342,6 +699,178 @@ namespace MF {
         }
 
 
+        void MyTcpServant::onRecv(std::shared_ptr<MyChannel> channel, int32_t res) {
+            //1. 连接已经被关闭了, 关闭之前已经完成的recv
+            if (findChannel(channel->getUid()) != channel) {
+                return;
+            }
+
+            //2. 处理收到的数据
+            if (res > 0) {
+                handlePackets(channel);
+                return;
+            }
+
+            //3. buffer用完或者暂停读取时取消了, 由channel重新提交
+            if (res == -ENOBUFS || res == -ECANCELED) {
+                return;
+            }
+
+            if (res == 0) {
+                LOG(INFO) << "connection close by remote, uid: " << channel->getUid() << std::endl;
+            } else {
+                LOG(ERROR) << "read error, uid: " << channel->getUid() << ", error: " << strerror(-res) << std::endl;
+            }
+            onReadError(channel);
+        }
+
+        MyUnixServant::MyUnixServant(EventLoopManager *loopManager, MyDispatcher *dispatcher)
+        : MyTcpServant(loopManager, dispatcher) {
+        }
+
+        int32_t MyUnixServant::initialize(const ServantConfig &config) {
+            //unix socket不支持SO_REUSEPORT, 只有一个监听socket
+            auto unixConfig = config;
+            unixConfig.reusePort = false;
+            return MyTcpServant::initialize(unixConfig);
+        }
+
+        void MyUnixServant::stopServant() {
+            MyTcpServant::stopServant();
+
+            //删除自己创建的socket文件
+            if (bound) {
+                ::unlink(config.host.c_str());
+                bound = false;
+            }
+        }
+
+        Socket::MySocket* MyUnixServant::createListener() {
+            const std::string& path = config.host;
+            //1. 构造socket
+            auto listener = new Socket::MySocket();
+            if (listener->socket(AF_UNIX, config.seqPacket ? SOCK_SEQPACKET : SOCK_STREAM, 0) != 0) {
+                LOG(ERROR) << "create unix socket fail, path: " << path
+                           << ", error: " << strerror(errno) << std::endl;
+                delete(listener);
+                return nullptr; //初始化失败
+            }
+            listener->setNonBlock();
+
+            //2. bind, 之前的进程异常退出时socket文件还在
+            removeStale(path);
+            if (listener->bind(path, 0) != 0) {
+                LOG(ERROR) << "bind unix socket fail, path: " << path
+                           << ", error: " << strerror(errno) << std::endl;
+                delete(listener);
+                return nullptr; //初始化失败
+            }
+            bound = true;
+
+            //3. listen
+            if (listener->listen(config.listenBacklog) != 0) {
+                LOG(ERROR) << "listen unix socket fail, path: " << path
+                           << ", error: " << strerror(errno) << std::endl;
+                delete(listener);
+                return nullptr; //初始化失败
+            }
+
+            LOG(INFO) << "unix servant listen, name: " << config.name << ", path: " << path
+                      << ", seqpacket: " << config.seqPacket << std::endl;
+            return listener;
+        }
+
+        void MyUnixServant::removeStale(const std::string &path) {
+            //1. 只删除socket文件
+            struct stat st;
+            if (::stat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode)) {
+                return;
+            }
+
+            //2. 还有进程在监听时不删除, bind会失败
+            Socket::MySocket probe;
+            if (probe.socket(AF_UNIX, SOCK_STREAM, 0) != 0) {
+                return;
+            }
+            probe.setNonBlock();
+            if (probe.connect(path, 0) == 0 || errno != ECONNREFUSED) {
+                return;
+            }
+
+            LOG(INFO) << "remove stale unix socket, path: " << path << std::endl;
+            ::unlink(path.c_str());
+        }
+
+        MyShmServant::MyShmServant(EventLoopManager *loopManager, MyDispatcher *dispatcher)
+        : MyUnixServant(loopManager, dispatcher) {
+        }
+
+        int32_t MyShmServant::initialize(const ServantConfig &config) {
+            //unix socket只用于握手和检测关闭, 不需要按消息读取
+            auto shmConfig = config;
+            shmConfig.seqPacket = false;
+            return MyUnixServant::initialize(shmConfig);
+        }
+
+        void MyShmServant::createChannel(Socket::MySocket *socket, EventLoop* ioLoop) {
+            //构造Channel
+            auto channel = std::make_shared<MyShmChannel>(socket);
+
+            //分配uid, uid中带有loop的下标和generation
+            channel->setUid(ioLoop->allocateUid(static_cast<uint32_t >(socket->getfd())));
+
+            //先监听unix socket, 等待client传递共享内存
+            EV::MyIOWatcher* ioWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
+                    std::bind(&MyShmServant::onControl, this, std::placeholders::_1), socket->getfd(), EV_READ);
+            ioWatcher->setUid(channel->getUid());
+            ioLoop->add(ioWatcher);
+            channel->setReadWatcher(ioWatcher);
+
+            //设置超时检查函数
+            channel->setOnTimeoutFunc(std::bind(&MyShmServant::onTimeout, this, std::placeholders::_1));
+            channel->setIdleTimeout(config.timeout);
+            channel->setReadBudget(config.readBudget);
+            channel->setBufferPool(ioLoop->getBufferPool()); //在io线程读取
+
+            //设置待发送数据的水位
+            channel->setWatermark(config.writeHighWatermark, config.writeLowWatermark);
+            channel->setOnWatermarkFunc(std::bind(&MyShmServant::onWatermark, this,
+                    std::placeholders::_1, std::placeholders::_2));
+
+            //保存iothread
+            channel->setLoop(ioLoop);
+            ioLoop->addChannel(channel);
+
+            LOG(INFO) << "shm client connected, uid: " << channel->getUid() << std::endl;
+        }
+
+        void MyShmServant::onControl(EV::MyWatcher *watcher) {
+            //1. 获取channel
+            uint64_t uid = dynamic_cast<EV::MyIOWatcher*>(watcher)->getUid();
+            auto channel = std::dynamic_pointer_cast<MyShmChannel>(findChannel(uid));
+            if (channel == nullptr) {
+                LOG(ERROR) << "find channel fail, uid: " << uid << std::endl;
+                return;
+            }
+
+            //2. 握手或者对端关闭
+            bool attached = channel->isAttached();
+            auto rv = channel->onControl();
+            if (rv == 0 || (rv < 0 && errno != EAGAIN)) {
+                LOG(INFO) << "shm connection close, uid: " << uid << ", rv: " << rv << std::endl;
+                onReadError(channel);
+                return;
+            }
+
+            //3. 握手完成, 开始监听doorbell, 数据的读取和tcp相同
+            if (!attached && channel->isAttached()) {
+                EV::MyIOWatcher* doorbellWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
+                        std::bind(&MyShmServant::onRead, this, std::placeholders::_1), channel->getDoorbell(), EV_READ);
+                doorbellWatcher->setUid(uid);
+                channel->setDoorbellWatcher(doorbellWatcher);
+            }
+        }
+
         MyUdpServant::MyUdpServant(
                 MF::Server::EventLoopManager *loopManager
                 , MF::Server::MyDispatcher *dispatcher)
@@ -354,7 +883,9 @@ namespace MF {
             uint16_t port = config.port;
             //1. 构造socket
             socket = new Socket::MySocket();
-            if (socket->socket(PF_INET, SOCK_DGRAM, 0) != 0) {
+            //ipv6地址中包含':'
+            auto domain = host.find(':') != std::string::npos ? PF_INET6 : PF_INET;
+            if (socket->socket(domain, SOCK_DGRAM, 0) != 0) {
                 LOG(ERROR) << "create socket fail, host: " << host << ", port: " << port
                            << ", error: " << strerror(errno) << std::endl;
                 return -1; //初始化失败
@@ -371,60 +902,244 @@ namespace MF {
                 return -1; //初始化失败
             }
 
-            //3. 构造watcher
+            //3. GSO/GRO, 内核不支持时使用普通的收发
+            if (config.udpOffload) {
+                //合并的数据包需要从控制信息中拆分, 只有批量读取时处理
+                if (config.udpBatchSize <= 1) {
+                    LOG(ERROR) << "udp gro needs udpBatchSize > 1, disabled" << std::endl;
+                } else if (socket->setUdpGro(true) == 0) {
+                    recvLength = g_max_udp_offload_length;
+                    gro = true;
+                } else {
+                    LOG(ERROR) << "udp gro is not supported, error: " << strerror(errno) << std::endl;
+                }
+
+                segment = socket->supportUdpSegment();
+                if (!segment) {
+                    LOG(ERROR) << "udp segment offload is not supported" << std::endl;
+                }
+            }
+
+            //4. 批量收发
+            if (config.udpBatchSize > 1) {
+#ifdef __linux__
+                recvBuffer.resize(config.udpBatchSize * recvLength);
+                recvMsgs.resize(config.udpBatchSize);
+                recvIov.resize(config.udpBatchSize);
+                recvAddrs.resize(config.udpBatchSize);
+                if (gro) {
+                    recvControl.resize(config.udpBatchSize * CMSG_SPACE(sizeof(int32_t)));
+                }
+#endif
+                //每个loop一个批量发送, 在loop发送完所有channel之后发出, servant停止时删除
+                flushHookIds.resize(loopManager->size(), 0);
+                for (uint32_t i = 0; i < loopManager->size(); ++i) {
+                    auto lp = loopManager->get(i);
+                    auto batch = std::make_shared<MyUdpSendBatch>(socket, config.udpBatchSize);
+                    batch->setSegment(segment);
+                    sendBatches.push_back(batch);
+                    lp->RunInThreadOrImmediate([this, i, lp, batch]() {
+                        this->flushHookIds[i] = lp->addFlushHook([batch]() {
+                            batch->flush();
+                        });
+                    });
+                }
+            }
+
+            //5. 构造watcher
             readWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyIOWatcher>(
                     std::bind(&MyUdpServant::onRead, this, std::placeholders::_1), socket->getfd(), EV_READ);
             loop->add(readWatcher);
 
-            //4. 注册节点
+            //6. 注册节点
 
 
             return 0;
         }
 
+        void MyUdpServant::stopServant() {
+            //批量发送引用servant的socket, 需要在所在的loop中删除, 避免和flush并发
+            std::vector<std::future<void>> futures;
+            for (uint32_t i = 0; i < sendBatches.size(); ++i) {
+                auto lp = loopManager->get(i);
+                auto batch = sendBatches[i];
+                auto done = std::make_shared<std::promise<void>>();
+                futures.push_back(done->get_future());
+                lp->RunInThreadOrImmediate([this, i, lp, batch, done]() {
+                    lp->removeFlushHook(this->flushHookIds[i]);
+                    batch->close(); //channel中还持有batch, 之后的响应直接丢弃
+                    done->set_value();
+                });
+            }
+
+            //等待所有loop确认
+            for (auto& future : futures) {
+                future.wait();
+            }
+
+            MyServant::stopServant();
+        }
+
         std::shared_ptr<MyUdpChannel> MyUdpServant::createChannel(
-                Socket::MySocket *socket, const std::string& ip, uint16_t port) {
+                Socket::MySocket *socket, const MyUdpPeerKey& peer) {
             //构造Channel
-            auto channel = std::make_shared<MyUdpChannel>(socket, ip, port);
+            auto channel = std::make_shared<MyUdpChannel>(socket, peer);
 
-            //将新连接加入到evloop中
-            auto ioLoop = loopManager->getByUid(channel->getUid()); //根据uid获取evloop
+            //将新连接加入到evloop中, 绑定loop时留在servant自己的loop上
+            auto ioLoop = pinned ? loop : loopManager->getByUid(channel->getUid()); //根据uid获取evloop
             if (ioLoop == nullptr) {
                 LOG(ERROR) << "get next loop fail" << std::endl;
                 return nullptr;
             }
 
-            //构造watcher
-            EV::MyAsyncWatcher* writeWatcher = EV::MyWatcherManager::GetInstance()->create<EV::MyAsyncWatcher>(
-                    std::bind(&MyUdpServant::onWrite, this, std::placeholders::_1));
+            //GRO合并之后的数据包
+            channel->setReadLength(recvLength);
 
-            //设置ev data
-            writeWatcher->setUid(channel->getUid());
-
-            //开启事件监听
-            ioLoop->add(writeWatcher);
-
-            //保存watcher
-            channel->setWriteWatcher(writeWatcher);
+            //批量发送
+            if (!sendBatches.empty()) {
+                channel->setSendBatch(sendBatches[ioLoop->getIndex()]);
+            }
 
             //设置超时检查函数
             channel->setOnTimeoutFunc(std::bind(&MyUdpServant::onTimeout, this, std::placeholders::_1));
-
+            channel->setIdleTimeout(config.timeout);
+            channel->setBufferPool(loop->getBufferPool()); //在servant的loop中读取
+
+            //关闭之后从对端表删除, 关闭可能发生在io线程
+            auto servantLoop = loop;
+            channel->setOnCloseFunc([this, servantLoop](const MyUdpPeerKey& key) {
+                servantLoop->RunInThreadOrImmediate([this, key]() {
+                    evictPeer(key);
+                });
+            });
+            peers.insert(peer, channel);
 
             //保存iothread
             channel->setLoop(ioLoop);
-            loopManager->addChannel(channel);
+            ioLoop->addChannel(channel);
 
-            LOG(INFO) << "client connected, ip: " << ip << ", port: " << port
+            LOG(INFO) << "client connected, ip: " << peer.getIp() << ", port: " << peer.getPort()
             << ", uid: " << channel->getUid() << std::endl;
 
             return channel;
         }
 
+        std::shared_ptr<MyUdpChannel> MyUdpServant::findPeer(const MyUdpPeerKey &peer) {
+            auto value = peers.find(peer);
+            if (value == nullptr) {
+                return nullptr;
+            }
+
+            //已经关闭的channel直接删除, 不等待evictPeer
+            auto channel = value->lock();
+            if (channel == nullptr || channel->isClosed()) {
+                peers.erase(peer);
+                return nullptr;
+            }
+            return channel;
+        }
+
+        std::shared_ptr<MyUdpChannel> MyUdpServant::getOrCreatePeer(const sockaddr *sa, socklen_t len) {
+            MyUdpPeerKey peer;
+            if (!MyUdpPeerKey::make(sa, len, peer)) {
+                LOG(ERROR) << "unsupported address family: " << sa->sa_family << std::endl;
+                return nullptr;
+            }
+
+            auto channel = findPeer(peer);
+            if (channel == nullptr
+                && (channel = createChannel(this->socket, peer)) == nullptr) {
+                LOG(ERROR) << "create udp channel fail, ip: " << peer.getIp()
+                           << ", port: " << peer.getPort() << std::endl;
+            }
+            return channel;
+        }
+
+        void MyUdpServant::evictPeer(const MyUdpPeerKey &peer) {
+            //同一个对端可能已经创建了新的channel, 只删除已经关闭的
+            auto value = peers.find(peer);
+            if (value == nullptr) {
+                return;
+            }
+
+            auto channel = value->lock();
+            if (channel == nullptr || channel->isClosed()) {
+                peers.erase(peer);
+            }
+        }
+
+        void MyUdpServant::onRead(EV::MyWatcher *watcher) {
+#ifdef __linux__
+            if (config.udpBatchSize > 1) {
+                readBatch();
+                return;
+            }
+#endif
+            MyServant::onRead(watcher);
+        }
+
+        void MyUdpServant::readBatch() {
+#ifdef __linux__
+            //1. 设置每个数据包的地址和buffer
+            uint32_t count = static_cast<uint32_t >(recvMsgs.size());
+            for (uint32_t i = 0; i < count; ++i) {
+                recvIov[i].iov_base = &recvBuffer[i * recvLength];
+                recvIov[i].iov_len = recvLength;
+
+                auto& hdr = recvMsgs[i].msg_hdr;
+                bzero(&hdr, sizeof(hdr));
+                hdr.msg_name = &recvAddrs[i];
+                hdr.msg_namelen = sizeof(sockaddr_storage);
+                hdr.msg_iov = &recvIov[i];
+                hdr.msg_iovlen = 1;
+                if (gro) {
+                    hdr.msg_control = &recvControl[i * CMSG_SPACE(sizeof(int32_t))];
+                    hdr.msg_controllen = CMSG_SPACE(sizeof(int32_t));
+                }
+            }
+
+            //2. 一次读取多个数据包
+            auto received = socket->readMany(recvMsgs.data(), count);
+            if (received <= 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    LOG(ERROR) << "read error, fd: " << socket->getfd() << ", error: " << strerror(errno) << std::endl;
+                }
+                return;
+            }
+
+            //3. 分发到对应的channel
+            for (int32_t i = 0; i < received; ++i) {
+                if ((recvMsgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+                    LOG(ERROR) << "udp packet is truncated, length: " << recvMsgs[i].msg_len << std::endl;
+                    continue;
+                }
+
+                auto channel = getOrCreatePeer(
+                        reinterpret_cast<sockaddr*>(&recvAddrs[i]), recvMsgs[i].msg_hdr.msg_namelen);
+                if (channel == nullptr) {
+                    continue;
+                }
+
+                //开启GRO之后一次可能收到同一个对端的多个数据包, 按照分段长度拆开
+                auto data = static_cast<char*>(recvIov[i].iov_base);
+                uint32_t length = recvMsgs[i].msg_len;
+                uint32_t segmentSize = gro ? Socket::MySocket::getUdpGroSize(&recvMsgs[i].msg_hdr) : 0;
+                if (segmentSize == 0) {
+                    segmentSize = length;
+                }
+                for (uint32_t offset = 0; offset < length; offset += segmentSize) {
+                    channel->appendPacket(data + offset, std::min(segmentSize, length - offset));
+                    handlePackets(channel);
+                }
+            }
+#endif
+        }
+
         shared_ptr<MyChannel> MyUdpServant::doRead(EV::MyWatcher *watcher) {
             //1. 检查消息来源
-            sockaddr_in addr = {0};
-            uint32_t addrLen = sizeof(addr);
+            sockaddr_storage addr;
+            socklen_t addrLen = sizeof(addr);
+            bzero(&addr, addrLen);
 
             if(socket->peekFrom(reinterpret_cast<sockaddr*>(&addr), &addrLen) <= 0) {
                 if (errno != EAGAIN) {
@@ -434,18 +1149,9 @@ namespace MF {
                 return nullptr;
             }
 
-            //2. 生成ui
-            std::string ip = inet_ntoa(addr.sin_addr);
-            uint16_t port = ntohs(addr.sin_port);
-            auto uid = MyUdpChannel::createUid(ip, port);
-
-            //3. 根据uid查找对应的channel
-            auto channel = loopManager->findChannel(uid);
-            if (channel == nullptr
-                && (channel = createChannel(this->socket, ip, port)) == nullptr) {
-                LOG(ERROR) << "create udp channel fail, uid: " << uid
-                           << ", ip: " << ip << ", port: " << port << std::endl;
-
+            //2. 根据对端地址查找对应的channel
+            auto channel = getOrCreatePeer(reinterpret_cast<sockaddr*>(&addr), addrLen);
+            if (channel == nullptr) {
                 return nullptr;
             }
 
@@ -11,6 +11,7 @@
 #include "net/server/MyDispatcher.h"
 #include "net/buffer/MySKBuffer.h"
 #include "net/server/MyChannel.h"
+#include "net/server/MyAdmissionControl.h"
 #include "util/MyThreadPool.h"
 #include "route/MyRouteProxy.h"
 
@@ -23,7 +24,22 @@ namespace MF {
             uint16_t port; //绑定的端口
             uint32_t timeout; //client 超时断连时间(s)
             uint32_t handlerThreadCount; //handler线程数
+            ExecutorType handlerExecutorType {kExecutorThreadPool}; //handler线程池的实现, 默认加锁队列的线程池
             uint32_t version; //版本号
+            uint32_t writeHighWatermark {g_default_write_high_watermark}; //待发送数据的高水位(字节), 0表示不限制
+            uint32_t writeLowWatermark {g_default_write_low_watermark}; //待发送数据的低水位(字节)
+            bool reusePort {false}; //每个io线程一个监听socket(SO_REUSEPORT), 由内核分配新连接, 只对tcp有效
+            uint32_t listenBacklog {g_default_listen_backlog}; //监听socket的等待连接数
+            uint32_t acceptBudget {g_default_accept_budget}; //每次监听socket可读时最多accept的连接数
+            bool inlineHandler {false}; //是否在io线程直接执行handler, 只适用于不阻塞的handler
+            uint32_t inlineBudgetMicros {g_default_inline_budget_us}; //io线程执行handler的耗时上限(微秒)
+            uint32_t udpBatchSize {g_default_udp_batch_size}; //udp一次recvmmsg/sendmmsg的数据包个数, 1表示不批量
+            bool udpOffload {false}; //udp是否开启GSO/GRO, 内核不支持时自动关闭, GSO需要批量发送
+            uint32_t readBudget {g_default_read_budget}; //tcp和shm连接每次可读事件最多读取的字节数, 0表示不限制
+            bool seqPacket {false}; //unix socket是否使用SOCK_SEQPACKET, 默认SOCK_STREAM
+            uint32_t dispatchBatchSize {g_default_dispatch_batch_size}; //一次读取的完整数据包合并成一个handler任务的最大个数, 1表示不合并
+            uint32_t admissionTargetMicros {0}; //handler排队时间的目标(微秒), 0表示不做准入控制(默认), 开启时可以使用g_default_admission_target_us
+            uint32_t admissionIntervalMicros {g_default_admission_interval_us}; //排队时间持续超过目标多久之后拒绝新请求(微秒)
         };
 
         /**
@@ -52,6 +68,13 @@ namespace MF {
              */
             virtual int32_t initialize(const ServantConfig& config);
 
+            /**
+             * 绑定到一个loop上, 需要在initialize之前调用
+             * 连接、handler都只在该loop的线程中处理, 不使用handler线程池
+             * @param loop 所属的loop
+             */
+            void pinToLoop(EventLoop* loop);
+
             /**
              * 启动servant
              * @return 0 成功 其他失败
@@ -61,7 +84,7 @@ namespace MF {
             /**
              * 停止
              */
-            void stopServant();
+            virtual void stopServant();
 
             /**
              * 注册servant
@@ -73,6 +96,19 @@ namespace MF {
              */
             virtual void syncServant(const std::string& routeServantName);
 
+            /**
+             * 过载状态变化时同步到路由服务
+             */
+            virtual void syncStatus(const std::string& routeServantName);
+
+            /**
+             * 是否过载, handler排队时间持续超过目标时过载, 新的请求直接拒绝
+             * @return true 过载
+             */
+            bool isOverloaded() const {
+                return admission != nullptr && admission->isOverloaded();
+            }
+
             /**
              * 检查servant是否已经注册
              * @return 是否已经注册
@@ -94,7 +130,7 @@ namespace MF {
             /**
              * 有数据可以读取
              */
-            void onRead(EV::MyWatcher* watcher);
+            virtual void onRead(EV::MyWatcher* watcher);
 
             /**
              * 需要发送数据
@@ -115,9 +151,28 @@ namespace MF {
             virtual void handlePackets(std::shared_ptr<MyChannel> channel);
 
             /**
-             * 数据包完整
+             * 待发送数据越过高水位或者回落到低水位
+             * @param channel channel
+             * @param blocked true 越过高水位 false 回落到低水位
+             */
+            void onWatermark(std::shared_ptr<MyChannel> channel, bool blocked);
+
+            /**
+             * 数据包完整, 在io线程执行的handler直接执行, 其他的放入batch等待批量分发
+             * 直接执行或者拒绝之前先分发batch中之前的数据包, 不改变数据包的顺序
+             * @param channel channel
+             * @param buf 可读数据
+             * @param len 可读数据长度
+             * @param batch 待分发的数据包
+             */
+            virtual void onReadComplete(std::shared_ptr<MyChannel> channel, const char* buf, uint32_t len,
+                                        std::vector<MyPacket>& batch) ;
+
+            /**
+             * 把batch中的数据包作为一个任务放入handler线程池, 只有一个数据包时单独分发
+             * @param batch 待分发的数据包, 分发之后清空
              */
-            virtual void onReadComplete(std::shared_ptr<MyChannel> channel, const char* buf, uint32_t len) ;
+            void dispatchBatch(std::vector<MyPacket>& batch);
 
             /**
              * 数据包读取出错
@@ -125,6 +180,27 @@ namespace MF {
              */
             virtual void onReadError(std::shared_ptr<MyChannel> channel);
 
+            /**
+             * 执行handler, 绑定loop时直接在io线程执行, 否则放入handler线程池
+             * @param func handler
+             * @param wait 是否等待执行结束
+             * @return wait时返回handler的结果, 否则返回0
+             */
+            int32_t runHandler(std::function<int32_t()>&& func, bool wait);
+
+            /**
+             * 查找channel, 绑定loop时只在自己的loop中查找
+             * @param uid uid
+             * @return channel
+             */
+            std::shared_ptr<MyChannel> findChannel(uint64_t uid);
+
+            /**
+             * 删除channel
+             * @param channel channel
+             */
+            void removeChannel(std::shared_ptr<MyChannel> channel);
+
         protected:
             /**
              * 执行read操作
@@ -144,9 +220,13 @@ namespace MF {
             Socket::MySocket* socket {nullptr}; //socket
             EV::MyIOWatcher* readWatcher {nullptr}; //ioWatcher
 
-            MyThreadExecutor<int32_t >* handlerExecutor; //handler的执行线程池
+            MyThreadExecutor<int32_t >* handlerExecutor {nullptr}; //handler的执行线程池
+            bool pinned {false}; //是否绑定到loop上
+            std::unique_ptr<MyAdmissionControl> admission; //handler线程池的准入控制, 绑定loop时没有排队, 不需要
 
             bool registered {false}; //是否已经注册
+            std::string nodeId; //注册之后路由服务分配的节点标识
+            bool reportedOverload {false}; //上次同步到路由服务的是否过载
             uint32_t lastSyncTime {0}; //上次同步时间
         };
 
@@ -170,13 +250,67 @@ namespace MF {
              */
             int32_t startServant() override;
 
+            /**
+             * 停止servant, 关闭所有的监听socket
+             */
+            void stopServant() override;
+
         protected:
+            /**
+             * 构造监听socket
+             * @return socket, 失败时返回nullptr
+             */
+            virtual Socket::MySocket* createListener();
+
             /**
              * 接收新的链接
              * @return
              */
             void onAccept(EV::MyWatcher* watcher);
 
+            /**
+             * 把新的连接投递到所属的loop, 在loop自己的线程构造channel
+             * @param ioLoop channel所属的loop
+             * @param sockets 新的连接
+             */
+            void dispatchAccepted(EventLoop* ioLoop, std::vector<Socket::MySocket*>&& sockets);
+
+            /**
+             * 在监听socket所在loop的io_uring上提交多次accept, 只能在该loop的线程调用
+             * @param acceptLoop 监听socket所在的loop
+             * @param listener 监听socket
+             * @param index 监听socket的下标
+             */
+            void startUringAccept(EventLoop* acceptLoop, Socket::MySocket* listener, uint32_t index);
+
+            /**
+             * io_uring的accept完成
+             * @param acceptLoop 监听socket所在的loop
+             * @param listener 监听socket
+             * @param index 监听socket的下标
+             * @param res 新连接的fd, 小于0时为-errno
+             * @param flags cqe的flags
+             */
+            void onUringAccept(EventLoop* acceptLoop, Socket::MySocket* listener, uint32_t index,
+                               int32_t res, uint32_t flags);
+
+            /**
+             * io_uring收到数据或者recv结束
+             * @param channel channel
+             * @param res recv的结果, 0表示对端关闭
+             */
+            void onRecv(std::shared_ptr<MyChannel> channel, int32_t res);
+
+            /**
+             * 监听socket是否使用io_uring accept, 只支持字节流socket
+             * @param acceptLoop 监听socket所在的loop
+             * @param listener 监听socket
+             * @return true 使用io_uring
+             */
+            static bool useUring(EventLoop* acceptLoop, Socket::MySocket* listener) {
+                return acceptLoop->getUring() != nullptr && listener->getType() == SOCK_STREAM;
+            }
+
             /**
              * 执行read操作
              * @param watcher watcher
@@ -184,13 +318,108 @@ namespace MF {
              */
             shared_ptr<MyChannel> doRead(EV::MyWatcher *watcher) override;
 
+            /**
+             * 在目标loop上批量构造channel, 只能在ioLoop的线程调用
+             * @param ioLoop channel所属的loop
+             * @param sockets 新的连接
+             */
+            void createChannels(EventLoop* ioLoop, const std::vector<Socket::MySocket*>& sockets);
+
             /**
              * 构造channel
              * @param socket socket对象
+             * @param ioLoop channel所属的loop
              */
-            void createChannel(Socket::MySocket *socket) ;
+            virtual void createChannel(Socket::MySocket *socket, EventLoop* ioLoop) ;
 
         protected:
+            //reuseport模式下每个loop一个监听socket, 下标和loop的下标一致
+            std::vector<Socket::MySocket*> listeners;
+            std::vector<EV::MyIOWatcher*> acceptWatchers;
+
+            //io_uring的多次accept, 下标和监听socket一致, 只在监听socket所在的loop访问
+            std::vector<uint64_t> acceptIds;
+            //servant停止之后到达的accept完成事件直接关闭连接, 不再访问servant
+            std::shared_ptr<std::atomic<bool>> acceptStopped {std::make_shared<std::atomic<bool>>(false)};
+        };
+
+        /**
+         * unix socket servant, 用于同一台机器上的调用, 不经过tcp/ip协议栈
+         * config.host为socket文件的路径, port和reusePort不使用
+         * 连接的处理和tcp相同, seqPacket时每次write是一个消息, 消息不能超过g_max_read_size
+         */
+        class MyUnixServant : public MyTcpServant {
+        public:
+            /**
+             * 构造函数
+             * @param loopManager loop manager
+             * @param dispatcher dispatcher
+             */
+            MyUnixServant(EventLoopManager *loopManager, MyDispatcher *dispatcher);
+
+            /**
+             * 初始化Servant
+             * @param config 配置
+             * @return 0 成功
+             */
+            int32_t initialize(const ServantConfig& config) override;
+
+            /**
+             * 停止servant, 删除socket文件
+             */
+            void stopServant() override;
+
+        protected:
+            /**
+             * 构造监听socket, 之前的进程留下的socket文件会被删除
+             * @return socket, 失败时返回nullptr
+             */
+            Socket::MySocket* createListener() override;
+
+            /**
+             * 删除没有进程监听的socket文件
+             * @param path 路径
+             */
+            static void removeStale(const std::string& path);
+
+        protected:
+            bool bound {false}; //是否已经绑定到socket文件
+        };
+
+        /**
+         * 共享内存servant, 用于同一台机器上延迟敏感的调用
+         * client连接unix socket之后通过SCM_RIGHTS传递共享内存和doorbell的fd, 之后数据只通过共享内存收发
+         * io loop开启忙轮询时直接轮询ring, 否则通过doorbell(eventfd)唤醒, 只支持linux
+         */
+        class MyShmServant : public MyUnixServant {
+        public:
+            /**
+             * 构造函数
+             * @param loopManager loop manager
+             * @param dispatcher dispatcher
+             */
+            MyShmServant(EventLoopManager *loopManager, MyDispatcher *dispatcher);
+
+            /**
+             * 初始化Servant
+             * @param config 配置
+             * @return 0 成功
+             */
+            int32_t initialize(const ServantConfig& config) override;
+
+        protected:
+            /**
+             * 构造共享内存channel, 先只监听unix socket, 握手之后再监听doorbell
+             * @param socket socket对象
+             * @param ioLoop channel所属的loop
+             */
+            void createChannel(Socket::MySocket *socket, EventLoop* ioLoop) override;
+
+            /**
+             * unix socket可读, 握手或者对端关闭
+             * @param watcher watcher
+             */
+            void onControl(EV::MyWatcher* watcher);
         };
 
         /**
@@ -211,13 +440,51 @@ namespace MF {
              */
             int32_t startServant() override;
 
+            /**
+             * 停止servant, 先在每个loop中删除批量发送, 再关闭socket
+             */
+            void stopServant() override;
+
         protected:
+            /**
+             * 有数据可以读取, 批量模式下一次读取多个数据包
+             * @param watcher watcher
+             */
+            void onRead(EV::MyWatcher* watcher) override;
+
+            /**
+             * 使用recvmmsg批量读取数据包, 分发到对应的channel
+             */
+            void readBatch();
+
             /**
              * 构造channel
              * @param socket socket
+             * @param peer 对端地址
              */
             std::shared_ptr<MyUdpChannel> createChannel(
-                    Socket::MySocket *socket, const std::string& ip, uint16_t port) ;
+                    Socket::MySocket *socket, const MyUdpPeerKey& peer) ;
+
+            /**
+             * 根据对端地址查找channel, 不存在或者已经关闭时返回nullptr
+             * @param peer 对端地址
+             * @return channel
+             */
+            std::shared_ptr<MyUdpChannel> findPeer(const MyUdpPeerKey& peer);
+
+            /**
+             * 获取数据包对应的channel, 不存在时创建
+             * @param sa 对端地址
+             * @param len 对端地址长度
+             * @return channel
+             */
+            std::shared_ptr<MyUdpChannel> getOrCreatePeer(const sockaddr* sa, socklen_t len);
+
+            /**
+             * channel关闭之后从对端表中删除, 在servant的loop中执行
+             * @param peer 对端地址
+             */
+            void evictPeer(const MyUdpPeerKey& peer);
 
             /**
              * 执行读取操作
@@ -225,6 +492,22 @@ namespace MF {
              * @return channel
              */
             shared_ptr<MyChannel> doRead(EV::MyWatcher *watcher) override;
+
+        protected:
+#ifdef __linux__
+            //批量读取使用的buffer, 只在servant的loop中访问
+            std::vector<char> recvBuffer;
+            std::vector<struct mmsghdr> recvMsgs;
+            std::vector<struct iovec> recvIov;
+            std::vector<sockaddr_storage> recvAddrs;
+            std::vector<char> recvControl; //开启GRO时每个数据包的控制信息, 内核通过UDP_GRO返回分段长度
+#endif
+            uint32_t recvLength {g_max_udp_packet_length}; //一次读取一个数据包的最大长度, 开启GRO之后变大
+            bool segment {false}; //是否开启了GSO
+            bool gro {false}; //是否开启了GRO, 只在批量读取时开启
+            MyUdpPeerTable<std::weak_ptr<MyUdpChannel>> peers; //对端地址到channel的映射, 只在servant的loop中访问
+            std::vector<std::shared_ptr<MyUdpSendBatch>> sendBatches; //每个loop一个批量发送, 下标和loop的下标一致
+            std::vector<uint64_t> flushHookIds; //每个loop上批量发送的flush hook, 只在对应的loop中访问
         };
     }
 }
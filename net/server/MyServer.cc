@@ -7,15 +7,40 @@
 //
 
 #include "net/server/MyServer.h"
+#include "net/client/MyCommunicator.h"
 
 namespace MF {
     namespace Server {
         int32_t MyServer::initServer(const MF::Server::ServerConfig &config) {
             this->config = config;
 
+            //threadPerCore模式默认每个允许使用的cpu一个io线程
+            auto cpus = MyCommon::getAllowedCpus();
+            if (this->config.threadPerCore && this->config.ioThreadCount == 0) {
+                this->config.ioThreadCount = static_cast<uint32_t >(cpus.size());
+            }
+            if (this->config.ioThreadCount > MyChannelTable::kMaxLoops) {
+                this->config.ioThreadCount = MyChannelTable::kMaxLoops; //uid中loop下标的上限
+            }
+
             //初始化loop manager
             this->loopManager = new EventLoopManager();
-            return this->loopManager->initialize(this->config.ioThreadCount);
+            this->loopManager->setBackend(this->config.loopBackend);
+            if (!this->config.threadPerCore) {
+                return this->loopManager->initialize(this->config.ioThreadCount, this->config.busyPollMicros);
+            }
+
+            //threadPerCore模式每个core有自己的client io线程, 和server的io线程绑定在同一个cpu上
+            std::vector<int32_t> coreCpus;
+            for (uint32_t i = 0; i < this->config.ioThreadCount; ++i) {
+                coreCpus.push_back(cpus[i % cpus.size()]);
+            }
+            Client::MyCommunicator::GetInstance()->initializeCores(coreCpus);
+            return this->loopManager->initialize(this->config.ioThreadCount, this->config.busyPollMicros, true,
+                    [](uint32_t index) {
+                        //handler在io线程执行, 通过getLocalServantProxy使用当前core的proxy
+                        Client::MyCommunicator::setLocalCore(static_cast<int32_t >(index));
+                    });
         }
 
         int32_t MyServer::startServer() {
@@ -25,6 +50,11 @@ namespace MF {
                     it->second->startServant();
                 }
             }
+
+            //2. 启动其他io线程上的副本
+            for (auto it = replicaServants.begin(); it != replicaServants.end(); ++it) {
+                (*it)->startServant();
+            }
             return 0;
         }
 
@@ -49,6 +79,9 @@ namespace MF {
                         LOG(INFO) << "sync servant, name: " << it->first << std::endl;
                         it->second->syncServant(config.routeServantName);
                     }
+
+                    //过载状态变化时通知路由服务
+                    it->second->syncStatus(config.routeServantName);
                 }
 
                 //sleep1秒
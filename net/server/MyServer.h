@@ -9,6 +9,7 @@
 #ifndef myserver_h
 #define myserver_h
 
+#include <set>
 #include "util/MyCommon.h"
 #include "util/MyThreadPool.h"
 #include "net/server/MyServant.h"
@@ -22,6 +23,11 @@ namespace MF {
          */
         struct ServerConfig {
             uint32_t ioThreadCount{0}; //io线程数
+            uint32_t busyPollMicros{0}; //io线程忙轮询时长(微秒), 0表示不忙轮询
+            //每个io线程一份servant, 连接,handler,buffer池和client proxy都不跨core, io线程绑定cpu
+            //该模式下必须通过dispatcherFactory为每个副本构造dispatcher
+            bool threadPerCore{false};
+            LoopBackend loopBackend{kLoopBackendEpoll}; //io线程的事件后端, io_uring时tcp连接的收发由io_uring完成
             std::string routeServantName; //route servant name
         };
 
@@ -38,13 +44,22 @@ namespace MF {
             int32_t initServer(const ServerConfig& config);
 
             /**
-             * 构造servant
+             * 构造servant, threadPerCore模式下有多个io线程时不能共享dispatcher, 需要使用dispatcherFactory
              * @param config servant 配置
              * @return 0 成功 其他 失败
              */
             template<typename Servant>
             int32_t addServant(const ServantConfig &config, MyDispatcher *dispatcher);
 
+            /**
+             * 构造servant, threadPerCore模式下每个servant副本使用自己的dispatcher
+             * @param config servant 配置
+             * @param dispatcherFactory 构造dispatcher的函数, 每次调用必须返回新的dispatcher
+             * @return 0 成功 其他 失败
+             */
+            template<typename Servant>
+            int32_t addServant(const ServantConfig &config, std::function<MyDispatcher*()> dispatcherFactory);
+
             /**
              * 启动服务
              * @return 0 成功 其他 失败
@@ -57,26 +72,60 @@ namespace MF {
             void wait();
         protected:
             std::map<std::string, MyServant*> servantMap;//服务列表
+            std::vector<MyServant*> replicaServants; //threadPerCore模式下其他io线程上的servant副本
             EventLoopManager* loopManager {nullptr}; //事件循环列表
             ServerConfig config; //server配置
         };
 
         template <typename Servant>
         int32_t MyServer::addServant(const MF::Server::ServantConfig &config, MyDispatcher *dispatcher) {
-            //1. new 一个对象
-            MyServant* servant = new Servant(this->loopManager, dispatcher);
-
-            //2. 初始化servant
-            int32_t rv = servant->initialize(config);
-            if (rv != 0) {
-                LOG(ERROR) << "initialize servant fail, name: " << config.name
-                           << ", host: "  << config.host << ", port: " << config.port << std::endl;
-                return rv;
+            //dispatcher在每个副本初始化时会被修改, 不能在多个core之间共享
+            if (this->config.threadPerCore && loopManager->size() > 1) {
+                LOG(ERROR) << "threadPerCore needs a dispatcher factory, name: " << config.name << std::endl;
+                return -1;
             }
 
-            //3. 将servant 保存起来
-            servantMap[config.name] = servant;
-            return rv;
+            return addServant<Servant>(config, [dispatcher]() -> MyDispatcher* {
+                return dispatcher;
+            });
+        }
+
+        template <typename Servant>
+        int32_t MyServer::addServant(const MF::Server::ServantConfig &config,
+                std::function<MyDispatcher*()> dispatcherFactory) {
+            //普通模式只有一个servant, threadPerCore模式每个io线程一个
+            uint32_t count = this->config.threadPerCore ? loopManager->size() : 1;
+            std::set<MyDispatcher*> dispatchers;
+            for (uint32_t i = 0; i < count; ++i) {
+                //1. 每个副本一个dispatcher
+                auto dispatcher = dispatcherFactory();
+                if (dispatcher == nullptr || !dispatchers.insert(dispatcher).second) {
+                    LOG(ERROR) << "dispatcher factory must return a new dispatcher, name: " << config.name << std::endl;
+                    return -1;
+                }
+
+                //2. new 一个对象
+                MyServant* servant = new Servant(this->loopManager, dispatcher);
+                if (this->config.threadPerCore) {
+                    servant->pinToLoop(loopManager->get(i));
+                }
+
+                //3. 初始化servant
+                int32_t rv = servant->initialize(config);
+                if (rv != 0) {
+                    LOG(ERROR) << "initialize servant fail, name: " << config.name
+                               << ", host: "  << config.host << ", port: " << config.port << std::endl;
+                    return rv;
+                }
+
+                //4. 将servant 保存起来, 第一个负责注册和同步
+                if (i == 0) {
+                    servantMap[config.name] = servant;
+                } else {
+                    replicaServants.push_back(servant);
+                }
+            }
+            return 0;
         }
     }
 }
@@ -0,0 +1,137 @@
+//
+// Created by mingweiliu on 2019/1/17.
+//
+
+#include "net/server/MyUdpBatch.h"
+
+namespace MF {
+    namespace Server {
+        MyUdpSendBatch::MyUdpSendBatch(Socket::MySocket *socket, uint32_t capacity)
+        : socket(socket), capacity(capacity > 0 ? capacity : 1) {
+            packets.reserve(this->capacity);
+            addrs.reserve(this->capacity);
+            addrLens.reserve(this->capacity);
+        }
+
+        void MyUdpSendBatch::add(const sockaddr_storage &addr, socklen_t addrLen, std::unique_ptr<Buffer::MyIOBuf> iobuf) {
+            if (socket == nullptr) {
+                return; //servant已经停止
+            }
+
+            packets.push_back(std::move(iobuf));
+            addrs.push_back(addr);
+            addrLens.push_back(addrLen);
+            if (packets.size() >= capacity) {
+                flush();
+            }
+        }
+
+        void MyUdpSendBatch::close() {
+            socket = nullptr;
+            packets.clear();
+            addrs.clear();
+            addrLens.clear();
+        }
+
+        void MyUdpSendBatch::flush() {
+            if (packets.empty() || socket == nullptr) {
+                return;
+            }
+
+#ifdef __linux__
+            //1. 每个响应一个iovec, 开启GSO时可以合并的响应共用一个mmsghdr
+            std::vector<struct iovec> iov(packets.size());
+            std::vector<struct mmsghdr> msgs;
+            std::vector<size_t> firsts; //每个消息的第一个响应的下标
+            std::vector<char> control(packets.size() * CMSG_SPACE(sizeof(uint16_t)), 0);
+            msgs.reserve(packets.size());
+            for (size_t i = 0; i < packets.size(); ++i) {
+                iov[i].iov_base = packets[i]->readable();
+                iov[i].iov_len = packets[i]->getReadableLength();
+            }
+
+            for (size_t i = 0; i < packets.size(); ) {
+                auto count = segment ? segmentRun(i) : 1;
+
+                struct mmsghdr msg;
+                bzero(&msg, sizeof(msg));
+                auto& hdr = msg.msg_hdr;
+                hdr.msg_name = &addrs[i];
+                hdr.msg_namelen = addrLens[i];
+                hdr.msg_iov = &iov[i];
+                hdr.msg_iovlen = count;
+
+                //由内核按照第一个响应的长度切分
+                if (count > 1) {
+                    hdr.msg_control = &control[msgs.size() * CMSG_SPACE(sizeof(uint16_t))];
+                    hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+                    auto cmsg = CMSG_FIRSTHDR(&hdr);
+                    cmsg->cmsg_level = SOL_UDP;
+                    cmsg->cmsg_type = UDP_SEGMENT;
+                    cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                    auto size = static_cast<uint16_t >(iov[i].iov_len);
+                    memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+                }
+
+                msgs.push_back(msg);
+                firsts.push_back(i);
+                i += count;
+            }
+
+            //2. 发送, 发送失败的数据包直接丢弃
+            uint32_t sent = 0;
+            while (sent < msgs.size()) {
+                auto rv = socket->writeMany(&msgs[sent], static_cast<uint32_t >(msgs.size() - sent));
+                if (rv <= 0) {
+                    //网卡或者内核不支持GSO, 关闭之后剩下的响应单独发送
+                    if (segment && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                        LOG(ERROR) << "udp segment offload fail, disable it, error: " << strerror(errno) << std::endl;
+                        segment = false;
+                        packets.erase(packets.begin(), packets.begin() + firsts[sent]);
+                        addrs.erase(addrs.begin(), addrs.begin() + firsts[sent]);
+                        addrLens.erase(addrLens.begin(), addrLens.begin() + firsts[sent]);
+                        flush();
+                        return;
+                    }
+
+                    LOG(ERROR) << "send udp packets fail, dropped: " << msgs.size() - sent
+                               << ", error: " << strerror(errno) << std::endl;
+                    break;
+                }
+                sent += rv;
+            }
+#else
+            for (size_t i = 0; i < packets.size(); ++i) {
+                if (socket->writeTo(reinterpret_cast<sockaddr*>(&addrs[i]), addrLens[i],
+                        packets[i]->readable(), packets[i]->getReadableLength()) <= 0) {
+                    LOG(ERROR) << "send udp packet fail, error: " << strerror(errno) << std::endl;
+                }
+            }
+#endif
+
+            packets.clear();
+            addrs.clear();
+            addrLens.clear();
+        }
+
+        size_t MyUdpSendBatch::segmentRun(size_t start) const {
+            //除了最后一个, 其他的响应长度必须相同, 总长度不能超过一个udp数据包
+            auto size = packets[start]->getReadableLength();
+            auto total = size;
+            size_t end = start + 1;
+            while (end < packets.size() && end - start < g_max_udp_gso_segments) {
+                auto length = packets[end]->getReadableLength();
+                if (length == 0 || length > size
+                    || packets[end - 1]->getReadableLength() != size
+                    || total + length > g_max_udp_offload_length - 48 //ip头和udp头
+                    || addrLens[end] != addrLens[start]
+                    || memcmp(&addrs[end], &addrs[start], addrLens[start]) != 0) {
+                    break;
+                }
+                total += length;
+                ++end;
+            }
+            return end - start;
+        }
+    }
+}
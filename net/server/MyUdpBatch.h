@@ -0,0 +1,76 @@
+//
+// Created by mingweiliu on 2019/1/17.
+//
+
+#ifndef MYFRAMEWORK2_MYUDPBATCH_H
+#define MYFRAMEWORK2_MYUDPBATCH_H
+
+#include <vector>
+#include <memory>
+#include "net/MyGlobal.h"
+#include "net/socket/MySocket.h"
+#include "net/buffer/myIOBuf.h"
+
+namespace MF {
+    namespace Server {
+
+        /**
+         * udp响应的批量发送
+         * 每个loop一个, loop发送完所有待发送的channel之后用一次sendmmsg发出, 只在io线程访问
+         */
+        class MyUdpSendBatch {
+        public:
+            /**
+             * 构造函数
+             * @param socket udp servant的socket, 不持有
+             * @param capacity 一次sendmmsg最多发送的数据包个数
+             */
+            MyUdpSendBatch(Socket::MySocket* socket, uint32_t capacity);
+
+            /**
+             * 放入一个响应, 满了之后立刻发送
+             * @param addr 对端地址
+             * @param addrLen 对端地址长度
+             * @param iobuf 响应
+             */
+            void add(const sockaddr_storage& addr, socklen_t addrLen, std::unique_ptr<Buffer::MyIOBuf> iobuf);
+
+            /**
+             * 发送所有的响应
+             */
+            void flush();
+
+            /**
+             * servant停止时调用, 丢弃未发送的响应, 之后不再访问socket
+             */
+            void close();
+
+            /**
+             * 开启GSO, 同一个对端连续的等长响应合并成一个消息发送, 由内核切分
+             * @param flag true 开启
+             */
+            void setSegment(bool flag) {
+                segment = flag;
+            }
+
+        protected:
+            /**
+             * 计算从start开始可以合并发送的响应个数
+             * @param start 开始的下标
+             * @return 个数, 至少为1
+             */
+            size_t segmentRun(size_t start) const;
+
+        protected:
+            Socket::MySocket* socket {nullptr}; //udp socket
+            uint32_t capacity {0}; //一次最多发送的数据包个数
+            bool segment {false}; //是否开启GSO
+
+            std::vector<std::unique_ptr<Buffer::MyIOBuf>> packets; //待发送的响应
+            std::vector<sockaddr_storage> addrs; //响应的对端地址
+            std::vector<socklen_t> addrLens; //对端地址的长度
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYUDPBATCH_H
@@ -0,0 +1,246 @@
+//
+// Created by mingweiliu on 2019/1/18.
+//
+
+#ifndef MYFRAMEWORK2_MYUDPPEERTABLE_H
+#define MYFRAMEWORK2_MYUDPPEERTABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+namespace MF {
+    namespace Server {
+
+        /**
+         * udp对端的地址, 直接使用sockaddr中的二进制数据, 支持ipv4和ipv6
+         */
+        struct MyUdpPeerKey {
+            uint16_t family {0}; //AF_INET 或者 AF_INET6
+            uint16_t port {0}; //网络字节序
+            uint32_t scope {0}; //ipv6的scope id
+            uint8_t addr[16] {0}; //ipv4只使用前4个字节
+
+            /**
+             * 从sockaddr构造
+             * @param sa 地址
+             * @param len 地址长度
+             * @param key 构造的key
+             * @return true 成功 false 不支持的地址类型
+             */
+            static bool make(const sockaddr* sa, socklen_t len, MyUdpPeerKey& key) {
+                if (sa->sa_family == AF_INET && len >= sizeof(sockaddr_in)) {
+                    auto in = reinterpret_cast<const sockaddr_in*>(sa);
+                    key = MyUdpPeerKey();
+                    key.family = AF_INET;
+                    key.port = in->sin_port;
+                    memcpy(key.addr, &in->sin_addr, sizeof(in->sin_addr));
+                    return true;
+                }
+
+                if (sa->sa_family == AF_INET6 && len >= sizeof(sockaddr_in6)) {
+                    auto in6 = reinterpret_cast<const sockaddr_in6*>(sa);
+                    key = MyUdpPeerKey();
+                    key.family = AF_INET6;
+                    key.port = in6->sin6_port;
+                    key.scope = in6->sin6_scope_id;
+                    memcpy(key.addr, &in6->sin6_addr, sizeof(in6->sin6_addr));
+                    return true;
+                }
+                return false;
+            }
+
+            /**
+             * 转换成sockaddr, 用于发送
+             * @param ss 地址
+             * @return 地址长度
+             */
+            socklen_t toSockaddr(sockaddr_storage& ss) const {
+                memset(&ss, 0, sizeof(ss));
+                if (family == AF_INET6) {
+                    auto in6 = reinterpret_cast<sockaddr_in6*>(&ss);
+                    in6->sin6_family = AF_INET6;
+                    in6->sin6_port = port;
+                    in6->sin6_scope_id = scope;
+                    memcpy(&in6->sin6_addr, addr, sizeof(in6->sin6_addr));
+                    return sizeof(sockaddr_in6);
+                }
+
+                auto in = reinterpret_cast<sockaddr_in*>(&ss);
+                in->sin_family = AF_INET;
+                in->sin_port = port;
+                memcpy(&in->sin_addr, addr, sizeof(in->sin_addr));
+                return sizeof(sockaddr_in);
+            }
+
+            /**
+             * 获取ip, 只用于日志
+             * @return ip
+             */
+            std::string getIp() const {
+                char buf[INET6_ADDRSTRLEN] = {0};
+                inet_ntop(family == AF_INET6 ? AF_INET6 : AF_INET, addr, buf, sizeof(buf));
+                return buf;
+            }
+
+            /**
+             * 获取端口
+             * @return 端口, 主机字节序
+             */
+            uint16_t getPort() const {
+                return ntohs(port);
+            }
+
+            /**
+             * 计算hash值, FNV-1a
+             * @return hash
+             */
+            uint64_t hash() const {
+                auto bytes = reinterpret_cast<const uint8_t*>(this);
+                uint64_t h = 14695981039346656037ULL;
+                for (size_t i = 0; i < sizeof(MyUdpPeerKey); ++i) {
+                    h = (h ^ bytes[i]) * 1099511628211ULL;
+                }
+                return h;
+            }
+
+            bool operator == (const MyUdpPeerKey& r) const {
+                return memcmp(this, &r, sizeof(MyUdpPeerKey)) == 0;
+            }
+        };
+
+        /**
+         * 以对端地址为key的开放寻址hash表, 线性探测, 删除时向前移动后面的元素, 不使用墓碑
+         * 非线程安全, 只能在一个线程中使用
+         */
+        template<typename V>
+        class MyUdpPeerTable {
+        public:
+            /**
+             * 构造函数
+             * @param capacity 初始容量, 会调整为2的幂
+             */
+            explicit MyUdpPeerTable(uint32_t capacity = 1024) {
+                uint32_t cap = 16;
+                while (cap < capacity) {
+                    cap <<= 1;
+                }
+                slots.resize(cap);
+            }
+
+            /**
+             * 查找
+             * @param key key
+             * @return value, 不存在时返回nullptr
+             */
+            V* find(const MyUdpPeerKey& key) {
+                auto mask = slots.size() - 1;
+                for (auto i = key.hash() & mask; slots[i].used; i = (i + 1) & mask) {
+                    if (slots[i].key == key) {
+                        return &slots[i].value;
+                    }
+                }
+                return nullptr;
+            }
+
+            /**
+             * 插入或者覆盖
+             * @param key key
+             * @param value value
+             */
+            void insert(const MyUdpPeerKey& key, V value) {
+                //负载超过一半时扩容
+                if ((count + 1) * 2 > slots.size()) {
+                    rehash(slots.size() * 2);
+                }
+
+                auto mask = slots.size() - 1;
+                auto i = key.hash() & mask;
+                for (; slots[i].used; i = (i + 1) & mask) {
+                    if (slots[i].key == key) {
+                        slots[i].value = std::move(value);
+                        return;
+                    }
+                }
+
+                slots[i].used = true;
+                slots[i].key = key;
+                slots[i].value = std::move(value);
+                ++count;
+            }
+
+            /**
+             * 删除
+             * @param key key
+             * @return true 成功 false 不存在
+             */
+            bool erase(const MyUdpPeerKey& key) {
+                auto mask = slots.size() - 1;
+                auto i = key.hash() & mask;
+                for (; slots[i].used; i = (i + 1) & mask) {
+                    if (slots[i].key == key) {
+                        break;
+                    }
+                }
+                if (!slots[i].used) {
+                    return false;
+                }
+
+                //把后面探测链上的元素往前移动, 保证查找不会提前结束
+                auto hole = i;
+                for (auto j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+                    auto home = slots[j].key.hash() & mask;
+                    //home不在(hole, j]之间时可以移动到hole
+                    if (((j - home) & mask) >= ((j - hole) & mask)) {
+                        slots[hole] = std::move(slots[j]);
+                        hole = j;
+                    }
+                }
+
+                slots[hole] = Slot();
+                --count;
+                return true;
+            }
+
+            /**
+             * 获取元素个数
+             * @return 个数
+             */
+            size_t size() const {
+                return count;
+            }
+
+        private:
+            struct Slot {
+                bool used {false};
+                MyUdpPeerKey key;
+                V value {};
+            };
+
+            /**
+             * 扩容
+             * @param capacity 新的容量
+             */
+            void rehash(size_t capacity) {
+                std::vector<Slot> old(capacity);
+                old.swap(slots);
+                count = 0;
+                for (auto it = old.begin(); it != old.end(); ++it) {
+                    if (it->used) {
+                        insert(it->key, std::move(it->value));
+                    }
+                }
+            }
+
+        private:
+            std::vector<Slot> slots; //所有的slot, 个数是2的幂
+            size_t count {0}; //元素个数
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYUDPPEERTABLE_H
@@ -8,6 +8,8 @@
 
 #include "MySocket.h"
 #include <errno.h>
+#include <cstring>
+#include <vector>
 
 namespace MF {
     namespace Socket {
@@ -27,6 +29,34 @@ namespace MF {
         }
 
         int32_t MySocket::bind(const std::string &host, uint16_t port) {
+            local_.host = host;
+            local_.port = port;
+            
+            //设置reuse
+            setReuseAddr(true);
+
+            //unix socket, host为文件路径
+            if (domain == AF_UNIX) {
+                sockaddr_un addrUn;
+                socklen_t len = 0;
+                if (unixAddress(host, &addrUn, &len) != 0) {
+                    return -1;
+                }
+                return ::bind(fd, (struct sockaddr*)(&addrUn), len);
+            }
+
+            //ipv6
+            if (domain == AF_INET6) {
+                sockaddr_in6 addr6;
+                bzero(&addr6, sizeof(addr6));
+                addr6.sin6_family = AF_INET6;
+                addr6.sin6_port = htons(port);
+                if (inet_pton(AF_INET6, host.c_str(), &addr6.sin6_addr) != 1) {
+                    return -1;
+                }
+                return ::bind(fd, (struct sockaddr*)(&addr6), sizeof(addr6));
+            }
+
             sockaddr_in addr;
             bzero(&addr, sizeof(addr));
             
@@ -34,12 +64,6 @@ namespace MF {
             addr.sin_addr.s_addr = inet_addr(host.c_str());
             addr.sin_port = htons(port);
             
-            local_.host = host;
-            local_.port = port;
-            
-            //设置reuse
-            setReuseAddr(true);
-            
             return ::bind(fd, (struct sockaddr*)(&addr), sizeof(struct sockaddr));
         }
         
@@ -62,7 +86,18 @@ namespace MF {
             remote.host = host;
             remote.port = port;
             
-            int32_t rv = ::connect(fd, (struct sockaddr*)(&addr), sizeof(struct sockaddr));
+            int32_t rv = 0;
+            if (domain == AF_UNIX) {
+                //unix socket, host为文件路径, 连接立即完成
+                sockaddr_un addrUn;
+                socklen_t len = 0;
+                if (unixAddress(host, &addrUn, &len) != 0) {
+                    return -1;
+                }
+                rv = ::connect(fd, (struct sockaddr*)(&addrUn), len);
+            } else {
+                rv = ::connect(fd, (struct sockaddr*)(&addr), sizeof(struct sockaddr));
+            }
             
             if (rv != 0) { //如果出错了，则抛出异常
                 auto err = errno;
@@ -86,21 +121,66 @@ namespace MF {
             return error;
         }
         
-        int32_t MySocket::accept(MySocket* client) {
+        MySocket* MySocket::accept() {
             
             struct sockaddr_in raddr;
             bzero(&raddr, sizeof(struct sockaddr_in));
             socklen_t len = sizeof(raddr);
             
+#ifdef __linux__
+            //一次系统调用完成accept和设置非阻塞
+            auto fd = ::accept4(this->fd,(struct sockaddr*)(&raddr), &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
             auto fd = ::accept(this->fd,(struct sockaddr*)(&raddr), &len);
-            if (fd == 0) {
-                return -1;
+#endif
+            if (fd < 0) {
+                return nullptr; //errno为EAGAIN时表示已经没有新的连接
             }
+
+            return newAccepted(fd, raddr);
+        }
+
+        MySocket* MySocket::adopt(int32_t fd) {
+            struct sockaddr_in raddr;
+            bzero(&raddr, sizeof(struct sockaddr_in));
+            socklen_t len = sizeof(raddr);
+            if (domain != AF_UNIX) {
+                ::getpeername(fd, (struct sockaddr*)(&raddr), &len);
+            }
+            return newAccepted(fd, raddr);
+        }
+
+        MySocket* MySocket::newAccepted(int32_t fd, const struct sockaddr_in& raddr) {
+            auto client = new MySocket();
             client->fd = fd;
+            client->domain = domain;
+            client->type = type;
+            client->protocol = protocol;
             client->isConnected = true;
+#ifndef __linux__
+            client->setNonBlock();
+#endif
             
+            if (domain == AF_UNIX) {
+                //unix socket的对端没有地址, 使用监听的路径
+                client->remote.host = local_.host;
+                client->remote.port = 0;
+                return client;
+            }
             client->remote.host = inet_ntoa(raddr.sin_addr);
             client->remote.port = ntohs(raddr.sin_port);
+            return client;
+        }
+
+        int32_t MySocket::unixAddress(const std::string &path, sockaddr_un *addr, socklen_t *len) {
+            bzero(addr, sizeof(sockaddr_un));
+            if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+                errno = ENAMETOOLONG;
+                return -1;
+            }
+            addr->sun_family = AF_UNIX;
+            memcpy(addr->sun_path, path.data(), path.size());
+            *len = static_cast<socklen_t >(offsetof(sockaddr_un, sun_path) + path.size() + 1);
             return 0;
         }
         
@@ -108,6 +188,10 @@ namespace MF {
             return static_cast<int32_t >(::write(fd, buffer, length));
         }
         
+        int32_t MySocket::writev(const struct iovec *iov, int32_t count) {
+            return static_cast<int32_t >(::writev(fd, iov, count));
+        }
+
         int32_t MySocket::writeTo(const std::string &host, uint16_t port, void *buffer, uint32_t length) {
             
             struct sockaddr_in addr;
@@ -126,10 +210,28 @@ namespace MF {
                     ::sendto(fd, buffer, length, 0, addr, sizeof(sockaddr)));
         }
         
+        int32_t MySocket::writeTo(const struct sockaddr *addr, socklen_t addrLen, void *buffer, uint32_t length) {
+            return static_cast<int32_t >(::sendto(fd, buffer, length, 0, addr, addrLen));
+        }
+        
         int32_t MySocket::read(void *buffer, uint32_t size) {
             return static_cast<int32_t >(::read(fd, buffer, size));
         }
         
+        int32_t MySocket::readv(const struct iovec *iov, int32_t count) {
+            return static_cast<int32_t >(::readv(fd, iov, count));
+        }
+
+        int32_t MySocket::readMsg(const struct iovec *iov, int32_t count, int32_t *flags) {
+            struct msghdr msg;
+            bzero(&msg, sizeof(msg));
+            msg.msg_iov = const_cast<struct iovec*>(iov);
+            msg.msg_iovlen = static_cast<size_t >(count);
+            auto rv = static_cast<int32_t >(::recvmsg(fd, &msg, 0));
+            *flags = msg.msg_flags;
+            return rv;
+        }
+
         int32_t MySocket::readFrom(struct sockaddr *addr, socklen_t *addr_len, void *buffer, uint32_t size) {
             return static_cast<int32_t >(::recvfrom(fd, buffer, size, 0, addr, addr_len));
         }
@@ -140,6 +242,109 @@ namespace MF {
             return static_cast<uint32_t >(::recvfrom(fd, buf, len, MSG_PEEK, addr, addrLen));
         }
         
+#ifdef __linux__
+        int32_t MySocket::readMany(struct mmsghdr *msgs, uint32_t count) {
+            return static_cast<int32_t >(::recvmmsg(fd, msgs, count, MSG_DONTWAIT, nullptr));
+        }
+
+        int32_t MySocket::writeMany(struct mmsghdr *msgs, uint32_t count) {
+            return static_cast<int32_t >(::sendmmsg(fd, msgs, count, MSG_DONTWAIT));
+        }
+
+        uint32_t MySocket::getUdpGroSize(const struct msghdr *msg) {
+            //内核合并了多个数据包时才会带上UDP_GRO, 值为每个数据包的长度, 最后一个可以更短
+            for (auto cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr;
+                 cmsg = CMSG_NXTHDR(const_cast<struct msghdr*>(msg), cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int32_t size = 0;
+                    memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+                    return size > 0 ? static_cast<uint32_t >(size) : 0;
+                }
+            }
+            return 0;
+        }
+#endif
+
+        int32_t MySocket::writeFds(const int32_t *fds, uint32_t count, const void *buffer, uint32_t length) {
+            //1. 至少要有一个字节的数据, fd才能随着数据一起发送
+            struct iovec iov;
+            iov.iov_base = const_cast<void*>(buffer);
+            iov.iov_len = length;
+
+            std::vector<char> control(CMSG_SPACE(sizeof(int32_t) * count), 0);
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+
+            //2. 设置SCM_RIGHTS
+            auto cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int32_t) * count);
+            memcpy(CMSG_DATA(cmsg), fds, sizeof(int32_t) * count);
+
+            return static_cast<int32_t >(::sendmsg(fd, &msg, MSG_DONTWAIT));
+        }
+
+        int32_t MySocket::readFds(int32_t *fds, uint32_t *count, void *buffer, uint32_t size) {
+            struct iovec iov;
+            iov.iov_base = buffer;
+            iov.iov_len = size;
+
+            std::vector<char> control(CMSG_SPACE(sizeof(int32_t) * (*count)), 0);
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+
+            auto rv = static_cast<int32_t >(::recvmsg(fd, &msg, MSG_DONTWAIT));
+            uint32_t received = 0;
+            if (rv > 0) {
+                //取出所有SCM_RIGHTS里面的fd, 超过容量的直接关闭
+                for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                        continue;
+                    }
+                    auto n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+                    auto data = reinterpret_cast<int32_t*>(CMSG_DATA(cmsg));
+                    for (size_t i = 0; i < n; ++i) {
+                        if (received < *count) {
+                            fds[received++] = data[i];
+                        } else {
+                            ::close(data[i]);
+                        }
+                    }
+                }
+            }
+            *count = received;
+            return rv;
+        }
+
+        int32_t MySocket::setUdpGro(bool flag) {
+#ifdef __linux__
+            int32_t value = flag ? 1 : 0;
+            return ::setsockopt(fd, SOL_UDP, UDP_GRO, &value, sizeof(value)) == 0 ? 0 : -1;
+#else
+            return -1;
+#endif
+        }
+
+        bool MySocket::supportUdpSegment() const {
+#ifdef __linux__
+            //老的内核不认识这个选项, 返回ENOPROTOOPT
+            int32_t value = 0;
+            socklen_t len = sizeof(value);
+            return ::getsockopt(fd, SOL_UDP, UDP_SEGMENT, &value, &len) == 0;
+#else
+            return false;
+#endif
+        }
+
         void MySocket::setSockOpt(int32_t level, int32_t option_name, int32_t value) {
             setsockopt(fd, level, option_name, (void*)(&value), sizeof(value));
         }
@@ -19,6 +19,16 @@
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/uio.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 //linux 4.18
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104 //linux 5.0
+#endif
+#endif
 
 #include <string>
 
@@ -51,8 +61,8 @@ namespace MF {
             /**
              *  @brief 绑定一个本地地址
              *
-             *  @param host 本机ip
-             *  @param port 本地端口
+             *  @param host 本机ip, unix socket时为socket文件的路径
+             *  @param port 本地端口, unix socket时忽略
              *
              */
             int32_t bind(const std::string& host, uint16_t port);
@@ -76,8 +86,8 @@ namespace MF {
             /**
              *  @brief 连接到一个端口
              *
-             *  @param host 对端ip
-             *  @param port 对端端口
+             *  @param host 对端ip, unix socket时为socket文件的路径
+             *  @param port 对端端口, unix socket时忽略
              *
              */
             int32_t connect(const std::string& host, uint16_t port);
@@ -89,11 +99,21 @@ namespace MF {
             int32_t getConnectResult() const ;
             
             /**
-             *  @brief 接受一个新的连接
+             *  @brief 接受一个新的连接, 新连接已经设置为非阻塞
+             *  accept成功之后才分配socket对象, 没有等待的连接时不分配
+             *
+             *  @return 新的连接, 由调用者释放 nullptr 失败, errno为EAGAIN时表示没有等待的连接
+             */
+            MySocket* accept();
+
+            /**
+             *  @brief 接管在其他地方accept的连接, 例如io_uring的accept, fd需要已经设置为非阻塞
+             *
+             *  @param fd 新连接的fd
              *
-             *  @param socket 新的连接
+             *  @return 新的连接, 由调用者释放
              */
-            int32_t accept(MySocket* socket);
+            MySocket* adopt(int32_t fd);
             
             /**
              *  @brief 重用地址
@@ -108,6 +128,20 @@ namespace MF {
             void setReusePort(bool flag) {
                 setSockOpt(SOL_SOCKET, SO_REUSEPORT, flag ? 1 : 0);
             }
+            /**
+             *  @brief 开启udp GRO, 内核把同一个对端的多个数据包合并之后一次读取
+             *
+             *  @return 0 成功 -1 内核不支持
+             */
+            int32_t setUdpGro(bool flag);
+
+            /**
+             *  @brief 检查内核是否支持udp GSO(UDP_SEGMENT)
+             *
+             *  @return true 支持
+             */
+            bool supportUdpSegment() const;
+
             /**
              *  @brief 设置保活
              */
@@ -218,6 +252,16 @@ namespace MF {
              */
             int32_t write(void* buffer, uint32_t length);
             
+            /**
+             *  @brief 一次写入多段数据
+             *
+             *  @param iov iovec数组
+             *  @param count iovec个数
+             *
+             *  @return 写入的数据长度
+             */
+            int32_t writev(const struct iovec* iov, int32_t count);
+
             /**
              *  @brief 发送数据 UDP, 失败时抛出异常
              *
@@ -242,6 +286,18 @@ namespace MF {
              */
             int32_t writeTo(struct sockaddr *addr, void *buffer, uint32_t length);
 
+            /**
+             *  @brief 发送数据 UDP, 支持ipv6
+             *
+             *  @param addr     对端地址
+             *  @param addrLen  对端地址长度
+             *  @param buffer   buffer
+             *  @param length   buffer长度
+             *
+             *  @return 写入的数据长度
+             */
+            int32_t writeTo(const struct sockaddr *addr, socklen_t addrLen, void *buffer, uint32_t length);
+
             /**
              *  @brief 读取一段数据
              *
@@ -252,6 +308,27 @@ namespace MF {
              */
             int32_t read(void* buffer, uint32_t size);
             
+            /**
+             *  @brief 读取数据到多段buffer
+             *
+             *  @param iov iovec数组
+             *  @param count iovec个数
+             *
+             *  @return 读取到的字节数
+             */
+            int32_t readv(const struct iovec* iov, int32_t count);
+
+            /**
+             *  @brief 使用recvmsg读取数据到多段buffer, 可以得到消息是否被截断
+             *
+             *  @param iov iovec数组
+             *  @param count iovec个数
+             *  @param flags 返回msg_flags, 消息被截断时带有MSG_TRUNC
+             *
+             *  @return 读取到的字节数
+             */
+            int32_t readMsg(const struct iovec* iov, int32_t count, int32_t* flags);
+
             /**
              *  @brief 从某个socket读取消息
              *
@@ -271,6 +348,61 @@ namespace MF {
              * @return 消息的长度
              */
             int32_t peekFrom(struct sockaddr* addr, socklen_t *addrLen);
+
+#ifdef __linux__
+            /**
+             *  @brief 一次系统调用读取多个数据包, 不阻塞
+             *
+             *  @param msgs 数据包数组, 每个数据包的地址和buffer需要提前设置
+             *  @param count 数据包个数
+             *
+             *  @return 读取到的数据包个数, -1 失败
+             */
+            int32_t readMany(struct mmsghdr* msgs, uint32_t count);
+
+            /**
+             *  @brief 一次系统调用发送多个数据包, 不阻塞
+             *
+             *  @param msgs 数据包数组
+             *  @param count 数据包个数
+             *
+             *  @return 发送成功的数据包个数, -1 失败
+             */
+            int32_t writeMany(struct mmsghdr* msgs, uint32_t count);
+
+            /**
+             *  @brief 开启GRO之后, 从收到的消息的控制信息中获取每个数据包的长度
+             *
+             *  @param msg 收到的消息, 需要有CMSG_SPACE(sizeof(int32_t))的控制信息空间
+             *
+             *  @return 每个数据包的长度, 0表示只有一个数据包
+             */
+            static uint32_t getUdpGroSize(const struct msghdr* msg);
+#endif
+
+            /**
+             *  @brief 通过unix socket发送fd, 同时带一段数据
+             *
+             *  @param fds 需要发送的fd
+             *  @param count fd个数
+             *  @param buffer 数据, 不能为空
+             *  @param length 数据长度
+             *
+             *  @return 发送的字节数, -1 失败
+             */
+            int32_t writeFds(const int32_t* fds, uint32_t count, const void* buffer, uint32_t length);
+
+            /**
+             *  @brief 通过unix socket接收fd, 不阻塞
+             *
+             *  @param fds 接收到的fd
+             *  @param count 输入fds的容量, 返回接收到的fd个数
+             *  @param buffer 数据buffer
+             *  @param size buffer容量
+             *
+             *  @return 读取到的字节数, 0 对端关闭 -1 失败
+             */
+            int32_t readFds(int32_t* fds, uint32_t* count, void* buffer, uint32_t size);
             
             /**
              *  @brief 获取对端的ip
@@ -298,6 +430,15 @@ namespace MF {
             int32_t getfd() const {
                 return fd;
             }
+
+            /**
+             *  @brief 获取socket类型
+             *
+             *  @return SOCK_STREAM、SOCK_DGRAM、SOCK_SEQPACKET
+             */
+            int32_t getType() const {
+                return type;
+            }
             
             /**
              *  @brief 查看是否已经连接
@@ -322,6 +463,17 @@ namespace MF {
             }
             
         protected:
+            /**
+             *  @brief 构造unix socket的地址
+             *
+             *  @param path socket文件的路径
+             *  @param addr 地址
+             *  @param len 地址长度
+             *
+             *  @return 0 成功 -1 路径太长
+             */
+            static int32_t unixAddress(const std::string& path, sockaddr_un* addr, socklen_t* len);
+
             /**
              *  @brief 设置socket的属性
              *
@@ -331,6 +483,16 @@ namespace MF {
              *
              */
             void setSockOpt(int32_t level, int32_t option_name, int32_t value);
+
+            /**
+             *  @brief 为监听socket上accept到的fd构造socket对象
+             *
+             *  @param fd    新连接的fd
+             *  @param raddr 对端地址
+             *
+             *  @return 新的连接
+             */
+            MySocket* newAccepted(int32_t fd, const struct sockaddr_in& raddr);
             
             int32_t fd {0}; //描述符
             struct {
@@ -0,0 +1,54 @@
+//
+// Created by mingweiliu on 2019/1/23.
+//
+
+#include "net/socket/MySocketIO.h"
+#include <climits>
+#include <vector>
+
+namespace MF {
+    namespace Socket {
+        int32_t MySocketIO::writeFrame(MySocket *socket, Buffer::MyIOBufChain &queue, uint32_t length) {
+            //1. 只取消息自己的部分, 后面的消息留在队列中
+            struct iovec iov[IOV_MAX];
+            auto count = queue.readableIovec(iov, IOV_MAX);
+            uint32_t total = 0;
+            uint32_t used = 0;
+            for (; used < count && total < length; ++used) {
+                if (total + iov[used].iov_len > length) {
+                    iov[used].iov_len = length - total;
+                }
+                total += static_cast<uint32_t >(iov[used].iov_len);
+            }
+
+            //2. 消息的块太多, 拷贝成一段
+            if (total < length) {
+                iov[0].iov_base = spareBlock(length);
+                iov[0].iov_len = queue.peek(iov[0].iov_base, length);
+                used = 1;
+            }
+
+            int32_t rv;
+            do {
+                rv = socket->writev(iov, static_cast<int32_t >(used));
+            } while (rv < 0 && errno == EINTR);
+
+            //3. 消息是原子发送的, 发送成功之后释放
+            if (rv == static_cast<int32_t >(length)) {
+                queue.moveReadable(length);
+            } else if (rv >= 0) {
+                errno = EMSGSIZE; //按消息发送时不会只发送一部分
+                rv = -1;
+            }
+            return rv;
+        }
+
+        char* MySocketIO::spareBlock(uint32_t length) {
+            static thread_local std::vector<char> block;
+            if (block.size() < length) {
+                block.resize(length);
+            }
+            return block.data();
+        }
+    }
+}
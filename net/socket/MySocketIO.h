@@ -0,0 +1,93 @@
+//
+// Created by mingweiliu on 2019/1/23.
+//
+
+#ifndef MYFRAMEWORK2_MYSOCKETIO_H
+#define MYFRAMEWORK2_MYSOCKETIO_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "net/socket/MySocket.h"
+#include "net/buffer/MyIOBufChain.h"
+
+namespace MF {
+    namespace Socket {
+
+        /**
+         * tcp/unix socket的server和client共用的读写方法
+         */
+        class MySocketIO {
+        public:
+            /**
+             * 读取一次, 先读到buffer尾部的空闲空间, 空间不够want时多读到备用块, 再追加到buffer
+             * 不需要为了一次read整理或者扩容buffer
+             * 按消息读取(SOCK_SEQPACKET)时一次只返回一个消息, 消息被截断时返回-1, errno为EMSGSIZE
+             * @param socket socket
+             * @param tail buffer尾部空闲空间的指针
+             * @param tailLength 尾部空闲空间的长度
+             * @param want 尾部空间不够时读取的长度, 按消息读取时需要不小于最大的消息
+             * @param packet 是否按消息读取
+             * @param reserve char*(uint32_t length), 获取至少length字节的可写空间, 可能切换buffer
+             * @param commit void(uint32_t length), 移动buffer的写指针
+             * @return 读取到的字节数, 已经追加到buffer, 0 对端关闭 -1 失败
+             */
+            template <typename Reserve, typename Commit>
+            static int32_t read(MySocket* socket, char* tail, uint32_t tailLength, uint32_t want, bool packet,
+                                Reserve&& reserve, Commit&& commit) {
+                uint32_t extra = tailLength >= want ? 0 : want;
+
+                struct iovec iov[2];
+                int32_t count = 0;
+                if (tailLength > 0) {
+                    iov[count].iov_base = tail;
+                    iov[count++].iov_len = tailLength;
+                }
+                if (extra > 0) {
+                    iov[count].iov_base = spareBlock(extra);
+                    iov[count++].iov_len = extra;
+                }
+
+                //1. 读取, 按消息读取时需要检查是否被截断, 截断的部分已经丢失了
+                int32_t flags = 0;
+                auto read = socket->readMsg(iov, count, &flags);
+                if (read > 0 && packet && (flags & MSG_TRUNC)) {
+                    errno = EMSGSIZE;
+                    return -1;
+                }
+                if (read <= 0) {
+                    return read;
+                }
+
+                //2. 读到备用块的部分追加到buffer
+                auto length = static_cast<uint32_t >(read);
+                auto inTail = std::min(length, tailLength);
+                commit(inTail);
+                if (length > inTail) {
+                    memcpy(reserve(length - inTail), spareBlock(extra), length - inTail);
+                    commit(length - inTail);
+                }
+                return read;
+            }
+
+            /**
+             * 发送队列头部的一个消息, 用于SOCK_SEQPACKET, 一次系统调用正好是一个消息
+             * 成功之后才从队列中释放
+             * @param socket socket
+             * @param queue 发送队列
+             * @param length 消息的长度
+             * @return 发送的字节数, 成功时等于length, -1 失败, errno为EAGAIN时表示socket写满了
+             */
+            static int32_t writeFrame(MySocket* socket, Buffer::MyIOBufChain& queue, uint32_t length);
+
+            /**
+             * 尾部空间不够时使用的备用块, 每个线程一个
+             * @param length 需要的长度
+             * @return 备用块
+             */
+            static char* spareBlock(uint32_t length);
+        };
+    }
+}
+
+#endif //MYFRAMEWORK2_MYSOCKETIO_H
@@ -9,6 +9,10 @@
 #include "MyCommon.h"
 #include "MyTimeProvider.h"
 #include <fstream>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace MF {
     std::string MyCommon::trim(const std::string &str, const std::string &c) {
@@ -130,4 +134,38 @@ namespace MF {
         //2. 写入数据
         stream << str;
     }
+
+    std::vector<int32_t> MyCommon::getAllowedCpus() {
+        std::vector<int32_t> cpus;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int32_t i = 0; i < CPU_SETSIZE; ++i) {
+                if (CPU_ISSET(i, &set)) {
+                    cpus.push_back(i);
+                }
+            }
+        }
+#endif
+        //获取失败时使用所有的cpu
+        if (cpus.empty()) {
+            auto count = std::thread::hardware_concurrency();
+            for (uint32_t i = 0; i < (count > 0 ? count : 1); ++i) {
+                cpus.push_back(static_cast<int32_t >(i));
+            }
+        }
+        return cpus;
+    }
+
+    int32_t MyCommon::pinThread(std::thread::native_handle_type thread, int32_t cpu) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+        return 0; //其他平台不绑定
+#endif
+    }
 }
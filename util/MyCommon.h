@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
+#include <thread>
 #include <type_traits>
 #include <locale>
 
@@ -438,6 +439,23 @@ namespace MF {
          *  @param str  字符串
          */
         static void savefile(const std::string& file, const std::string& str);
+
+        /**
+         *  @brief 获取当前进程允许运行的cpu, 受taskset和cgroup限制
+         *
+         *  @return cpu编号列表, 获取失败时为0到hardware_concurrency-1
+         */
+        static std::vector<int32_t> getAllowedCpus();
+
+        /**
+         *  @brief 把线程绑定到一个cpu上
+         *
+         *  @param thread 线程的native handle
+         *  @param cpu cpu编号
+         *
+         *  @return 0 成功 其他失败
+         */
+        static int32_t pinThread(std::thread::native_handle_type thread, int32_t cpu);
         
         /**
          *  @brief 判断是否是digit
@@ -0,0 +1,117 @@
+//
+// Created by mingweiliu on 2019/1/28.
+//
+
+#ifndef MYFRAMEWORK2_MYEVENTCOUNT_H
+#define MYFRAMEWORK2_MYEVENTCOUNT_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace MF {
+    /// event count, 用于空闲线程等待新的任务
+    /// 等待方: prepareWait -> 再检查一次条件 -> 条件满足时cancelWait, 否则wait
+    /// 通知方: 修改条件 -> notify, 没有线程在等待时不需要系统调用
+    /// linux上使用futex, 其他平台使用条件变量
+    class MyEventCount {
+    public:
+        typedef uint32_t Key;
+
+        /**
+         *  @brief 准备等待, 之后需要再检查一次条件
+         *
+         *  @return 传给wait的key
+         */
+        Key prepareWait() {
+            waiters_.fetch_add(1, std::memory_order_seq_cst);
+            //和notify中的fence配对, 之后对条件的检查能看到notify之前的修改
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return epoch_.load(std::memory_order_seq_cst);
+        }
+
+        /**
+         *  @brief 条件已经满足, 不再等待
+         */
+        void cancelWait() {
+            waiters_.fetch_sub(1, std::memory_order_seq_cst);
+        }
+
+        /**
+         *  @brief 等待, prepareWait之后有notify时马上返回
+         *
+         *  @param key prepareWait返回的key
+         */
+        void wait(Key key) {
+#ifdef __linux__
+            while (epoch_.load(std::memory_order_acquire) == key) {
+                syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAIT_PRIVATE, key,
+                        nullptr, nullptr, 0);
+            }
+#else
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (epoch_.load(std::memory_order_acquire) == key) {
+                cond_.wait(lock);
+            }
+#endif
+            waiters_.fetch_sub(1, std::memory_order_seq_cst);
+        }
+
+        /**
+         *  @brief 唤醒一个等待的线程
+         */
+        void notifyOne() {
+            notify(1);
+        }
+
+        /**
+         *  @brief 唤醒所有等待的线程
+         */
+        void notifyAll() {
+            notify(INT32_MAX);
+        }
+
+    private:
+        void notify(int32_t count) {
+            //和prepareWait配对, 保证条件的修改和等待的线程至少有一方能看到对方
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiters_.load(std::memory_order_relaxed) == 0) {
+                return;
+            }
+
+#ifdef __linux__
+            epoch_.fetch_add(1, std::memory_order_release);
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_), FUTEX_WAKE_PRIVATE, count,
+                    nullptr, nullptr, 0);
+#else
+            {
+                std::lock_guard<std::mutex> guard(mutex_);
+                epoch_.fetch_add(1, std::memory_order_release);
+            }
+            if (count == 1) {
+                cond_.notify_one();
+            } else {
+                cond_.notify_all();
+            }
+#endif
+        }
+
+    private:
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+
+        std::atomic<uint32_t> epoch_ {0}; //每次notify加一, futex等待的地址
+        std::atomic<uint32_t> waiters_ {0}; //准备等待和正在等待的线程数
+#ifndef __linux__
+        std::mutex mutex_;
+        std::condition_variable cond_;
+#endif
+    };
+}
+
+#endif //MYFRAMEWORK2_MYEVENTCOUNT_H
@@ -0,0 +1,100 @@
+//
+// Created by mingweiliu on 2019/1/10.
+//
+
+#ifndef MYFRAMEWORK2_MYMPSCQUEUE_H
+#define MYFRAMEWORK2_MYMPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace MF {
+    /// 无锁的多生产者单消费者队列
+    /// 任意线程都可以push, 只有一个线程可以pop
+    /// push只有一次原子交换, 不会被其他生产者阻塞
+    template<typename T>
+    class MyMpscQueue {
+    private:
+        struct Node {
+            std::atomic<Node*> next {nullptr};
+            T value;
+
+            Node() = default;
+            explicit Node(T&& v) : value(std::move(v)) {}
+        };
+
+    public:
+        /**
+         *  @brief 构造函数
+         */
+        MyMpscQueue() {
+            auto stub = new Node();
+            head_.store(stub, std::memory_order_relaxed);
+            tail_ = stub;
+        }
+
+        /**
+         *  @brief 析构函数, 释放所有没有取出的数据
+         */
+        ~MyMpscQueue() {
+            while (tail_ != nullptr) {
+                auto next = tail_->next.load(std::memory_order_relaxed);
+                delete tail_;
+                tail_ = next;
+            }
+        }
+
+        /**
+         *  @brief 放数据到队列尾部, 可以在任意线程调用
+         *
+         *  @param t 对象
+         */
+        void push(T t) {
+            auto node = new Node(std::move(t));
+            //1. 先抢占队尾
+            auto prev = head_.exchange(node, std::memory_order_acq_rel);
+
+            //2. 再链接到前一个节点上, 在这之前消费者看不到该节点
+            prev->next.store(node, std::memory_order_release);
+        }
+
+        /**
+         *  @brief 从头部取出数据, 只能在消费者线程调用
+         *
+         *  @param t 取出的数据
+         *
+         *  @return true 成功 false 队列为空(或者生产者还没有完成链接)
+         */
+        bool pop(T& t) {
+            auto next = tail_->next.load(std::memory_order_acquire);
+            if (next == nullptr) {
+                return false;
+            }
+
+            //next成为新的哨兵节点
+            t = std::move(next->value);
+            delete tail_;
+            tail_ = next;
+            return true;
+        }
+
+        /**
+         *  @brief 队列是否为空, 只能在消费者线程调用
+         *
+         *  @return true 为空
+         */
+        bool empty() const {
+            return tail_->next.load(std::memory_order_acquire) == nullptr;
+        }
+
+    public:
+        MyMpscQueue(const MyMpscQueue& r) = delete;
+        MyMpscQueue& operator = (const MyMpscQueue& r) = delete;
+    private:
+        std::atomic<Node*> head_; //最后放入的节点, 生产者使用
+        Node* tail_; //哨兵节点, 消费者使用
+    };
+
+}
+
+#endif //MYFRAMEWORK2_MYMPSCQUEUE_H
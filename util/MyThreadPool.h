@@ -11,6 +11,7 @@
 
 #include "MyQueue.h"
 #include "MyTimeoutMap.h"
+#include "MyWorkStealingPool.h"
 using namespace std;
 
 namespace MF
@@ -33,10 +34,11 @@ namespace MF
         MyThreadPool()  = default;
 
         /**
-         * @brief 析构, 会停止所有线程
+         * @brief 析构, 执行完队列中的任务之后停止所有线程
          */
         ~MyThreadPool() {
-            stop();
+            StopAfterAllDone();
+            wait();
         }
 
         /**
@@ -121,15 +123,26 @@ namespace MF
 
         /**
          * @brief 等待线程池退出(任务队列未空，并且没有繁忙线程).
-         *
+         * 在工作线程中调用时不等待自己, 当前任务返回之后该线程直接退出, 不再访问线程池
          */
         void wait() {
             //1. 先等待所有线程都退出
             for (auto it = workers_.begin(); it != workers_.end(); ++it) {
-                (*it)->join();
+                if ((*it)->GetId() == std::this_thread::get_id()) {
+                    (*it)->detach(); //不能join自己
+                } else if ((*it)->joinable()) {
+                    (*it)->join();
+                }
             }
             workers_.clear(); //清理线程队列
-            job_queue_.clear(); //清理任务队列
+
+            //2. 线程都退出之后还在队列中的任务在当前线程执行, 保证future能够返回
+            std::shared_ptr<JobFunc> job;
+            while (job_queue_.popFront(job, 0)) {
+                if (job != nullptr && job->valid()) {
+                    (*job)();
+                }
+            }
         }
         
     protected:
@@ -142,8 +155,9 @@ namespace MF
             MyThread(MyThreadPool* pool) {
                 exit_ = false;
                 pool_ = pool;
-                //启动线程
-                std::thread t([this] () {
+                //启动线程, run在线程退出之前不能访问已经释放的MyThread
+                std::thread t([this, pool] () {
+                    currentPool() = pool;
                     this->run();
                 });
 
@@ -176,20 +190,24 @@ namespace MF
              *  @brief 线程的执行函数
              */
             void run() {
+                auto pool = pool_;
                 is_alive_ = true;
                 while (true) { //持续的循环
 
                     if (exit_) {
-                        if ((exit_after_done_ && pool_->GetJobNum() == 0)
+                        if ((exit_after_done_ && pool->GetJobNum() == 0)
                             || !exit_after_done_) { //如果完成了所有任务或者未设置该标记时，线程退出
                             break;
                         }
                     }
 
-                    auto job = pool_->GetJob();
+                    auto job = pool->GetJob();
                     if (job != nullptr && job->valid()) { //job有效，执行该任务
                         (*(job.get()))();
-                        pool_->idle(); //任务执行完了，线程空闲了
+                        if (currentPool() != pool) {
+                            return; //任务中停止了线程池, 自己已经被detach, MyThread和线程池都可能已经释放
+                        }
+                        pool->idle(); //任务执行完了，线程空闲了
                     }
                 }
                 is_alive_ = false;
@@ -219,15 +237,38 @@ namespace MF
             void join() {
                 thread_.join();
             }
+
+            /**
+             *  @brief 线程是否还没有join
+             */
+            bool joinable() const {
+                return thread_.joinable();
+            }
+
+            /**
+             *  @brief 在自己的线程中停止时不等待, 当前任务返回之后线程直接退出
+             */
+            void detach() {
+                currentPool() = nullptr;
+                thread_.detach();
+            }
         protected:
         private:
             MyThreadPool* pool_;
-            bool exit_ {false}; //退出标志 true 退出 false 继续
-            bool exit_after_done_ {false}; //线程执行完所有任务再退出
+            std::atomic<bool> exit_ {false}; //退出标志 true 退出 false 继续
+            std::atomic<bool> exit_after_done_ {false}; //线程执行完所有任务再退出
             std::thread thread_; //线程
-            bool is_alive_ {false}; //线程是否存活
+            std::atomic<bool> is_alive_ {false}; //线程是否存活
         };
 
+        /**
+         * @brief 当前线程所属的线程池, 工作线程在任务返回之后通过它判断是否已经被detach
+         */
+        static MyThreadPool*& currentPool() {
+            static thread_local MyThreadPool* current = nullptr;
+            return current;
+        }
+
     protected:
 
         /**
@@ -267,23 +308,44 @@ namespace MF
         MyThreadQueue<std::shared_ptr<JobFunc>> job_queue_; //任务队列
     };
 
+    /// handler线程池的实现
+    typedef enum enumExecutorType : uint32_t {
+        kExecutorThreadPool = 0, //加锁队列的线程池(默认)
+        kExecutorWorkStealing = 1, //work stealing线程池, 其他线程提交时只有一次短暂的加锁, 任务中提交的任务不加锁
+    }ExecutorType;
+
+    /// handler线程池, 默认使用MyThreadPool, 可以选择MyWorkStealingPool
+    /// 析构时先执行完已经提交的任务, 保证所有的future都能返回
     template<typename R>
     class MyThreadExecutor {
     public:
         /**
          *  @brief 构造函数
+         *  @param count 线程数
+         *  @param type 线程池的实现
          */
-        MyThreadExecutor(uint32_t count)  {
-            if(!pool_.initialize(count)) {
+        MyThreadExecutor(uint32_t count, ExecutorType type = kExecutorThreadPool)  {
+            bool ok = false;
+            if (type == kExecutorWorkStealing) {
+                stealingPool_.reset(new MyWorkStealingPool<R>());
+                ok = stealingPool_->initialize(count);
+            } else {
+                pool_.reset(new MyThreadPool<R>());
+                ok = pool_->initialize(count);
+            }
+            if(!ok) {
                 throw MyException("initialize executor thread pool");
             }
         }
         
         /**
-         *  @brief 析构函数
+         *  @brief 析构函数, 执行完队列中的任务之后停止所有线程
          */
         virtual ~MyThreadExecutor() {
-            pool_.stop();
+            if (stealingPool_ != nullptr) {
+                stealingPool_->stop();
+            }
+            pool_.reset();
         }
         
 
@@ -294,12 +356,28 @@ namespace MF
          */
         template<typename Predicate>
         std::future<int32_t > exec(Predicate&& pred) {
-            auto task = std::make_shared<std::packaged_task<R()>>(pred);
-            pool_.exec(task);
+            if (stealingPool_ != nullptr) {
+                std::unique_ptr<std::packaged_task<R()>> task(new std::packaged_task<R()>(std::forward<Predicate>(pred)));
+                auto future = task->get_future();
+                stealingPool_->exec(std::move(task));
+                return future;
+            }
+
+            auto task = std::make_shared<std::packaged_task<R()>>(std::forward<Predicate>(pred));
+            pool_->exec(task);
             return task->get_future();
         }
+
+        /**
+         * 获取还没有开始执行的任务数
+         * @return 任务数
+         */
+        size_t getJobNum() const {
+            return stealingPool_ != nullptr ? stealingPool_->GetJobNum() : pool_->GetJobNum();
+        }
     private:
-        MyThreadPool<R> pool_; //线程池
+        std::unique_ptr<MyThreadPool<R>> pool_; //加锁队列的线程池
+        std::unique_ptr<MyWorkStealingPool<R>> stealingPool_; //work stealing线程池
     };
 }
 #endif
@@ -0,0 +1,146 @@
+//
+// Created by mingweiliu on 2019/1/14.
+//
+
+#ifndef MYFRAMEWORK2_MYTIMINGWHEEL_H
+#define MYFRAMEWORK2_MYTIMINGWHEEL_H
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+namespace MF {
+    /// 分层时间轮
+    /// 每一层kSlotCount个槽, 上一层的一个槽等于下一层转一圈, 最多可以表示kSlotCount^kLevelCount个tick
+    /// 添加是O(1), 推进时间只处理到期的槽, 非线程安全, 只能在一个线程中使用
+    template<typename T>
+    class MyTimingWheel {
+    public:
+        typedef std::function<void (T&)> OnExpireFunc;
+
+        /**
+         *  @brief 构造函数
+         *
+         *  @param now 当前的tick
+         */
+        explicit MyTimingWheel(uint64_t now) : current_(now) {}
+
+        /**
+         *  @brief 添加一个定时任务
+         *
+         *  @param value 到期时返回的对象
+         *  @param expire 到期的tick, 已经过期的会在下一个tick到期
+         */
+        void add(T value, uint64_t expire) {
+            place(Entry{expire > current_ ? expire : current_ + 1, std::move(value)});
+            ++size_;
+        }
+
+        /**
+         *  @brief 推进到指定的tick, 依次返回所有到期的对象
+         *  回调中可以重新添加定时任务
+         *
+         *  @param now 当前的tick
+         *  @param func 到期回调
+         */
+        void advance(uint64_t now, const OnExpireFunc& func) {
+            while (current_ < now) {
+                ++current_;
+
+                //1. 下一层转完一圈, 把上一层的槽拆分到下面的层
+                for (uint32_t level = 1; level < kLevelCount; ++level) {
+                    if ((current_ & ((1ULL << (kLevelBits * level)) - 1)) != 0) {
+                        break;
+                    }
+                    cascade(level);
+                }
+
+                //2. 处理第0层当前的槽
+                std::vector<Entry> expired;
+                expired.swap(slots_[0][current_ & kSlotMask]);
+                for (auto it = expired.begin(); it != expired.end(); ++it) {
+                    if (it->expire > current_) {
+                        place(std::move(*it)); //超过时间轮范围被截断的任务
+                        continue;
+                    }
+
+                    --size_;
+                    func(it->value);
+                }
+            }
+        }
+
+        /**
+         *  @brief 获取当前的tick
+         *
+         *  @return tick
+         */
+        uint64_t current() const {
+            return current_;
+        }
+
+        /**
+         *  @brief 获取定时任务的个数
+         *
+         *  @return 个数
+         */
+        size_t size() const {
+            return size_;
+        }
+
+    private:
+        static const uint32_t kLevelBits = 8;
+        static const uint32_t kSlotCount = 1 << kLevelBits;
+        static const uint64_t kSlotMask = kSlotCount - 1;
+        static const uint32_t kLevelCount = 4;
+
+        struct Entry {
+            uint64_t expire; //到期的tick
+            T value;
+        };
+
+        /**
+         *  @brief 根据到期时间放入对应层的槽
+         *
+         *  @param entry 定时任务
+         */
+        void place(Entry&& entry) {
+            //超过时间轮的范围, 先放在最远的位置, 到期后重新放置
+            uint64_t diff = entry.expire > current_ ? entry.expire - current_ : 0;
+            uint64_t maxDiff = (1ULL << (kLevelBits * kLevelCount)) - 1;
+            uint64_t expire = diff > maxDiff ? current_ + maxDiff : entry.expire;
+            diff = diff > maxDiff ? maxDiff : diff;
+
+            uint32_t level = 0;
+            while (level + 1 < kLevelCount && diff >= (1ULL << (kLevelBits * (level + 1)))) {
+                ++level;
+            }
+
+            auto index = (expire >> (kLevelBits * level)) & kSlotMask;
+            slots_[level][index].push_back(std::move(entry));
+        }
+
+        /**
+         *  @brief 把一个槽中的任务重新放置到下面的层
+         *
+         *  @param level 层
+         */
+        void cascade(uint32_t level) {
+            std::vector<Entry> entries;
+            entries.swap(slots_[level][(current_ >> (kLevelBits * level)) & kSlotMask]);
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                place(std::move(*it));
+            }
+        }
+
+    public:
+        MyTimingWheel(const MyTimingWheel& r) = delete;
+        MyTimingWheel& operator = (const MyTimingWheel& r) = delete;
+    private:
+        std::vector<Entry> slots_[kLevelCount][kSlotCount]; //所有的槽
+        uint64_t current_; //当前的tick
+        size_t size_ {0}; //定时任务的个数
+    };
+}
+
+#endif //MYFRAMEWORK2_MYTIMINGWHEEL_H
@@ -0,0 +1,167 @@
+//
+// Created by mingweiliu on 2019/1/28.
+//
+
+#ifndef MYFRAMEWORK2_MYWORKSTEALINGDEQUE_H
+#define MYFRAMEWORK2_MYWORKSTEALINGDEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace MF {
+    /// Chase-Lev work stealing deque, 内存序参考 Lê et al. (PPoPP 2013)
+    /// 只有所属线程可以push/pop(从底部), 其他线程只能steal(从顶部)
+    /// 元素为指针, 空间不够时所属线程扩容, 旧的数组在析构时释放, 因为steal可能还在读取
+    template<typename T>
+    class MyWorkStealingDeque {
+    private:
+        struct Array {
+            int64_t capacity;
+            int64_t mask;
+            std::atomic<T*>* items;
+
+            explicit Array(int64_t capacity) : capacity(capacity), mask(capacity - 1) {
+                items = new std::atomic<T*>[capacity];
+            }
+
+            ~Array() {
+                delete[] items;
+            }
+
+            T* get(int64_t i) const {
+                return items[i & mask].load(std::memory_order_relaxed);
+            }
+
+            void put(int64_t i, T* x) {
+                items[i & mask].store(x, std::memory_order_relaxed);
+            }
+
+            /**
+             *  @brief 扩容为两倍, 拷贝[top, bottom)之间的元素
+             */
+            Array* grow(int64_t bottom, int64_t top) const {
+                auto array = new Array(capacity * 2);
+                for (int64_t i = top; i < bottom; ++i) {
+                    array->put(i, get(i));
+                }
+                return array;
+            }
+        };
+
+    public:
+        /**
+         *  @brief 构造函数
+         *
+         *  @param capacity 初始容量, 2的幂
+         */
+        explicit MyWorkStealingDeque(int64_t capacity = 256) {
+            auto array = new Array(capacity);
+            array_.store(array, std::memory_order_relaxed);
+            garbage_.push_back(array);
+        }
+
+        /**
+         *  @brief 析构函数, 不释放没有取出的元素
+         */
+        ~MyWorkStealingDeque() {
+            for (auto array : garbage_) {
+                delete array;
+            }
+        }
+
+        MyWorkStealingDeque(const MyWorkStealingDeque&) = delete;
+        MyWorkStealingDeque& operator=(const MyWorkStealingDeque&) = delete;
+
+        /**
+         *  @brief 放入底部, 只能在所属线程调用
+         *
+         *  @param x 元素
+         */
+        void push(T* x) {
+            auto b = bottom_.load(std::memory_order_relaxed);
+            auto t = top_.load(std::memory_order_acquire);
+            auto array = array_.load(std::memory_order_relaxed);
+            if (b - t > array->capacity - 1) {
+                array = array->grow(b, t);
+                garbage_.push_back(array);
+                array_.store(array, std::memory_order_release);
+            }
+            array->put(b, x);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+
+        /**
+         *  @brief 从底部取出, 只能在所属线程调用
+         *
+         *  @return 元素, 为空时返回nullptr
+         */
+        T* pop() {
+            auto b = bottom_.load(std::memory_order_relaxed) - 1;
+            auto array = array_.load(std::memory_order_relaxed);
+            bottom_.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto t = top_.load(std::memory_order_relaxed);
+
+            //1. 已经空了
+            if (t > b) {
+                bottom_.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            //2. 还有多个元素, 不会和steal冲突
+            T* x = array->get(b);
+            if (t < b) {
+                return x;
+            }
+
+            //3. 最后一个元素, 和steal竞争
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                x = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return x;
+        }
+
+        /**
+         *  @brief 从顶部偷取, 可以在任意线程调用
+         *
+         *  @return 元素, 为空或者竞争失败时返回nullptr
+         */
+        T* steal() {
+            auto t = top_.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto b = bottom_.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+
+            auto array = array_.load(std::memory_order_acquire);
+            T* x = array->get(t);
+            if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return x;
+        }
+
+        /**
+         *  @brief 获取元素个数, 其他线程调用时只是近似值
+         *
+         *  @return 个数
+         */
+        int64_t size() const {
+            auto b = bottom_.load(std::memory_order_relaxed);
+            auto t = top_.load(std::memory_order_relaxed);
+            return b > t ? b - t : 0;
+        }
+
+    private:
+        alignas(64) std::atomic<int64_t> top_ {0}; //steal的位置
+        alignas(64) std::atomic<int64_t> bottom_ {0}; //push/pop的位置
+        std::atomic<Array*> array_ {nullptr}; //当前的数组
+        std::vector<Array*> garbage_; //所有分配过的数组, 只在所属线程修改
+    };
+}
+
+#endif //MYFRAMEWORK2_MYWORKSTEALINGDEQUE_H
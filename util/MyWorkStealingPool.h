@@ -0,0 +1,325 @@
+//
+// Created by mingweiliu on 2019/1/28.
+//
+
+#ifndef MYFRAMEWORK2_MYWORKSTEALINGPOOL_H
+#define MYFRAMEWORK2_MYWORKSTEALINGPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "util/MyEventCount.h"
+#include "util/MyWorkStealingDeque.h"
+
+namespace MF {
+    /// work stealing线程池
+    /// 1. 其他线程(例如io线程)提交的任务放入全局队列, 工作线程一次取出一批放到自己的deque
+    /// 2. 工作线程中提交的任务直接放入自己的deque, 不加锁
+    /// 3. 自己没有任务时从其他线程的deque偷取, 都没有时通过event count等待
+    template<typename R>
+    class MyWorkStealingPool {
+    public:
+        //job function
+        using JobFunc = std::packaged_task<R ()>;
+
+        /**
+         * @brief 构造函数
+         */
+        MyWorkStealingPool() = default;
+
+        /**
+         * @brief 析构, 执行完已经提交的任务之后停止所有线程
+         */
+        ~MyWorkStealingPool() {
+            stop();
+        }
+
+        MyWorkStealingPool(const MyWorkStealingPool&) = delete;
+        MyWorkStealingPool& operator=(const MyWorkStealingPool&) = delete;
+
+        /**
+         * @brief 初始化
+         *
+         * @param num 工作线程个数
+         *
+         * @return true 成功 false 失败
+         */
+        bool initialize(size_t num) {
+            //1. 停止上次的线程
+            stop();
+
+            //2. 先构造所有的deque, 线程启动之后就可能互相偷取
+            exit_.store(false, std::memory_order_relaxed);
+            for (size_t i = 0; i < num; ++i) {
+                workers_.emplace_back(new Worker());
+            }
+
+            //3. 启动线程
+            for (size_t i = 0; i < num; ++i) {
+                workers_[i]->thread = std::thread([this, i]() {
+                    this->run(static_cast<uint32_t >(i));
+                });
+            }
+            return true;
+        }
+
+        /**
+         * @brief 获取线程个数
+         *
+         * @return 线程个数
+         */
+        size_t GetThreadNum() const {
+            return workers_.size();
+        }
+
+        /**
+         * @brief 获取还没有开始执行的任务数
+         *
+         * @return 任务数
+         */
+        size_t GetJobNum() const {
+            auto count = pending_.load(std::memory_order_relaxed);
+            return count > 0 ? static_cast<size_t >(count) : 0;
+        }
+
+        /**
+         * @brief 停止并等待所有线程退出, 已经提交的任务都会执行完, 之后提交的任务在提交的线程直接执行
+         * 在工作线程中调用时不等待自己: 先在当前线程执行完自己deque中的任务, 当前任务返回之后该线程直接退出,
+         * 不再访问线程池, 所以任务中可以停止并释放线程池
+         */
+        void stop() {
+            //任务中再次停止时直接返回, 由外层的stop执行完
+            if (stopping_.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+
+            //1. 通知所有线程退出, 和exec互斥, 之后全局队列不会再增加
+            {
+                std::lock_guard<std::mutex> guard(injectMutex_);
+                exit_.store(true, std::memory_order_seq_cst);
+            }
+            idle_.notifyAll();
+
+            //2. 工作线程执行完所有的任务之后退出, 当前是工作线程时执行完自己的任务, 不能join自己
+            auto& current = currentWorker();
+            for (size_t i = 0; i < workers_.size(); ++i) {
+                auto& worker = *workers_[i];
+                if (current.pool == this && current.index == i) {
+                    current.pool = nullptr; //run在当前任务返回之后直接退出
+                    worker.thread.detach();
+                    runAll(worker.deque);
+                } else if (worker.thread.joinable()) {
+                    worker.thread.join();
+                }
+            }
+
+            //3. 所有线程都退出之后剩下的任务在当前线程执行, 保证future能够返回
+            for (auto& worker : workers_) {
+                runAll(worker->deque);
+            }
+            std::deque<JobFunc*> jobs;
+            {
+                std::lock_guard<std::mutex> guard(injectMutex_);
+                jobs.swap(injectQueue_);
+                injectSize_.store(0, std::memory_order_relaxed);
+            }
+            for (auto job : jobs) {
+                runJob(job);
+            }
+            workers_.clear();
+            stopping_.store(false, std::memory_order_release);
+        }
+
+        /**
+         * @brief 添加任务, 马上返回
+         * 已经停止或者没有工作线程时在当前线程直接执行, 保证future能够返回
+         *
+         * @param job 任务
+         */
+        void exec(std::unique_ptr<JobFunc> job) {
+            //1. 工作线程提交的任务放入自己的deque, 其他线程提交的放入全局队列
+            auto& current = currentWorker();
+            if (current.pool == this && !exit_.load(std::memory_order_acquire)) {
+                pending_.fetch_add(1, std::memory_order_relaxed);
+                workers_[current.index]->deque.push(job.release());
+            } else {
+                //和stop中清空全局队列互斥, 放入之后一定会被执行或者被释放
+                std::unique_lock<std::mutex> guard(injectMutex_);
+                if (exit_.load(std::memory_order_acquire) || workers_.empty()) {
+                    guard.unlock();
+                    (*job)();
+                    return;
+                }
+                pending_.fetch_add(1, std::memory_order_relaxed);
+                injectQueue_.push_back(job.release());
+                injectSize_.store(injectQueue_.size(), std::memory_order_relaxed);
+            }
+
+            //2. 有空闲线程时唤醒一个
+            idle_.notifyOne();
+        }
+
+    protected:
+        //工作线程
+        struct Worker {
+            MyWorkStealingDeque<JobFunc> deque; //自己的任务
+            std::thread thread; //线程
+        };
+
+        //当前线程所属的线程池
+        struct CurrentWorker {
+            MyWorkStealingPool* pool {nullptr};
+            uint32_t index {0};
+            uint32_t seed {0}; //选择偷取对象的随机数
+        };
+
+        static CurrentWorker& currentWorker() {
+            static thread_local CurrentWorker current;
+            return current;
+        }
+
+        /**
+         * @brief 线程的执行函数
+         *
+         * @param index 线程的下标
+         */
+        void run(uint32_t index) {
+            auto& current = currentWorker();
+            current.pool = this;
+            current.index = index;
+            current.seed = index * 2654435761U + 1;
+
+            while (true) {
+                //1. 查找任务, 短暂自旋之后再等待, 避免突发的任务每次都需要唤醒
+                auto job = findJob(index);
+                for (uint32_t i = 0; job == nullptr && i < kSpinRounds; ++i) {
+                    std::this_thread::yield();
+                    job = findJob(index);
+                }
+
+                //2. 准备等待之后再检查一次, 避免错过通知
+                //   先看到退出标志再确认没有任务时才退出, 自己deque中的任务只有自己能保证取到
+                if (job == nullptr) {
+                    auto key = idle_.prepareWait();
+                    bool exiting = exit_.load(std::memory_order_acquire);
+                    job = findJob(index);
+                    if (job != nullptr || exiting) {
+                        idle_.cancelWait();
+                    } else {
+                        idle_.wait(key);
+                        continue;
+                    }
+                }
+
+                if (job == nullptr) {
+                    break; //退出
+                }
+
+                //3. 执行任务, 任务中停止了线程池时自己已经被detach, 线程池可能已经释放
+                runJob(job);
+                if (current.pool != this) {
+                    return;
+                }
+            }
+
+            current.pool = nullptr;
+        }
+
+        /**
+         * @brief 执行一个任务
+         *
+         * @param job 任务, 执行之后释放
+         */
+        void runJob(JobFunc* job) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            std::unique_ptr<JobFunc> task(job);
+            (*task)();
+        }
+
+        /**
+         * @brief 在当前线程执行完deque中的任务, 只能由deque的所有者或者在所有线程退出之后调用
+         *
+         * @param deque 任务队列
+         */
+        void runAll(MyWorkStealingDeque<JobFunc>& deque) {
+            while (auto job = deque.pop()) {
+                runJob(job);
+            }
+        }
+
+        /**
+         * @brief 查找任务: 自己的deque, 全局队列, 其他线程的deque
+         *
+         * @param index 线程的下标
+         *
+         * @return 任务, 没有时返回nullptr
+         */
+        JobFunc* findJob(uint32_t index) {
+            auto& self = workers_[index]->deque;
+            //1. 自己的deque, 后进先出, 数据还在cache中
+            auto job = self.pop();
+            if (job != nullptr) {
+                return job;
+            }
+
+            //2. 全局队列, 一次取出一批, 剩下的放到自己的deque给其他线程偷取
+            if (injectSize_.load(std::memory_order_relaxed) > 0) {
+                std::lock_guard<std::mutex> guard(injectMutex_);
+                if (!injectQueue_.empty()) {
+                    auto count = std::min(kInjectBatch, injectQueue_.size() / workers_.size() + 1);
+                    job = injectQueue_.front();
+                    injectQueue_.pop_front();
+                    for (size_t i = 1; i < count; ++i) {
+                        self.push(injectQueue_.front());
+                        injectQueue_.pop_front();
+                    }
+                    injectSize_.store(injectQueue_.size(), std::memory_order_relaxed);
+                    if (count > 1) {
+                        idle_.notifyOne(); //其他空闲线程可以偷取
+                    }
+                    return job;
+                }
+            }
+
+            //3. 从随机的线程开始偷取, 避免所有线程都从同一个开始
+            auto& current = currentWorker();
+            current.seed ^= current.seed << 13;
+            current.seed ^= current.seed >> 17;
+            current.seed ^= current.seed << 5;
+            auto size = static_cast<uint32_t >(workers_.size());
+            auto start = current.seed % size;
+            for (uint32_t i = 0; i < size; ++i) {
+                auto victim = (start + i) % size;
+                if (victim == index) {
+                    continue;
+                }
+                job = workers_[victim]->deque.steal();
+                if (job != nullptr) {
+                    return job;
+                }
+            }
+            return nullptr;
+        }
+
+    protected:
+        static constexpr uint32_t kSpinRounds = 8; //没有任务时等待之前的自旋次数
+        static constexpr size_t kInjectBatch = 32; //一次从全局队列取出的最大任务数
+
+        std::vector<std::unique_ptr<Worker>> workers_; //所有的线程
+        std::atomic<bool> exit_ {false}; //退出标志
+        std::atomic<bool> stopping_ {false}; //正在停止, 避免任务中重入stop
+        std::atomic<int64_t> pending_ {0}; //还没有开始执行的任务数
+        MyEventCount idle_; //空闲线程等待新的任务
+
+        std::mutex injectMutex_; //全局队列的锁
+        std::deque<JobFunc*> injectQueue_; //其他线程提交的任务
+        std::atomic<size_t> injectSize_ {0}; //全局队列的长度, 为0时不加锁
+    };
+}
+
+#endif //MYFRAMEWORK2_MYWORKSTEALINGPOOL_H